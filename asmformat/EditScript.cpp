@@ -0,0 +1,57 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\EditScript.cpp
+ *
+ * Edit script definitions
+ *
+*/
+
+#include "pch.hpp"
+#include "EditScript.hpp"
+
+
+void EditScript::Reserve(std::size_t lines)
+{
+	begin.reserve(lines);
+	origin.reserve(lines);
+	length.reserve(lines);
+	indent.reserve(lines);
+	label.reserve(lines);
+	code_begin.reserve(lines);
+	code_end.reserve(lines);
+	comment.reserve(lines);
+	column.reserve(lines);
+	blanks_after.reserve(lines);
+	drop.reserve(lines);
+}
+
+std::size_t EditScript::Append(std::size_t offset, std::size_t size, std::size_t input)
+{
+	assert(size < NO_COMMENT);
+	const std::uint32_t line_size = static_cast<std::uint32_t>(size);
+
+	begin.push_back(offset);
+	origin.push_back(input);
+	length.push_back(line_size);
+	indent.push_back(Indent::None);
+	label.push_back(0);
+	code_begin.push_back(0);
+	code_end.push_back(line_size);
+	comment.push_back(NO_COMMENT);
+	column.push_back(0);
+	blanks_after.push_back(0);
+	drop.push_back(0);
+
+	return begin.size() - 1;
+}
+
+std::size_t EditScript::Size() const noexcept
+{
+	return begin.size();
+}
@@ -0,0 +1,406 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\EditScript.hpp
+ *
+ * Edit script which describes how to format each line and its renderer
+ *
+ * Formatter analyzes lines and records decisions into edit script without modifying any text,
+ * renderer then produces formatted text out of edit script and lines of unformatted text.
+ * Offsets of edit script refer to source text, thus it can be turned into a diff or text edits as well.
+ * Lines which are rendered the same as they are in input text before trimming are copied from input,
+ * consecutive lines at once, such that text which is already formatted is copied in a few large runs.
+ *
+*/
+
+#pragma once
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+/**
+ * @brief Kind of indentation inserted at the beginning of line
+*/
+enum class Indent : std::uint8_t
+{
+	None,
+	Tab		// Single tab or tab_width spaces
+};
+
+/**
+ * Edit script with one entry per line of source text, stored as struct of arrays.
+ * Offsets other than begin are relative to the beginning of line, line break is not part of line.
+ * Entry which is appended is a no-op, that is line is rendered as is.
+*/
+struct EditScript
+{
+	// Value of comment for lines without comment
+	static constexpr std::uint32_t NO_COMMENT = std::numeric_limits<std::uint32_t>::max();
+
+	// Offset of line in source text
+	std::vector<std::size_t> begin;
+	// Offset of line in input text before trimming, lines of input are contiguous thus line ends where the next begins
+	std::vector<std::size_t> origin;
+	// Length of line
+	std::vector<std::uint32_t> length;
+	// Indentation inserted before code or comment
+	std::vector<Indent> indent;
+	// Length of label which is moved onto its own line, 0 if line is not split
+	std::vector<std::uint32_t> label;
+	// Code span which is kept, empty for comment lines
+	std::vector<std::uint32_t> code_begin;
+	std::vector<std::uint32_t> code_end;
+	// Beginning of comment text after semicolon and spaces, NO_COMMENT if there is no comment
+	std::vector<std::uint32_t> comment;
+	// Display column at which inline comment starts, 0 if comment is not aligned
+	std::vector<std::uint32_t> column;
+	// Count of blank lines inserted after line
+	std::vector<std::uint8_t> blanks_after;
+	// Line is removed
+	std::vector<std::uint8_t> drop;
+
+	/**
+	 * @brief		Reserve memory for lines
+	 * @param lines	Expected count of lines
+	*/
+	void Reserve(std::size_t lines);
+
+	/**
+	 * @brief			Append no-op entry for a line
+	 * @param offset	Offset of line in source text
+	 * @param size		Length of line excluding line break
+	 * @param input		Offset of line in input text
+	 * @return			Index of entry
+	*/
+	std::size_t Append(std::size_t offset, std::size_t size, std::size_t input);
+
+	/**
+	 * @brief	Get count of lines
+	 * @return	Count of entries
+	*/
+	[[nodiscard]] std::size_t Size() const noexcept;
+};
+
+/**
+ * @brief				Get display width of text which starts on a tab stop
+ * @tparam StringType	std::string or std::string_view
+ * @param text			Text which to measure
+ * @param tab_width		Count of columns between tab stops
+ * @return				Count of columns occupied by text
+*/
+template<typename StringType>
+[[nodiscard]] std::size_t DisplayWidth(const StringType& text, std::size_t tab_width) noexcept
+{
+	std::size_t column = 0;
+
+	for (const auto ch : text)
+	{
+		if (ch == static_cast<typename StringType::value_type>('\t'))
+			column += tab_width - column % tab_width;
+		else ++column;
+	}
+
+	return column;
+}
+
+/**
+ * @brief				Get count of tabs or spaces which move inline comment to its column
+ * @tparam CharType		char or wchar_t
+ * @param script		Edit script
+ * @param index			Index of line with aligned comment
+ * @param line			Text of line
+ * @param tab_width		Count of columns between tab stops
+ * @param spaces		Pad with spaces instead of tabs?
+ * @return				Count of padding characters
+*/
+template<typename CharType>
+[[nodiscard]] std::size_t CommentPadding(const EditScript& script, std::size_t index, std::basic_string_view<CharType> line, std::size_t tab_width, bool spaces) noexcept
+{
+	// Column at which code ends, indentation occupies one tab stop
+	std::size_t column = script.indent[index] == Indent::Tab ? tab_width : 0;
+	column += DisplayWidth(line.substr(script.code_begin[index], script.code_end[index] - script.code_begin[index]), tab_width);
+
+	assert((script.column[index] > column) && (script.column[index] % tab_width == 0));
+
+	if (spaces)
+		return script.column[index] - column;
+
+	// Each tab advances to the next tab stop
+	return script.column[index] / tab_width - column / tab_width;
+}
+
+/**
+ * @brief				Get text of line in input text
+ * @tparam CharType		char or wchar_t
+ * @param script		Edit script
+ * @param index			Index of line
+ * @param input			Text before trimming to which origin offsets refer, ending with line break of the last line
+ * @return				Text of line including line break
+*/
+template<typename CharType>
+[[nodiscard]] std::basic_string_view<CharType> InputLine(const EditScript& script, std::size_t index, std::basic_string_view<CharType> input) noexcept
+{
+	const std::size_t end = index + 1 < script.Size() ? script.origin[index + 1] : input.size();
+	return input.substr(script.origin[index], end - script.origin[index]);
+}
+
+/**
+ * @brief				Copy lines to which edit script refers into source text, edit script refers to source text afterwards
+ * @tparam StringType	std::string
+ * @param script		Edit script whose lines refer to text other than source text, ex. input text before trimming
+ * @param text			Text to which edit script refers
+ * @param linebreak		Line break which ends every line
+ * @param source		Source text to which lines are appended
+*/
+template<typename StringType>
+void CopyScriptLines(EditScript& script, std::basic_string_view<typename StringType::value_type> text, const StringType& linebreak, StringType& source)
+{
+	for (std::size_t index = 0; index < script.Size(); ++index)
+	{
+		const std::size_t begin = source.size();
+
+		source.append(text.substr(script.begin[index], script.length[index]));
+		source.append(linebreak);
+		script.begin[index] = begin;
+	}
+}
+
+/**
+ * @brief				Check if line would be rendered exactly as it is in input text, including line break
+ * @tparam CharType		char or wchar_t
+ * @param script		Edit script
+ * @param index			Index of line
+ * @param line			Text of line in source text
+ * @param original		Text of line in input text, including line break
+ * @param tab			Indentation, tab or tab_width spaces
+ * @param tab_width		Count of columns between tab stops
+ * @param spaces		Align inline comments with spaces instead of tabs?
+ * @param linebreak		Line break which ends every line
+ * @return				true if line can be copied from input text
+*/
+template<typename CharType>
+[[nodiscard]] bool IsRenderedAsInput(const EditScript& script, std::size_t index, std::basic_string_view<CharType> line, std::basic_string_view<CharType> original,
+	std::basic_string_view<CharType> tab, std::size_t tab_width, bool spaces, std::basic_string_view<CharType> linebreak) noexcept
+{
+	// Lines which are split, removed or followed by inserted blank lines differ from input
+	if (script.drop[index] || (script.label[index] != 0) || (script.blanks_after[index] != 0) || !original.ends_with(linebreak))
+		return false;
+
+	original.remove_suffix(linebreak.size());
+
+	if (script.indent[index] == Indent::Tab)
+	{
+		if (!original.starts_with(tab))
+			return false;
+
+		original.remove_prefix(tab.size());
+	}
+
+	const std::basic_string_view<CharType> code = line.substr(script.code_begin[index], script.code_end[index] - script.code_begin[index]);
+
+	if (!original.starts_with(code))
+		return false;
+
+	original.remove_prefix(code.size());
+
+	if (script.comment[index] == EditScript::NO_COMMENT)
+		return original.empty();
+
+	if (script.column[index] != 0)
+	{
+		const std::size_t padding = CommentPadding(script, index, line, tab_width, spaces);
+		const CharType pad = static_cast<CharType>(spaces ? ' ' : '\t');
+
+		if ((original.size() < padding) || (original.find_first_not_of(pad) < padding))
+			return false;
+
+		original.remove_prefix(padding);
+	}
+
+	// Semicolon and single space followed by comment text
+	const std::basic_string_view<CharType> comment = line.substr(script.comment[index]);
+
+	return (original.size() == 2 + comment.size()) && (original[0] == static_cast<CharType>(';')) &&
+		(original[1] == static_cast<CharType>(' ')) && original.ends_with(comment);
+}
+
+/**
+ * @brief				Check if rendering edit script would reproduce input text, that is file is formatted already
+ * @tparam CharType		char or wchar_t
+ * @param script		Edit script
+ * @param source		Text to which edit script refers
+ * @param input			Text before trimming to which origin offsets refer, ending with line break of the last line
+ * @param tab			Indentation, tab or tab_width spaces
+ * @param tab_width		Count of columns between tab stops
+ * @param spaces		Align inline comments with spaces instead of tabs?
+ * @param linebreak		Line break which ends every line
+ * @return				true if every line is rendered as it is in input
+*/
+template<typename CharType>
+[[nodiscard]] bool IsInputFormatted(const EditScript& script, std::basic_string_view<CharType> source, std::basic_string_view<CharType> input,
+	std::basic_string_view<CharType> tab, std::size_t tab_width, bool spaces, std::basic_string_view<CharType> linebreak) noexcept
+{
+	for (std::size_t index = 0; index < script.Size(); ++index)
+	{
+		const std::basic_string_view<CharType> line = source.substr(script.begin[index], script.length[index]);
+
+		if (!IsRenderedAsInput(script, index, line, InputLine(script, index, input), tab, tab_width, spaces, linebreak))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief				Check if rendering edit script would reproduce source text
+ * @tparam CharType		char or wchar_t
+ * @param script		Edit script
+ * @param source		Text to which edit script refers
+ * @return				true if every line is rendered as is
+*/
+template<typename CharType>
+[[nodiscard]] bool IsNoOp(const EditScript& script, std::basic_string_view<CharType> source) noexcept
+{
+	for (std::size_t index = 0; index < script.Size(); ++index)
+	{
+		if (script.drop[index] || (script.blanks_after[index] != 0) || (script.label[index] != 0) ||
+			(script.indent[index] != Indent::None) || (script.code_begin[index] != 0))
+			return false;
+
+		if (script.comment[index] == EditScript::NO_COMMENT)
+		{
+			if (script.code_end[index] != script.length[index])
+				return false;
+		}
+		// Comment line which already has single space after semicolon
+		else if ((script.column[index] != 0) || (script.code_end[index] != 0) || (script.comment[index] != 2) ||
+			(source[script.begin[index] + 1] != static_cast<CharType>(' ')))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief				Render edit script into formatted text
+ * @tparam StringType	std::string
+ * @param script		Edit script
+ * @param source		Text to which edit script refers
+ * @param input			Text before trimming to which origin offsets refer, ending with line break of the last line
+ * @param tab			Indentation, tab or tab_width spaces
+ * @param tab_width		Count of columns between tab stops
+ * @param spaces		Align inline comments with spaces instead of tabs?
+ * @param linebreak		Line break which ends every line
+ * @return				Formatted text, its size is computed upfront so that memory is allocated only once
+*/
+template<typename StringType>
+[[nodiscard]] StringType RenderEditScript(const EditScript& script, std::basic_string_view<typename StringType::value_type> source,
+	std::basic_string_view<typename StringType::value_type> input, const StringType& tab, std::size_t tab_width, bool spaces, const StringType& linebreak)
+{
+	using CharType = typename StringType::value_type;
+	const CharType pad = static_cast<CharType>(spaces ? ' ' : '\t');
+
+	std::size_t size = 0;
+
+	for (std::size_t index = 0; index < script.Size(); ++index)
+	{
+		if (script.drop[index])
+			continue;
+
+		const std::basic_string_view<CharType> line = source.substr(script.begin[index], script.length[index]);
+
+		if (script.label[index] != 0)
+			size += script.label[index] + linebreak.size();
+
+		if (script.indent[index] == Indent::Tab)
+			size += tab.size();
+
+		size += script.code_end[index] - script.code_begin[index];
+
+		if (script.comment[index] != EditScript::NO_COMMENT)
+		{
+			if (script.column[index] != 0)
+				size += CommentPadding(script, index, line, tab_width, spaces);
+
+			// Semicolon and single space
+			size += 2 + line.size() - script.comment[index];
+		}
+
+		size += linebreak.size() * (1 + script.blanks_after[index]);
+	}
+
+	StringType result;
+	result.reserve(size);
+
+	// Run of input text made of lines which are rendered as they are in input, copied at once
+	std::size_t run_begin = 0;
+	std::size_t run_end = 0;
+
+	for (std::size_t index = 0; index < script.Size(); ++index)
+	{
+		if (script.drop[index])
+			continue;
+
+		const std::basic_string_view<CharType> line = source.substr(script.begin[index], script.length[index]);
+		const std::basic_string_view<CharType> original = InputLine(script, index, input);
+		const std::size_t origin_end = script.origin[index] + original.size();
+
+		if (IsRenderedAsInput<CharType>(script, index, line, original, tab, tab_width, spaces, linebreak))
+		{
+			// Run is continued unless lines in between were removed
+			if (script.origin[index] != run_end)
+			{
+				result.append(input.substr(run_begin, run_end - run_begin));
+				run_begin = script.origin[index];
+			}
+
+			run_end = origin_end;
+			continue;
+		}
+
+		result.append(input.substr(run_begin, run_end - run_begin));
+		run_begin = run_end = origin_end;
+
+		if (script.label[index] != 0)
+		{
+			result.append(line.substr(0, script.label[index]));
+			result.append(linebreak);
+		}
+
+		if (script.indent[index] == Indent::Tab)
+			result.append(tab);
+
+		result.append(line.substr(script.code_begin[index], script.code_end[index] - script.code_begin[index]));
+
+		if (script.comment[index] != EditScript::NO_COMMENT)
+		{
+			if (script.column[index] != 0)
+				result.append(CommentPadding(script, index, line, tab_width, spaces), pad);
+
+			result += static_cast<CharType>(';');
+			result += static_cast<CharType>(' ');
+			result.append(line.substr(script.comment[index]));
+		}
+
+		result.append(linebreak);
+
+		for (std::uint8_t blank = 0; blank < script.blanks_after[index]; ++blank)
+			result.append(linebreak);
+	}
+
+	result.append(input.substr(run_begin, run_end - run_begin));
+
+	assert(result.size() == size);
+	return result;
+}
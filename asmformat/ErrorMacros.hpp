@@ -77,6 +77,7 @@
 // ShowError function
 #define ERR_FUNC wsl::ShowErrorA
 #define ShowCrtError wsl::ShowCrtErrorA
+#define ShowErrorMessage wsl::ShowErrorMessageA
 
 // Expansion macros
 #define GET_ERR_FUNC(N1, N2, N3, N4, N5, N6, FUNC, ...) FUNC
@@ -127,6 +128,8 @@
 // Not used
 #define ShowCrtError(...) EMPTY_STATEMENT
 // Not used
+#define ShowErrorMessage(...) EMPTY_STATEMENT
+// Not used
 #define CHECK_HR(hresult) EMPTY_STATEMENT
 // Not used
 #define CHECK_HR_RETURN(hresult) EMPTY_STATEMENT
@@ -0,0 +1,459 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\Filter.cpp
+ *
+ * Definitions used to select files to format while searching directories
+ *
+*/
+
+#include "pch.hpp"
+#include "Filter.hpp"
+#include "Logger.hpp"
+#include "StringCast.hpp"
+#include "error.hpp"
+using namespace wsl;
+namespace fs = std::filesystem;
+
+
+/**
+ * @brief Rules of a single .asmformatignore file
+*/
+struct IgnoreFile
+{
+	// Path of directory which contains ignore file relative to the searched directory, ending with /
+	std::string base;
+	std::vector<Glob> rules;
+};
+
+/**
+ * @brief		Convert ASCII character to lower case, other characters are unchanged
+ * @param ch	Character to convert
+ * @return		Lower case character
+*/
+[[nodiscard]] static constexpr char ToLower(char ch) noexcept
+{
+	return ((ch >= 'A') && (ch <= 'Z')) ? static_cast<char>(ch - 'A' + 'a') : ch;
+}
+
+/**
+ * @brief			Compare strings ignoring case of ASCII characters
+ * @param lhs		First string
+ * @param rhs		Second string
+ * @return			true if strings are equal
+*/
+[[nodiscard]] static bool EqualsNoCase(std::string_view lhs, std::string_view rhs) noexcept
+{
+	return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](char a, char b)
+	{
+		return ToLower(a) == ToLower(b);
+	});
+}
+
+/**
+ * @brief			Match single character against ? or [] token or literal character
+ * @param pattern	Pattern which contains the token
+ * @param pos		Position of the token, receives position of the next token if matched
+ * @param ch		Character to match
+ * @return			true if character matches the token
+*/
+[[nodiscard]] static bool MatchToken(std::string_view pattern, std::size_t& pos, char ch) noexcept
+{
+	if (pattern[pos] == '?')
+	{
+		++pos;
+		return true;
+	}
+
+	if (pattern[pos] == '[')
+	{
+		std::size_t i = pos + 1;
+		const bool negated = (i < pattern.size()) && ((pattern[i] == '!') || (pattern[i] == '^'));
+
+		if (negated)
+			++i;
+
+		// ] right after [ or [! is literal
+		const std::size_t end = pattern.find(']', i + 1);
+
+		if ((i < pattern.size()) && (end != std::string_view::npos))
+		{
+			bool matched = false;
+
+			for (; i < end; ++i)
+			{
+				if ((i + 2 < end) && (pattern[i + 1] == '-'))
+				{
+					matched = matched || ((ToLower(ch) >= ToLower(pattern[i])) && (ToLower(ch) <= ToLower(pattern[i + 2])));
+					i += 2;
+				}
+				else matched = matched || (ToLower(ch) == ToLower(pattern[i]));
+			}
+
+			if (matched == negated)
+				return false;
+
+			pos = end + 1;
+			return true;
+		}
+
+		// [ without ] is literal
+	}
+
+	if (ToLower(pattern[pos]) != ToLower(ch))
+		return false;
+
+	++pos;
+	return true;
+}
+
+/**
+ * @brief			Match name against pattern with wildcards, * backtracks to the last * only
+ * @param pattern	Pattern of a single path segment
+ * @param name		Name to match
+ * @return			true if name matches
+*/
+[[nodiscard]] static bool MatchWildcard(std::string_view pattern, std::string_view name) noexcept
+{
+	std::size_t pos = 0;
+	std::size_t index = 0;
+	std::size_t star = std::string_view::npos;
+	std::size_t mark = 0;
+
+	while (index < name.size())
+	{
+		if ((pos < pattern.size()) && (pattern[pos] == '*'))
+		{
+			star = pos++;
+			mark = index;
+		}
+		else if ((pos < pattern.size()) && MatchToken(pattern, pos, name[index]))
+		{
+			++index;
+		}
+		else if (star != std::string_view::npos)
+		{
+			// Let the last * consume one more character
+			pos = star + 1;
+			index = ++mark;
+		}
+		else return false;
+	}
+
+	while ((pos < pattern.size()) && (pattern[pos] == '*'))
+		++pos;
+
+	return pos == pattern.size();
+}
+
+Glob::Glob(std::string_view pattern) :
+	mBasename(false),
+	mDirectory(false),
+	mNegated(false)
+{
+	if (pattern.starts_with('!'))
+	{
+		mNegated = true;
+		pattern.remove_prefix(1);
+	}
+
+	if (pattern.ends_with('/'))
+	{
+		mDirectory = true;
+		pattern.remove_suffix(1);
+	}
+
+	// Leading / only anchors glob to base directory
+	mBasename = pattern.find('/') == std::string_view::npos;
+
+	if (pattern.starts_with('/'))
+		pattern.remove_prefix(1);
+
+	while (!pattern.empty())
+	{
+		const std::size_t separator = pattern.find('/');
+		const std::string_view text = pattern.substr(0, separator);
+		pattern.remove_prefix(separator == std::string_view::npos ? pattern.size() : separator + 1);
+
+		// Empty segment of a//b
+		if (text.empty())
+			continue;
+
+		if (text == "**")
+		{
+			// Consecutive ** are same as one
+			if (mSegments.empty() || (mSegments.back().kind != SegmentKind::Recursive))
+				mSegments.push_back(Segment{ SegmentKind::Recursive, std::string() });
+		}
+		else if (text == "*")
+		{
+			mSegments.push_back(Segment{ SegmentKind::Any, std::string() });
+		}
+		else if (text.find_first_of("*?[") == std::string_view::npos)
+		{
+			mSegments.push_back(Segment{ SegmentKind::Literal, std::string(text) });
+		}
+		else if (text.starts_with('*') && (text.find_first_of("*?[", 1) == std::string_view::npos))
+		{
+			mSegments.push_back(Segment{ SegmentKind::Suffix, std::string(text.substr(1)) });
+		}
+		else
+		{
+			mSegments.push_back(Segment{ SegmentKind::Wildcard, std::string(text) });
+		}
+	}
+}
+
+bool Glob::MatchSegment(const Segment& segment, std::string_view name) noexcept
+{
+	switch (segment.kind)
+	{
+	case SegmentKind::Literal:
+		return EqualsNoCase(segment.text, name);
+	case SegmentKind::Suffix:
+		return (name.size() >= segment.text.size()) && EqualsNoCase(segment.text, name.substr(name.size() - segment.text.size()));
+	case SegmentKind::Any:
+	case SegmentKind::Recursive:
+		return true;
+	case SegmentKind::Wildcard:
+	default:
+		return MatchWildcard(segment.text, name);
+	}
+}
+
+bool Glob::MatchSegments(std::size_t first, const std::vector<std::string_view>& names, std::size_t name) const
+{
+	for (; first < mSegments.size(); ++first, ++name)
+	{
+		const Segment& segment = mSegments[first];
+
+		if (segment.kind == SegmentKind::Recursive)
+		{
+			// ** matches zero or more names, trailing ** matches everything below
+			for (std::size_t skip = name; skip <= names.size(); ++skip)
+			{
+				if (MatchSegments(first + 1, names, skip))
+					return true;
+			}
+
+			return false;
+		}
+
+		if ((name == names.size()) || !MatchSegment(segment, names[name]))
+			return false;
+	}
+
+	return name == names.size();
+}
+
+bool Glob::Match(std::string_view path, bool directory) const
+{
+	if (mDirectory && !directory)
+		return false;
+
+	// Glob without / is single segment which matches name at any depth, ex. *.asm or build
+	if (mBasename)
+	{
+		const std::size_t separator = path.rfind('/');
+		return !mSegments.empty() && MatchSegment(mSegments.front(), separator == std::string_view::npos ? path : path.substr(separator + 1));
+	}
+
+	std::vector<std::string_view> names;
+
+	while (!path.empty())
+	{
+		const std::size_t separator = path.find('/');
+		names.push_back(path.substr(0, separator));
+		path.remove_prefix(separator == std::string_view::npos ? path.size() : separator + 1);
+	}
+
+	return MatchSegments(0, names, 0);
+}
+
+bool Glob::Negated() const noexcept
+{
+	return mNegated;
+}
+
+/**
+ * @brief			Read .asmformatignore file if it exists
+ * @param filepath	Full path to ignore file
+ * @param base		Path of directory which contains ignore file relative to the searched directory
+ * @param ignores	Ignore files which apply to directory, receives rules of this file
+ * @return			true if file was read and its rules were appended
+*/
+static bool ReadIgnoreFile(const fs::path& filepath, const std::string& base, std::vector<IgnoreFile>& ignores)
+{
+	std::ifstream file(filepath, std::ios::binary);
+
+	if (!file)
+		return false;
+
+	IgnoreFile ignore;
+	ignore.base = base;
+	std::string line;
+
+	while (std::getline(file, line))
+	{
+		// UTF-8 BOM of the first line
+		if (ignore.rules.empty() && line.starts_with("\xEF\xBB\xBF"))
+			line.erase(0, 3);
+
+		while (!line.empty() && ((line.back() == '\r') || (line.back() == ' ') || (line.back() == '\t')))
+			line.pop_back();
+
+		if (line.empty() || line.starts_with('#'))
+			continue;
+
+		ignore.rules.emplace_back(line);
+	}
+
+	if (file.bad())
+	{
+		ShowError(ErrorCode::FunctionFailed, "Failed to read ignore file " + filepath.string());
+		return false;
+	}
+
+	ignores.push_back(std::move(ignore));
+	return true;
+}
+
+/**
+ * @brief				Check if path is ignored by .asmformatignore files, the last matching rule wins
+ * @param ignores		Ignore files which apply to path from outermost to innermost
+ * @param path			Path relative to the searched directory
+ * @param directory		Is path a directory?
+ * @return				true if path is ignored
+*/
+[[nodiscard]] static bool IsIgnored(const std::vector<IgnoreFile>& ignores, const std::string& path, bool directory)
+{
+	bool ignored = false;
+
+	for (const IgnoreFile& ignore : ignores)
+	{
+		const std::string_view relative = std::string_view(path).substr(ignore.base.size());
+
+		for (const Glob& rule : ignore.rules)
+		{
+			if (rule.Negated() == ignored && rule.Match(relative, directory))
+				ignored = !rule.Negated();
+		}
+	}
+
+	return ignored;
+}
+
+/**
+ * @brief				Search directory and its subdirectories
+ * @param directory		Directory which to search
+ * @param relative		Path of directory relative to the searched directory, empty or ending with /
+ * @param recurse		Search subdirectories as well?
+ * @param filter		Globs which select files
+ * @param ignores		Ignore files which apply to directory, restored on return
+ * @param files			Vector to which matching files are appended
+*/
+static void SearchDirectory(const fs::path& directory, const std::string& relative, bool recurse, const FileFilter& filter,
+	std::vector<IgnoreFile>& ignores, std::vector<fs::path>& files)
+{
+	const bool has_ignore = ReadIgnoreFile(directory / IGNORE_FILE_NAME, relative, ignores);
+
+	std::error_code error;
+	fs::directory_iterator iterator(directory, fs::directory_options::skip_permission_denied, error);
+
+	for (; !error && (iterator != fs::directory_iterator()); iterator.increment(error))
+	{
+		const fs::directory_entry& entry = *iterator;
+
+		// Type comes from directory listing, entries are not queried one by one
+		std::error_code type_error;
+		const bool is_directory = entry.is_directory(type_error);
+		const std::wstring name = entry.path().filename().wstring();
+
+		if (type_error || (name == IGNORE_FILE_NAME) || (is_directory && !recurse))
+			continue;
+
+		const std::string path = relative + StringCast(name);
+		const auto matches = [&path, is_directory](const Glob& glob) { return glob.Match(path, is_directory); };
+
+		// Excluded directory is pruned, nothing below it is listed
+		if (std::any_of(filter.exclude.begin(), filter.exclude.end(), matches) || IsIgnored(ignores, path, is_directory))
+			continue;
+
+		if (is_directory)
+		{
+			// Directory symbolic links and junctions are not followed, same as by recursive_directory_iterator,
+			// link which points to an ancestor would otherwise recurse without end
+			const DWORD attributes = GetFileAttributesW(entry.path().c_str());
+
+			if ((attributes == INVALID_FILE_ATTRIBUTES) || (attributes & FILE_ATTRIBUTE_REPARSE_POINT))
+			{
+				Log(Verbosity::Verbose) << "directory link " << entry.path() << " is not followed";
+				continue;
+			}
+
+			SearchDirectory(entry.path(), path + "/", recurse, filter, ignores, files);
+		}
+		else if (std::any_of(filter.include.begin(), filter.include.end(), matches))
+		{
+			files.push_back(entry.path());
+		}
+	}
+
+	if (error)
+	{
+		ShowError(ErrorCode::FunctionFailed, "Failed to search directory " + directory.string() + ", " + error.message());
+	}
+
+	if (has_ignore)
+		ignores.pop_back();
+}
+
+std::size_t FindFiles(const fs::path& directory, bool recurse, const FileFilter& filter, std::vector<fs::path>& files)
+{
+	const std::size_t count = files.size();
+	std::vector<IgnoreFile> ignores;
+
+	SearchDirectory(directory, std::string(), recurse, filter, ignores, files);
+	return files.size() - count;
+}
+
+bool MatchFile(const fs::path& directory, const fs::path& file, const FileFilter& filter)
+{
+	const fs::path relative = file.lexically_normal().lexically_relative(directory.lexically_normal());
+
+	if (relative.empty() || (*relative.begin() == L".."))
+		return false;
+
+	std::vector<IgnoreFile> ignores;
+	std::string path;
+	fs::path current = directory;
+
+	// Directories on the way to file are checked the same as FindFiles checks them before descending
+	for (auto name = relative.begin(); name != relative.end(); ++name)
+	{
+		const bool is_directory = std::next(name) != relative.end();
+		ReadIgnoreFile(current / IGNORE_FILE_NAME, path, ignores);
+
+		if (!is_directory && (name->wstring() == IGNORE_FILE_NAME))
+			return false;
+
+		path += StringCast(name->wstring());
+		const auto matches = [&path, is_directory](const Glob& glob) { return glob.Match(path, is_directory); };
+
+		if (std::any_of(filter.exclude.begin(), filter.exclude.end(), matches) || IsIgnored(ignores, path, is_directory))
+			return false;
+
+		if (!is_directory)
+			return std::any_of(filter.include.begin(), filter.include.end(), matches);
+
+		path += "/";
+		current /= *name;
+	}
+
+	return false;
+}
@@ -0,0 +1,130 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\Filter.hpp
+ *
+ * Declarations used to select files to format while searching directories
+ *
+ * Globs follow .gitignore syntax: * and ? don't match /, ** matches any count of directories,
+ * [abc] and [a-z] match a single character, [!a] any character but one of those listed.
+ * A glob without / other than trailing one matches name at any depth, otherwise it matches path
+ * relative to the directory being searched, or to directory of .asmformatignore file which contains it.
+ * Trailing / matches only directories and leading ! re-includes what was ignored by previous lines.
+ * Matching is case insensitive same as Windows file system.
+ *
+*/
+
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <filesystem>
+
+
+// Name of ignore file which is read from each directory being searched
+constexpr std::wstring_view IGNORE_FILE_NAME = L".asmformatignore";
+
+/**
+ * @brief Glob compiled for matching, pattern is parsed only once
+*/
+class Glob
+{
+	//
+	// Constructors
+	//
+public:
+	/**
+	 * @brief			Compile glob
+	 * @param pattern	Glob pattern, may begin with ! to negate it
+	*/
+	explicit Glob(std::string_view pattern);
+
+	//
+	// Public methods
+	//
+	/**
+	 * @brief				Match path against glob
+	 * @param path			Path relative to base directory of glob, separated with /
+	 * @param directory		Is path a directory?
+	 * @return				true if path matches, regardless of whether glob is negated
+	*/
+	[[nodiscard]] bool Match(std::string_view path, bool directory) const;
+
+	/**
+	 * @brief	Check if glob begins with !
+	 * @return	true if matching path is included rather than excluded
+	*/
+	[[nodiscard]] bool Negated() const noexcept;
+
+	//
+	// Members
+	//
+private:
+	/**
+	 * @brief Kind of path segment determines how it's matched
+	*/
+	enum class SegmentKind
+	{
+		Literal,	// Name without wildcards
+		Suffix,		// * followed by literal, ex. *.asm
+		Any,		// * which matches any name
+		Wildcard,	// Any other combination of wildcards
+		Recursive	// ** which matches any count of directories
+	};
+
+	struct Segment
+	{
+		SegmentKind kind;
+		// Text to match, for Suffix without leading *
+		std::string text;
+	};
+
+	[[nodiscard]] static bool MatchSegment(const Segment& segment, std::string_view name) noexcept;
+	[[nodiscard]] bool MatchSegments(std::size_t first, const std::vector<std::string_view>& names, std::size_t name) const;
+
+	std::vector<Segment> mSegments;
+	// Glob contains no / other than trailing and is matched against last name of a path
+	bool mBasename;
+	// Glob ends with / and matches only directories
+	bool mDirectory;
+	bool mNegated;
+};
+
+/**
+ * @brief Globs which select files while searching directories
+*/
+struct FileFilter
+{
+	// File is formatted if its path matches any of the globs
+	std::vector<Glob> include;
+	// File or directory is skipped if its path matches any of the globs, directories are not searched
+	std::vector<Glob> exclude;
+};
+
+/**
+ * Search directory for files which pass the filter and are not ignored by .asmformatignore.
+ * Directories which are excluded or ignored are skipped without listing their contents.
+ *
+ * @param directory		Directory which to search
+ * @param recurse		Search subdirectories as well?
+ * @param filter		Globs which select files
+ * @param files			Vector to which matching files are appended
+ * @return				Count of files which were appended
+*/
+std::size_t FindFiles(const std::filesystem::path& directory, bool recurse, const FileFilter& filter, std::vector<std::filesystem::path>& files);
+
+/**
+ * Check if file would be found by FindFiles searching directory and its subdirectories,
+ * used for files which are not found by searching, ex. files reported by git or by change notification.
+ *
+ * @param directory		Directory against which globs are matched
+ * @param file			Full path to file inside directory
+ * @param filter		Globs which select files
+ * @return				true if file passes the filter and is not ignored by .asmformatignore
+*/
+[[nodiscard]] bool MatchFile(const std::filesystem::path& directory, const std::filesystem::path& file, const FileFilter& filter);
@@ -0,0 +1,44 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\FormatError.hpp
+ *
+ * Error returned by formatter and file I/O functions
+ *
+ * Formatter and I/O functions don't show errors, they return an error value which is cheap to
+ * construct and it's up to caller to show it, asmformat shows it and libasmformat converts it to status.
+ *
+*/
+
+#pragma once
+#include "ErrorCode.hpp"
+#include "expected.hpp"
+
+
+/**
+ * @brief Error of formatting or of file I/O
+*/
+struct FormatError
+{
+	// Error code
+	wsl::ErrorCode code = wsl::ErrorCode::Success;
+	// String literal naming failed operation, ex. "read"
+	const char* operation = "";
+	// Line after which formatting failed, offset of invalid character if conversion failed,
+	// or count of bytes transferred before I/O failed
+	std::size_t position = 0;
+	// Win32 error code of failed I/O, ERROR_SUCCESS if error didn't come from Win32
+	DWORD system_error = 0;
+};
+
+/**
+ * @brief			Result of a function which returns value or error
+ * @tparam T		Value type, void if there is no value
+*/
+template<typename T = void>
+using FormatResult = wsl::expected<T, FormatError>;
@@ -15,8 +15,11 @@
 
 #include "pch.hpp"
 #include "FormatFile.hpp"
+#include "EditScript.hpp"
+#include "Kernels.hpp"
+#include "Trace.hpp"
+#include "Probes.hpp"
 #include "StringCast.hpp"
-#include "error.hpp"
 #include "ErrorCode.hpp"
 namespace rc = std::regex_constants;
 
@@ -204,11 +207,12 @@ requires std::is_same_v<typename StringType::value_type, typename StreamType::ch
  * @param codeline		string which receives next code line if any
  * @param crlf			Is line break CRLF?
  * @param skip_blanks	Skip blank lines too?
+ * @param indent		Indentation which is removed from the beginning of lines, empty if lines are trimmed
  * @return				true if blank line (by default) or EOF was reached before code line, false otherwise
 */
 template<typename StreamType, typename StringType>
 requires std::is_same_v<typename StreamType::char_type, typename StringType::value_type>
-[[nodiscard]] bool PeekNextCodeLine(StreamType& filedata, StringType& codeline, bool crlf, bool skip_blanks)
+[[nodiscard]] bool PeekNextCodeLine(StreamType& filedata, StringType& codeline, bool crlf, bool skip_blanks, const StringType& indent)
 {
 	bool fail = false;
 	StringType semicolon;
@@ -220,10 +224,13 @@ requires std::is_same_v<typename StreamType::char_type, typename StringType::val
 
 	while (std::getline(filedata, codeline).good())
 	{
+		if (!indent.empty() && codeline.starts_with(indent))
+			codeline.erase(0, indent.size());
+
 		// Skip comments
 		if (!codeline.starts_with(semicolon))
 		{
-			if (!codeline.empty() && crlf)
+			if (crlf && codeline.ends_with(static_cast<typename StringType::value_type>('\r')))
 			{
 				// Drop \r
 				codeline.erase(codeline.cend() - 1);
@@ -263,7 +270,7 @@ requires std::is_same_v<typename StringType::value_type, typename StreamType::ch
 
 	while (std::getline(filedata, line).good())
 	{
-		if (!line.empty() && crlf)
+		if (crlf && line.ends_with(static_cast<typename StringType::value_type>('\r')))
 		{
 			// Drop \r
 			line.erase(line.cend() - 1);
@@ -280,17 +287,181 @@ requires std::is_same_v<typename StringType::value_type, typename StreamType::ch
 	return count;
 }
 
+/**
+ * Replace runs of spaces and tabs between code tokens with tabs or spaces occupying the same columns.
+ * Text in quotes and comment are not modified, line must not be indented.
+ *
+ * @tparam StringType	std::string
+ * @param line			Line without indentation
+ * @param tab_width		Count of columns between tab stops
+ * @param spaces		Use spaces instead of tabs?
+ * @return				Normalized line
+*/
+template<typename StringType>
+[[nodiscard]] StringType NormalizeWhitespace(const StringType& line, std::size_t tab_width, bool spaces)
+{
+	using CharType = typename StringType::value_type;
+	constexpr CharType space = static_cast<CharType>(' ');
+	constexpr CharType htab = static_cast<CharType>('\t');
+
+	StringType result;
+	result.reserve(line.size());
+
+	// Display column of the next character
+	std::size_t column = 0;
+	// Quote character if inside quotes
+	CharType quote = 0;
+
+	for (std::size_t i = 0; i < line.size(); ++i)
+	{
+		const CharType ch = line.at(i);
+
+		if (quote != 0)
+		{
+			if (ch == quote)
+				quote = 0;
+		}
+		else if (ch == static_cast<CharType>(';'))
+		{
+			// Comment is formatted separately
+			result.append(line, i);
+			break;
+		}
+		else if ((ch == static_cast<CharType>('"')) || (ch == static_cast<CharType>('\'')))
+		{
+			quote = ch;
+		}
+		else if ((ch == space) || (ch == htab))
+		{
+			// Column at which next token starts
+			std::size_t end = column;
+
+			for (; (i < line.size()) && ((line.at(i) == space) || (line.at(i) == htab)); ++i)
+				end = line.at(i) == htab ? end + tab_width - end % tab_width : end + 1;
+
+			if (!spaces)
+			{
+				// Tabs up to the last tab stop, spaces for the remainder
+				for (std::size_t stop = column + tab_width - column % tab_width; stop <= end; stop += tab_width)
+				{
+					result += htab;
+					column = stop;
+				}
+			}
+
+			result.append(end - column, space);
+			column = end;
+
+			// Outer loop increments
+			--i;
+			continue;
+		}
+
+		result += ch;
+		column += ch == htab ? tab_width - column % tab_width : 1;
+	}
+
+	return result;
+}
+
+/**
+ * @brief				Trim leading and trailing whitespace of a line and measure its code
+ * @tparam RegexType	std::regex
+ * @tparam StringType	std::string
+ * @param line			Line without line break which isn't blank, receives trimmed and optionally normalized line
+ * @param tab_width		Count of columns between tab stops
+ * @param spaces		Use spaces instead of tabs?
+ * @param normalize		Replace whitespace between code tokens?
+ * @return				Display width of code preceding inline comment, 0 if there is no inline comment
+*/
+template<typename RegexType, typename StringType>
+requires std::is_same_v<typename RegexType::value_type, typename StringType::value_type>
+[[nodiscard]] std::size_t TrimLine(StringType& line, std::size_t tab_width, bool spaces, bool normalize)
+{
+	using CharType = typename StringType::value_type;
+
+	// Leading and trailing ASCII whitespace, same as \s matches in C locale
+	const std::size_t begin = SkipBlanks(std::basic_string_view<CharType>(line));
+	std::size_t end = line.size();
+
+	while ((end > begin) && IsAsciiBlank(line[end - 1]))
+		--end;
+
+	// \s of wide regex matches Unicode whitespace as well, lines which may begin or end with it are trimmed by regex
+	if ((begin < end) && ((CodeUnit(line[begin]) > 0x7Fu) || (CodeUnit(line[end - 1]) > 0x7Fu)))
+	{
+		// Shift line to beginning by trimming leading spaces and tabs
+		line = std::regex_replace(line, RegexType(STRING(StringType, "^\\s+(.*)")), STRING(StringType, "$1"));
+
+		// Trim trailing spaces and tabs
+		line = std::regex_replace(line, RegexType(STRING(StringType, "\\s+$")), STRING(StringType, ""));
+	}
+	else
+	{
+		line.erase(end);
+		line.erase(0, begin);
+	}
+
+	// Comment lines have no code
+	if (line.starts_with(static_cast<typename StringType::value_type>(';')))
+		return 0;
+
+	if (normalize)
+		line = NormalizeWhitespace(line, tab_width, spaces);
+
+	std::match_results<typename StringType::const_iterator> match;
+
+	if (std::regex_search(line, match, RegexType(STRING(StringType, "^(.*?)(?=\\s*;)"))))
+		return DisplayWidth(match[1].str(), tab_width);
+
+	return 0;
+}
+
+/**
+ * @brief				Get display width of the widest code line with inline comment
+ * @tparam RegexType	std::regex
+ * @tparam StringType	std::string
+ * @param filedata		File contents
+ * @param tab_width		Count of columns between tab stops
+ * @param spaces		Use spaces instead of tabs?
+ * @param normalize		Replace whitespace between code tokens?
+ * @return				Display width of code, same as computed by the first loop of formatter
+*/
+template<typename RegexType, typename StringType>
+requires std::is_same_v<typename RegexType::value_type, typename StringType::value_type>
+[[nodiscard]] std::size_t GetCodeWidth(const StringType& filedata, std::size_t tab_width, bool spaces, bool normalize)
+{
+	constexpr auto lf = static_cast<typename StringType::value_type>('\n');
+
+	StringType line;
+	std::size_t maxcodelen = 0;
+
+	// Same as with std::getline in the first loop, line which isn't terminated is not formatted
+	for (std::size_t begin = 0, end = filedata.find(lf); end != StringType::npos; begin = end + 1, end = filedata.find(lf, begin))
+	{
+		line.assign(filedata, begin, end - begin);
+
+		// Trailing \r is trimmed as whitespace
+		if (!line.empty())
+			maxcodelen = std::max(maxcodelen, TrimLine<RegexType>(line, tab_width, spaces, normalize));
+	}
+
+	return maxcodelen;
+}
+
 // Minimum capacity for strings
 constexpr std::size_t MIN_CAPACITY = 1000;
 
+// Formatting state is per thread so that multiple files may be formatted concurrently
+
 // TODO: currently not used
 // Information about previous line
-static LineInfo previous_line;
+static thread_local LineInfo previous_line;
 
 // Insert new blank line after currently processed line?
-static bool insert_blankline = false;
+static thread_local bool insert_blankline = false;
 
-void FormatFileW(std::wstringstream& filedata, std::size_t tab_width, bool spaces, bool compact, LineBreak line_break)
+FormatResult<> FormatFileW(std::wstringstream& filedata, std::size_t tab_width, bool spaces, bool compact, LineBreak line_break, bool normalize, std::size_t align_width)
 {
 	#ifdef _DEBUG
 	assert(!insert_blankline);
@@ -303,107 +474,183 @@ void FormatFileW(std::wstringstream& filedata, std::size_t tab_width, bool space
 	std::wstring tab = spaces ? std::wstring(tab_width, L' ') : L"\t";
 
 	line.reserve(MIN_CAPACITY);
-	result.reserve(filedata.str().capacity() + MIN_CAPACITY);
 
-	// Count of characters of the longest code line which contains inline comment
+	// Display width of the longest code line which contains inline comment
 	// inline comments will be shifted according to longest code line
 	std::size_t maxcodelen = 0;
 
+	// How to format each line of text produced by the first loop
+	EditScript script;
+	script.Reserve(CountLineFeeds(filedata.view()));
+
 	const bool crlf = GetLineBreak<std::wstring>(filedata) == LineBreak::CRLF;
 	const std::wstring linebreak = crlf ? L"\r\n" : L"\n";
 
-	// crlf != (line_break != LineBreak::CRLF)
-	// true (crlf) != false (CRLF) = true
-	// true (crlf) != true (LF)    = false
-	// false (lf)  != true (LF)    = true
-	// false (lf)  != false (CRLF) = false
-	const bool preserve = (line_break == LineBreak::Preserve) || (crlf != (line_break != LineBreak::CRLF));
-
 	// Formatting a soure file consists of 2 while loops, each looping trough lines in file,
 	// First loop trims leading and trailing spaces and tabs and calculates the widest code line containing an inline comment
-	// Second loop (later) uses this information (compacted lines and length) to perform accurate formatting
+	// Second loop (later) uses this information (compacted lines and length) to record into edit script how to format each line,
+	// text is modified only once edit script is complete by rendering it
+	TraceSpan pass_one("pass one");
+
+	// Offset of the next line in input text
+	std::size_t origin = 0;
+
+	// File may be formatted already only if trimming removes nothing but indentation, first line is blank,
+	// no blank lines are consecutive, the last line is not blank and line breaks need no conversion,
+	// the rest depends on pass two and is checked against edit script
+	bool clean = (line_break == LineBreak::Preserve) || (line_break == (crlf ? LineBreak::CRLF : LineBreak::LF));
+	bool previous_blank = false;
+
+	// While file may be formatted already trimmed lines refer to input text and trimmed text is not built
+	if (!clean)
+	{
+		// View doesn't copy stream buffer
+		result.reserve(filedata.view().size() + MIN_CAPACITY);
+	}
+
 	while (std::getline(filedata, line).good())
 	{
-		if (!line.empty() && crlf)
+		const std::size_t line_origin = origin;
+		// getline dropped \n
+		origin += line.size() + 1;
+
+		if (crlf && line.ends_with(L'\r'))
 		{
 			// Drop \r
 			line.erase(line.cend() -1);
 		}
 
+		// Line of input text without line break
+		const std::wstring_view raw = filedata.view().substr(line_origin, line.size());
+
 		if (!line.empty())
 		{
-			// Shift line to beginning by trimming leading spaces and tabs
-			regex = L"^\\s+(.*)";
-			line = std::regex_replace(line, regex, L"$1");
-
-			// Trim trailing spaces and tabs
-			regex = L"\\s+$";
-			line = std::regex_replace(line, regex, L"");
-
 			// Calculate longest code line with inline comment, excluding indentation
-			if (!line.starts_with(L";"))
+			const std::size_t codelen = TrimLine<std::wregex>(line, tab_width, spaces, normalize);
+
+			if (codelen > maxcodelen)
 			{
-				regex = L"^(.*?)(?=\\s*;)";
-				std::wsmatch match;
+				maxcodelen = codelen;
 
-				if (std::regex_search(line, match, regex))
-				{
-					const std::wssub_match code = match[1];
-					const std::size_t codelen = code.str().length();
+				#ifdef _DEBUG
+				maxlenline = line;
+				#endif // DEBUG
+			}
+		}
 
-					if (codelen > maxcodelen)
-					{
-						maxcodelen = codelen;
+		if (clean)
+		{
+			// Indented blank line is trimmed to empty line which isn't indented
+			clean = raw.ends_with(line) && ((raw.size() == line.size()) || (!line.empty() && (raw.substr(0, raw.size() - line.size()) == tab))) &&
+				(line_origin != 0 || line.empty()) && !(previous_blank && line.empty()) &&
+				((line_break == LineBreak::Preserve) || (raw.find(L'\r') == std::wstring_view::npos));
 
-						#ifdef _DEBUG
-						maxlenline = line;
-						#endif // DEBUG
-					}
-				}
+			previous_blank = line.empty();
+
+			if (clean)
+			{
+				// Trimmed line is the end of input line
+				script.Append(line_origin + raw.size() - line.size(), line.size(), line_origin);
+				continue;
 			}
+
+			// Lines trimmed so far are copied from input text once the file needs formatting
+			result.reserve(filedata.view().size() + MIN_CAPACITY);
+			CopyScriptLines(script, filedata.view(), linebreak, result);
 		}
 
+		script.Append(result.size(), line.size(), line_origin);
+
 		// getline dropped \n and \r dropped manually
 		result += line.append(linebreak);
 	}
 
+	pass_one.End();
+
 	if (filedata.bad() || (!filedata.eof() && filedata.fail()))
 	{
-		ShowError(wsl::ErrorCode::ParseFailure, ("Processing source file data failed after line: " + wsl::StringCast(line)).c_str());
-
-		// filedata is unchanged
-		return;
+		// filedata is unchanged, error is shown by caller
+		return wsl::unexpected(FormatError{ wsl::ErrorCode::ParseFailure, "format", script.Size() });
 	}
 
 	assert(filedata.eof());
 	// set good bit (remove eof bit)
 	filedata.clear();
-	filedata.str(result);
 
-	// clear contents but not memory
-	result.clear();
-	assert(result.capacity() > MIN_CAPACITY);
+	// There is a blank first line and the last line is complete and not blank
+	if (clean && ((script.Size() == 0) || previous_blank || (origin != filedata.view().size())))
+	{
+		clean = false;
+		result.reserve(filedata.view().size() + MIN_CAPACITY);
+		CopyScriptLines(script, filedata.view(), linebreak, result);
+	}
+
+	std::wstring input;
+
+	if (clean)
+	{
+		// Stream buffer is input text which pass two reads once more with indentation removed,
+		// edit script refers to it as well
+		filedata.seekg(0);
+	}
+	else
+	{
+		// Input text is kept to copy lines which are formatted already, trimmed text is moved to stream
+		// and edit script refers to stream buffer from now on
+		input = std::move(filedata).str();
+		filedata.str(std::move(result));
+	}
+
+	// Text before trimming to which origin offsets refer
+	const std::wstring_view input_text = clean ? filedata.view() : std::wstring_view(input);
+	// Input text is indented, trimmed text isn't
+	const std::wstring indent = clean ? tab : std::wstring();
+
+	// Inline comments of all files are aligned to the same column if code width of all files is given
+	maxcodelen = std::max(maxcodelen, align_width);
 
 	// Count of characters missing to make a full tab of the max length code line
 	const std::size_t maxmissing = tab_width - maxcodelen % tab_width;
 
+	// Inline comments start one tab stop past the max length code line, including indentation
+	const std::uint32_t comment_column = static_cast<std::uint32_t>(tab_width + maxcodelen + maxmissing);
+
 	// Count of lines to skip
 	std::size_t skiplines = 0;
+	// Index of the next line in edit script
+	std::size_t line_index = 0;
+
+	TraceSpan pass_two("pass two");
 
 	while (std::getline(filedata, line).good())
 	{
+		// Lines are same as in the first loop which appended entry for each of them
+		assert(line_index < script.Size());
+		const std::size_t index = line_index++;
+
 		if (skiplines > 0)
 		{
+			TraceLoggingWrite(probe_provider, "LineSkipped",
+				TraceLoggingUInt64(line_index, "Line"),
+				TraceLoggingUInt64(skiplines, "Remaining"));
+
+			script.drop[index] = 1;
 			--skiplines;
 			continue;
 		}
 
-		if (!line.empty() && crlf)
+		if (crlf && line.ends_with(L'\r'))
 		{
 			// Drop \r
 			line.erase(line.cend() - 1);
 		}
 
+		if (!indent.empty() && line.starts_with(indent))
+		{
+			// Trimming removed nothing but indentation
+			line.erase(0, indent.size());
+		}
+
 		if (line.empty())
 		{
 			previous_line.blank = true;
@@ -416,7 +663,7 @@ void FormatFileW(std::wstringstream& filedata, std::size_t tab_width, bool space
 			if (line.starts_with(L";"))
 			{
 				// Peek at next code line unless blank line is reached
-				const bool isblank = PeekNextCodeLine(filedata, nextcode, crlf, false);
+				const bool isblank = PeekNextCodeLine(filedata, nextcode, crlf, false, indent);
 				const LineInfo nextcodeinfo = isblank ? LineInfo{ 0 } : GetLineInfo<std::wregex>(nextcode);
 
 				// Will next code line be indented?
@@ -424,14 +671,18 @@ void FormatFileW(std::wstringstream& filedata, std::size_t tab_width, bool space
 
 				// Make only one space between semicolon and comment
 				regex = L"^;\\s*";
-				const std::wstring replacement = next_indent ? tab + L"; " : L"; ";
-				line = std::regex_replace(line, regex, replacement);
+				std::wsmatch match;
+				std::regex_search(line, match, regex);
+
+				script.indent[index] = next_indent ? Indent::Tab : Indent::None;
+				script.code_end[index] = 0;
+				script.comment[index] = static_cast<std::uint32_t>(match.length(0));
 
 				previous_line.comment = true;
 			}
 			else // code line
 			{
-				bool ignore_nextcode = PeekNextCodeLine(filedata, nextcode, crlf, true);
+				bool ignore_nextcode = PeekNextCodeLine(filedata, nextcode, crlf, true, indent);
 				LineInfo lineinfo = GetLineInfo<std::wregex>(line);
 				const LineInfo nextcodeinfo = ignore_nextcode ? LineInfo{ 0 } : GetLineInfo<std::wregex>(nextcode);
 				const std::size_t blanks = GetBlankCount<std::wstring>(filedata, crlf);
@@ -480,10 +731,14 @@ void FormatFileW(std::wstringstream& filedata, std::size_t tab_width, bool space
 
 							if (std::regex_search(line, match, regex))
 							{
+								TraceLoggingWrite(probe_provider, "LabelSplit",
+									TraceLoggingUInt64(line_index, "Line"));
+
 								ignore_nextcode = true;
 								lineinfo.label = false;
-								result += std::regex_replace(line, regex, L"$1" + linebreak);
-								line = std::regex_replace(line, regex, L"$2");
+								script.label[index] = static_cast<std::uint32_t>(match.length(1));
+								script.code_begin[index] = static_cast<std::uint32_t>(match.position(2));
+								line.erase(0, match.position(2));
 							}
 						}
 						break;
@@ -513,66 +768,19 @@ void FormatFileW(std::wstringstream& filedata, std::size_t tab_width, bool space
 					}
 
 				// Is code line indented with tab?
-				const bool indent = TestIndentLine(lineinfo);
-
-				if (indent)
-				{
-					// Indent line by inserting tab
-					line.insert(0, tab);
-				}
+				script.indent[index] = TestIndentLine(lineinfo) ? Indent::Tab : Indent::None;
 
 				// Format inline comments to start on same column
 				// On which column depends on the longest code line containing inline comment
-				regex = L"^(" + tab + L")?(.*?)(?=\\s*;)(\\s*)(;.*)";
+				regex = L"^(.*?)(?=\\s*;)\\s*;\\s*";
 				std::wsmatch match;
 
 				if (std::regex_search(line, match, regex))
 				{
-					// Character length of the current code line, excluding indentation
-					const std::size_t codelen = match[2].str().length();
-
-					std::wstring code = std::regex_replace(line, regex, L"$1$2");
-					std::wstring comment = std::regex_replace(line, regex, L"$4");
-
-					// Make between semicolon and comment only one space
-					regex = L"^;\\s*";
-					comment = std::regex_replace(comment, regex, L"; ");
-
-					// Character length difference of current code line compared to max length code line
-					std::size_t diff = maxcodelen - codelen;
-					// Also include characters which will be added to max length code line
-					diff += maxmissing;
-
-					if (spaces)
-					{
-						if (!indent)
-						{
-							// This accounts for removed tab at the start of line
-							diff += tab_width;
-						}
-
-						code.append(diff, L' ');
-					}
-					else
-					{
-						std::size_t tabcount = diff / tab_width;
-
-						if (!indent)
-						{
-							// This accounts for removed tab at the start of line
-							++tabcount;
-						}
-
-						// Tab count must be multiple of tab width
-						if (diff % tab_width != 0)
-						{
-							++tabcount;
-						}
-
-						code.append(tabcount, L'\t');
-					}
-
-					line = code.append(comment);
+					// Code is padded up to the column and semicolon is followed by single space when rendered
+					script.code_end[index] = script.code_begin[index] + static_cast<std::uint32_t>(match.length(1));
+					script.comment[index] = script.code_begin[index] + static_cast<std::uint32_t>(match.length(0));
+					script.column[index] = comment_column;
 				}
 
 				previous_line.comment = false;
@@ -581,25 +789,51 @@ void FormatFileW(std::wstringstream& filedata, std::size_t tab_width, bool space
 			previous_line.blank = false;
 		}
 
-		// \n dropped by getline \r dropped manually
-		result += line.append(linebreak);
-
 		if (insert_blankline)
 		{
-			result += linebreak;
+			TraceLoggingWrite(probe_provider, "BlankLineInserted",
+				TraceLoggingUInt64(line_index, "Line"));
+
+			script.blanks_after[index] = 1;
 			insert_blankline = false;
 			previous_line.blank = true;
 		}
 	}
 
+	pass_two.End();
+
 	if (filedata.bad() || (!filedata.eof() && filedata.fail()))
 	{
-		ShowError(wsl::ErrorCode::ParseFailure, ("Processing source file data failed after line: " + wsl::StringCast(line)).c_str());
+		// filedata is unchanged, error is shown by caller
+		return wsl::unexpected(FormatError{ wsl::ErrorCode::ParseFailure, "format", line_index });
+	}
+
+	// File which is formatted already is left as is, neither rendered nor post-processed.
+	// Both passes still run, whether lines are indented, blank lines inserted or dropped and where comments start
+	// is known only from pass two which classifies directives and looks ahead to the next code line
+	if (clean && IsInputFormatted<wchar_t>(script, filedata.view(), input_text, tab, tab_width, spaces, linebreak))
+	{
+		TraceLoggingWrite(probe_provider, "AlreadyFormatted",
+			TraceLoggingUInt64(script.Size(), "Lines"));
 
-		// filedata is unchanged
-		return;
+		// Stream buffer is input text as is
+		filedata.clear();
+		filedata.seekg(0);
+		return { };
 	}
 
+	TraceSpan render("render");
+
+	// Text is left as is if no line is modified, in which case stream buffer is moved out rather than copied,
+	// unless stream buffer is input text which is not trimmed
+	if (clean || !IsNoOp(script, filedata.view()))
+		result = RenderEditScript(script, filedata.view(), input_text.substr(0, origin), tab, tab_width, spaces, linebreak);
+	else result = std::move(filedata).str();
+
+	render.End();
+
+	TraceSpan post_processing("post-processing");
+
 	// Make sure first line is blank
 	if (!result.starts_with(linebreak))
 	{
@@ -630,29 +864,14 @@ void FormatFileW(std::wstringstream& filedata, std::size_t tab_width, bool space
 	regex = L"(" + linebreak + L"){2,}$";
 	result = std::regex_replace(result, regex, linebreak);
 
-	if (!preserve)
-	{
-		switch (line_break)
-		{
-		case LineBreak::LF:
-			wsl::ReplaceAll(result, linebreak, L"\n");
-			break;
-		case LineBreak::CRLF:
-			wsl::ReplaceAll(result, linebreak, L"\r\n");
-			break;
-		case LineBreak::CR:
-			ShowError(wsl::ErrorCode::NotImplemented, "CR line break not implemeted");
-			break;
-		case LineBreak::Preserve:
-		default:
-			break;
-		}
-	}
+	// Conversion also normalizes mixed line breaks, converted result is moved to stream rather than copied
+	if (line_break != LineBreak::Preserve)
+		result = ConvertLineBreaks(result, line_break);
 
 	assert(filedata.eof());
 	// set good bit (remove eof bit)
 	filedata.clear();
-	filedata.str(result);
+	filedata.str(std::move(result));
 
 	#if FALSE
 	// TODO: Reason why output is incorrect in the console is because not all tabs consume tab_width spaces
@@ -661,9 +880,11 @@ void FormatFileW(std::wstringstream& filedata, std::size_t tab_width, bool space
 	std::cout << str << std::endl;
 	std::cout << "longest code line " << "(" << maxcodelen << ")" << " is: " << wsl::StringCast(maxlenline) << std::endl;
 	#endif
+
+	return { };
 }
 
-void FormatFileA(std::stringstream& filedata, std::size_t tab_width, bool spaces, bool compact, LineBreak line_break)
+FormatResult<> FormatFileA(std::stringstream& filedata, std::size_t tab_width, bool spaces, bool compact, LineBreak line_break, bool normalize, std::size_t align_width)
 {
 	#ifdef _DEBUG
 	assert(!insert_blankline);
@@ -676,107 +897,183 @@ void FormatFileA(std::stringstream& filedata, std::size_t tab_width, bool spaces
 	std::string tab = spaces ? std::string(tab_width, ' ') : "\t";
 
 	line.reserve(MIN_CAPACITY);
-	result.reserve(filedata.str().capacity() + MIN_CAPACITY);
 
-	// Count of characters of the longest code line which contains inline comment
+	// Display width of the longest code line which contains inline comment
 	// inline comments will be shifted according to longest code line
 	std::size_t maxcodelen = 0;
 
+	// How to format each line of text produced by the first loop
+	EditScript script;
+	script.Reserve(CountLineFeeds(filedata.view()));
+
 	const bool crlf = GetLineBreak<std::string>(filedata) == LineBreak::CRLF;
 	const std::string linebreak = crlf ? "\r\n" : "\n";
 
-	// crlf != (line_break != LineBreak::CRLF)
-	// true (crlf) != false (CRLF) = true
-	// true (crlf) != true (LF)    = false
-	// false (lf)  != true (LF)    = true
-	// false (lf)  != false (CRLF) = false
-	const bool preserve = (line_break == LineBreak::Preserve) || (crlf != (line_break != LineBreak::CRLF));
-
 	// Formatting a soure file consists of 2 while loops, each looping trough lines in file,
 	// First loop trims leading and trailing spaces and tabs and calculates the widest code line containing an inline comment
-	// Second loop (later) uses this information (compacted lines and length) to perform accurate formatting
+	// Second loop (later) uses this information (compacted lines and length) to record into edit script how to format each line,
+	// text is modified only once edit script is complete by rendering it
+	TraceSpan pass_one("pass one");
+
+	// Offset of the next line in input text
+	std::size_t origin = 0;
+
+	// File may be formatted already only if trimming removes nothing but indentation, first line is blank,
+	// no blank lines are consecutive, the last line is not blank and line breaks need no conversion,
+	// the rest depends on pass two and is checked against edit script
+	bool clean = (line_break == LineBreak::Preserve) || (line_break == (crlf ? LineBreak::CRLF : LineBreak::LF));
+	bool previous_blank = false;
+
+	// While file may be formatted already trimmed lines refer to input text and trimmed text is not built
+	if (!clean)
+	{
+		// View doesn't copy stream buffer
+		result.reserve(filedata.view().size() + MIN_CAPACITY);
+	}
+
 	while (std::getline(filedata, line).good())
 	{
-		if (!line.empty() && crlf)
+		const std::size_t line_origin = origin;
+		// getline dropped \n
+		origin += line.size() + 1;
+
+		if (crlf && line.ends_with('\r'))
 		{
 			// Drop \r
 			line.erase(line.cend() - 1);
 		}
 
+		// Line of input text without line break
+		const std::string_view raw = filedata.view().substr(line_origin, line.size());
+
 		if (!line.empty())
 		{
-			// Shift line to beginning by trimming leading spaces and tabs
-			regex = "^\\s+(.*)";
-			line = std::regex_replace(line, regex, "$1");
-
-			// Trim trailing spaces and tabs
-			regex = "\\s+$";
-			line = std::regex_replace(line, regex, "");
-
 			// Calculate longest code line with inline comment, excluding indentation
-			if (!line.starts_with(";"))
+			const std::size_t codelen = TrimLine<std::regex>(line, tab_width, spaces, normalize);
+
+			if (codelen > maxcodelen)
 			{
-				regex = "^(.*?)(?=\\s*;)";
-				std::smatch match;
+				maxcodelen = codelen;
 
-				if (std::regex_search(line, match, regex))
-				{
-					const std::ssub_match code = match[1];
-					const std::size_t codelen = code.str().length();
+				#ifdef _DEBUG
+				maxlenline = line;
+				#endif // DEBUG
+			}
+		}
 
-					if (codelen > maxcodelen)
-					{
-						maxcodelen = codelen;
+		if (clean)
+		{
+			// Indented blank line is trimmed to empty line which isn't indented
+			clean = raw.ends_with(line) && ((raw.size() == line.size()) || (!line.empty() && (raw.substr(0, raw.size() - line.size()) == tab))) &&
+				(line_origin != 0 || line.empty()) && !(previous_blank && line.empty()) &&
+				((line_break == LineBreak::Preserve) || (raw.find('\r') == std::string_view::npos));
 
-						#ifdef _DEBUG
-						maxlenline = line;
-						#endif // DEBUG
-					}
-				}
+			previous_blank = line.empty();
+
+			if (clean)
+			{
+				// Trimmed line is the end of input line
+				script.Append(line_origin + raw.size() - line.size(), line.size(), line_origin);
+				continue;
 			}
+
+			// Lines trimmed so far are copied from input text once the file needs formatting
+			result.reserve(filedata.view().size() + MIN_CAPACITY);
+			CopyScriptLines(script, filedata.view(), linebreak, result);
 		}
 
+		script.Append(result.size(), line.size(), line_origin);
+
 		// getline dropped \n and \r dropped manually
 		result += line.append(linebreak);
 	}
 
+	pass_one.End();
+
 	if (filedata.bad() || (!filedata.eof() && filedata.fail()))
 	{
-		ShowError(wsl::ErrorCode::ParseFailure, ("Processing source file data failed after line: " + line).c_str());
-
-		// filedata is unchanged
-		return;
+		// filedata is unchanged, error is shown by caller
+		return wsl::unexpected(FormatError{ wsl::ErrorCode::ParseFailure, "format", script.Size() });
 	}
 
 	assert(filedata.eof());
 	// set good bit (remove eof bit)
 	filedata.clear();
-	filedata.str(result);
 
-	// clear contents but not memory
-	result.clear();
-	assert(result.capacity() > MIN_CAPACITY);
+	// There is a blank first line and the last line is complete and not blank
+	if (clean && ((script.Size() == 0) || previous_blank || (origin != filedata.view().size())))
+	{
+		clean = false;
+		result.reserve(filedata.view().size() + MIN_CAPACITY);
+		CopyScriptLines(script, filedata.view(), linebreak, result);
+	}
+
+	std::string input;
+
+	if (clean)
+	{
+		// Stream buffer is input text which pass two reads once more with indentation removed,
+		// edit script refers to it as well
+		filedata.seekg(0);
+	}
+	else
+	{
+		// Input text is kept to copy lines which are formatted already, trimmed text is moved to stream
+		// and edit script refers to stream buffer from now on
+		input = std::move(filedata).str();
+		filedata.str(std::move(result));
+	}
+
+	// Text before trimming to which origin offsets refer
+	const std::string_view input_text = clean ? filedata.view() : std::string_view(input);
+	// Input text is indented, trimmed text isn't
+	const std::string indent = clean ? tab : std::string();
+
+	// Inline comments of all files are aligned to the same column if code width of all files is given
+	maxcodelen = std::max(maxcodelen, align_width);
 
 	// Count of characters missing to make a full tab of the max length code line
 	const std::size_t maxmissing = tab_width - maxcodelen % tab_width;
 
+	// Inline comments start one tab stop past the max length code line, including indentation
+	const std::uint32_t comment_column = static_cast<std::uint32_t>(tab_width + maxcodelen + maxmissing);
+
 	// Count of lines to skip
 	std::size_t skiplines = 0;
+	// Index of the next line in edit script
+	std::size_t line_index = 0;
+
+	TraceSpan pass_two("pass two");
 
 	while (std::getline(filedata, line).good())
 	{
+		// Lines are same as in the first loop which appended entry for each of them
+		assert(line_index < script.Size());
+		const std::size_t index = line_index++;
+
 		if (skiplines > 0)
 		{
+			TraceLoggingWrite(probe_provider, "LineSkipped",
+				TraceLoggingUInt64(line_index, "Line"),
+				TraceLoggingUInt64(skiplines, "Remaining"));
+
+			script.drop[index] = 1;
 			--skiplines;
 			continue;
 		}
 
-		if (!line.empty() && crlf)
+		if (crlf && line.ends_with('\r'))
 		{
 			// Drop \r
 			line.erase(line.cend() - 1);
 		}
 
+		if (!indent.empty() && line.starts_with(indent))
+		{
+			// Trimming removed nothing but indentation
+			line.erase(0, indent.size());
+		}
+
 		if (line.empty())
 		{
 			previous_line.blank = true;
@@ -789,7 +1086,7 @@ void FormatFileA(std::stringstream& filedata, std::size_t tab_width, bool spaces
 			if (line.starts_with(";"))
 			{
 				// Peek at next code line unless blank line is reached
-				const bool isblank = PeekNextCodeLine(filedata, nextcode, crlf, false);
+				const bool isblank = PeekNextCodeLine(filedata, nextcode, crlf, false, indent);
 				const LineInfo nextcodeinfo = isblank ? LineInfo{ 0 } : GetLineInfo<std::regex>(nextcode);
 
 				// Will next code line be indented?
@@ -797,14 +1094,18 @@ void FormatFileA(std::stringstream& filedata, std::size_t tab_width, bool spaces
 
 				// Make only one space between semicolon and comment
 				regex = "^;\\s*";
-				const std::string replacement = next_indent ? tab + "; " : "; ";
-				line = std::regex_replace(line, regex, replacement);
+				std::smatch match;
+				std::regex_search(line, match, regex);
+
+				script.indent[index] = next_indent ? Indent::Tab : Indent::None;
+				script.code_end[index] = 0;
+				script.comment[index] = static_cast<std::uint32_t>(match.length(0));
 
 				previous_line.comment = true;
 			}
 			else // code line
 			{
-				bool ignore_nextcode = PeekNextCodeLine(filedata, nextcode, crlf, true);
+				bool ignore_nextcode = PeekNextCodeLine(filedata, nextcode, crlf, true, indent);
 				LineInfo lineinfo = GetLineInfo<std::regex>(line);
 				const LineInfo nextcodeinfo = ignore_nextcode ? LineInfo{ 0 } : GetLineInfo<std::regex>(nextcode);
 				const std::size_t blanks = GetBlankCount<std::string>(filedata, crlf);
@@ -853,10 +1154,14 @@ void FormatFileA(std::stringstream& filedata, std::size_t tab_width, bool spaces
 
 							if (std::regex_search(line, match, regex))
 							{
+								TraceLoggingWrite(probe_provider, "LabelSplit",
+									TraceLoggingUInt64(line_index, "Line"));
+
 								ignore_nextcode = true;
 								lineinfo.label = false;
-								result += std::regex_replace(line, regex, "$1" + linebreak);
-								line = std::regex_replace(line, regex, "$2");
+								script.label[index] = static_cast<std::uint32_t>(match.length(1));
+								script.code_begin[index] = static_cast<std::uint32_t>(match.position(2));
+								line.erase(0, match.position(2));
 							}
 						}
 						break;
@@ -886,66 +1191,19 @@ void FormatFileA(std::stringstream& filedata, std::size_t tab_width, bool spaces
 					}
 
 				// Is code line indented with tab?
-				const bool indent = TestIndentLine(lineinfo);
-
-				if (indent)
-				{
-					// Indent line by inserting tab
-					line.insert(0, tab);
-				}
+				script.indent[index] = TestIndentLine(lineinfo) ? Indent::Tab : Indent::None;
 
 				// Format inline comments to start on same column
 				// On which column depends on the longest code line containing inline comment
-				regex = "^(" + tab + ")?(.*?)(?=\\s*;)(\\s*)(;.*)";
+				regex = "^(.*?)(?=\\s*;)\\s*;\\s*";
 				std::smatch match;
 
 				if (std::regex_search(line, match, regex))
 				{
-					// Character length of the current code line, excluding indentation
-					const std::size_t codelen = match[2].str().length();
-
-					std::string code = std::regex_replace(line, regex, "$1$2");
-					std::string comment = std::regex_replace(line, regex, "$4");
-
-					// Make between semicolon and comment only one space
-					regex = "^;\\s*";
-					comment = std::regex_replace(comment, regex, "; ");
-
-					// Character length difference of current code line compared to max length code line
-					std::size_t diff = maxcodelen - codelen;
-					// Also include characters that will be added to max length code line
-					diff += maxmissing;
-
-					if (spaces)
-					{
-						if (!indent)
-						{
-							// This accounts for removed tab at the start of line
-							diff += tab_width;
-						}
-
-						code.append(diff, ' ');
-					}
-					else
-					{
-						std::size_t tabcount = diff / tab_width;
-
-						if (!indent)
-						{
-							// This accounts for removed tab at the start of line
-							++tabcount;
-						}
-
-						// Tab count must be multiple of tab width
-						if (diff % tab_width != 0)
-						{
-							++tabcount;
-						}
-
-						code.append(tabcount, '\t');
-					}
-
-					line = code.append(comment);
+					// Code is padded up to the column and semicolon is followed by single space when rendered
+					script.code_end[index] = script.code_begin[index] + static_cast<std::uint32_t>(match.length(1));
+					script.comment[index] = script.code_begin[index] + static_cast<std::uint32_t>(match.length(0));
+					script.column[index] = comment_column;
 				}
 
 				previous_line.comment = false;
@@ -954,25 +1212,51 @@ void FormatFileA(std::stringstream& filedata, std::size_t tab_width, bool spaces
 			previous_line.blank = false;
 		}
 
-		// \n dropped by getline \r dropped manually
-		result += line.append(linebreak);
-
 		if (insert_blankline)
 		{
-			result += linebreak;
+			TraceLoggingWrite(probe_provider, "BlankLineInserted",
+				TraceLoggingUInt64(line_index, "Line"));
+
+			script.blanks_after[index] = 1;
 			insert_blankline = false;
 			previous_line.blank = true;
 		}
 	}
 
+	pass_two.End();
+
 	if (filedata.bad() || (!filedata.eof() && filedata.fail()))
 	{
-		ShowError(wsl::ErrorCode::ParseFailure, ("Processing source file data failed after line: " + line).c_str());
+		// filedata is unchanged, error is shown by caller
+		return wsl::unexpected(FormatError{ wsl::ErrorCode::ParseFailure, "format", line_index });
+	}
+
+	// File which is formatted already is left as is, neither rendered nor post-processed.
+	// Both passes still run, whether lines are indented, blank lines inserted or dropped and where comments start
+	// is known only from pass two which classifies directives and looks ahead to the next code line
+	if (clean && IsInputFormatted<char>(script, filedata.view(), input_text, tab, tab_width, spaces, linebreak))
+	{
+		TraceLoggingWrite(probe_provider, "AlreadyFormatted",
+			TraceLoggingUInt64(script.Size(), "Lines"));
 
-		// filedata is unchanged
-		return;
+		// Stream buffer is input text as is
+		filedata.clear();
+		filedata.seekg(0);
+		return { };
 	}
 
+	TraceSpan render("render");
+
+	// Text is left as is if no line is modified, in which case stream buffer is moved out rather than copied,
+	// unless stream buffer is input text which is not trimmed
+	if (clean || !IsNoOp(script, filedata.view()))
+		result = RenderEditScript(script, filedata.view(), input_text.substr(0, origin), tab, tab_width, spaces, linebreak);
+	else result = std::move(filedata).str();
+
+	render.End();
+
+	TraceSpan post_processing("post-processing");
+
 	// Make sure first line is blank
 	if (!result.starts_with(linebreak))
 	{
@@ -1003,29 +1287,14 @@ void FormatFileA(std::stringstream& filedata, std::size_t tab_width, bool spaces
 	regex = "(" + linebreak + "){2,}$";
 	result = std::regex_replace(result, regex, linebreak);
 
-	if (!preserve)
-	{
-		switch (line_break)
-		{
-		case LineBreak::LF:
-			wsl::ReplaceAll(result, linebreak, "\n");
-			break;
-		case LineBreak::CRLF:
-			wsl::ReplaceAll(result, linebreak, "\r\n");
-			break;
-		case LineBreak::CR:
-			ShowError(wsl::ErrorCode::NotImplemented, "CR line break not implemeted");
-			break;
-		case LineBreak::Preserve:
-		default:
-			break;
-		}
-	}
+	// Conversion also normalizes mixed line breaks, converted result is moved to stream rather than copied
+	if (line_break != LineBreak::Preserve)
+		result = ConvertLineBreaks(result, line_break);
 
 	assert(filedata.eof());
 	// set good bit (remove eof bit)
 	filedata.clear();
-	filedata.str(result);
+	filedata.str(std::move(result));
 
 	#if FALSE
 	// TODO: Reason why output is incorrect in the console is because not all tabs consume tab_width spaces
@@ -1033,4 +1302,38 @@ void FormatFileA(std::stringstream& filedata, std::size_t tab_width, bool spaces
 	std::cout << result << std::endl;
 	std::cout << "longest code line " << "(" << maxcodelen << ")" << " is: " << maxlenline << std::endl;
 	#endif
+
+	return { };
+}
+
+FormatResult<std::wstring> FormatTextW(std::wstring&& text, std::size_t tab_width, bool spaces, bool compact, LineBreak line_break, bool normalize, std::size_t align_width)
+{
+	std::wstringstream filedata(std::move(text));
+	const FormatResult<> result = FormatFileW(filedata, tab_width, spaces, compact, line_break, normalize, align_width);
+
+	if (!result)
+		return wsl::unexpected(result.error());
+
+	return std::move(filedata).str();
+}
+
+FormatResult<std::string> FormatTextA(std::string&& text, std::size_t tab_width, bool spaces, bool compact, LineBreak line_break, bool normalize, std::size_t align_width)
+{
+	std::stringstream filedata(std::move(text));
+	const FormatResult<> result = FormatFileA(filedata, tab_width, spaces, compact, line_break, normalize, align_width);
+
+	if (!result)
+		return wsl::unexpected(result.error());
+
+	return std::move(filedata).str();
+}
+
+std::size_t GetCodeWidthW(const std::wstring& filedata, std::size_t tab_width, bool spaces, bool normalize)
+{
+	return GetCodeWidth<std::wregex>(filedata, tab_width, spaces, normalize);
+}
+
+std::size_t GetCodeWidthA(const std::string& filedata, std::size_t tab_width, bool spaces, bool normalize)
+{
+	return GetCodeWidth<std::regex>(filedata, tab_width, spaces, normalize);
 }
@@ -15,19 +15,11 @@
 
 #pragma once
 #include <sstream>
+#include <string>
+#include "LineBreak.hpp"
+#include "FormatError.hpp"
 
 
-/**
- * Line breaks used in file
-*/
-enum class LineBreak
-{
-	LF,
-	CRLF,
-	CR,
-	Preserve	// Use existing line breaks
-};
-
 /**
  * @brief				Format asm source file encoded as UTF-8, UTF-16 or UTF-16LE
  * @param filedata		File contents loaded into memory
@@ -35,8 +27,11 @@ enum class LineBreak
  * @param spaces		Use spaces instead of tabs?
  * @param compact		Replace all surplus blank lines with single blank line
  * @param line_break	Specify line breaks kind
+ * @param normalize		Replace whitespace between code tokens with tabs or spaces according to spaces parameter
+ * @param align_width	Minimum code width to which inline comments are aligned, ex. widest code of multiple files
+ * @return				Error with line after which reading of filedata failed, filedata is unchanged on error
 */
-void FormatFileW(std::wstringstream& filedata, std::size_t tab_width, bool spaces, bool compact, LineBreak line_break = LineBreak::Preserve);
+[[nodiscard]] FormatResult<> FormatFileW(std::wstringstream& filedata, std::size_t tab_width, bool spaces, bool compact, LineBreak line_break = LineBreak::Preserve, bool normalize = false, std::size_t align_width = 0);
 
 /**
  * @brief				Format asm source file encoded as ANSI
@@ -45,5 +40,58 @@ void FormatFileW(std::wstringstream& filedata, std::size_t tab_width, bool space
  * @param spaces		Use spaces instead of tabs?
  * @param compact		Replace all surplus blank lines with single blank line
  * @param line_break	Specify line breaks kind
+ * @param normalize		Replace whitespace between code tokens with tabs or spaces according to spaces parameter
+ * @param align_width	Minimum code width to which inline comments are aligned, ex. widest code of multiple files
+ * @return				Error with line after which reading of filedata failed, filedata is unchanged on error
+*/
+[[nodiscard]] FormatResult<> FormatFileA(std::stringstream& filedata, std::size_t tab_width, bool spaces, bool compact, LineBreak line_break = LineBreak::Preserve, bool normalize = false, std::size_t align_width = 0);
+
+/**
+ * Format text decoded to UTF-16, text buffer is moved into string stream and formatted text is moved out
+ * so that text is not copied by formatter regardless of whether it was modified.
+ *
+ * @param text			File contents decoded to UTF-16, moved from
+ * @Param tab_width		Count of spaces ocupying a tab character
+ * @param spaces		Use spaces instead of tabs?
+ * @param compact		Replace all surplus blank lines with single blank line
+ * @param line_break	Specify line breaks kind
+ * @param normalize		Replace whitespace between code tokens with tabs or spaces according to spaces parameter
+ * @param align_width	Minimum code width to which inline comments are aligned, ex. widest code of multiple files
+ * @return				Formatted text, or error with line after which reading of text failed
+*/
+[[nodiscard]] FormatResult<std::wstring> FormatTextW(std::wstring&& text, std::size_t tab_width, bool spaces, bool compact, LineBreak line_break = LineBreak::Preserve, bool normalize = false, std::size_t align_width = 0);
+
+/**
+ * Format text encoded as ANSI, text buffer is moved into string stream and formatted text is moved out
+ * so that text is not copied by formatter regardless of whether it was modified.
+ *
+ * @param text			File contents, moved from
+ * @Param tab_width		Count of spaces ocupying a tab character
+ * @param spaces		Use spaces instead of tabs?
+ * @param compact		Replace all surplus blank lines with single blank line
+ * @param line_break	Specify line breaks kind
+ * @param normalize		Replace whitespace between code tokens with tabs or spaces according to spaces parameter
+ * @param align_width	Minimum code width to which inline comments are aligned, ex. widest code of multiple files
+ * @return				Formatted text, or error with line after which reading of text failed
+*/
+[[nodiscard]] FormatResult<std::string> FormatTextA(std::string&& text, std::size_t tab_width, bool spaces, bool compact, LineBreak line_break = LineBreak::Preserve, bool normalize = false, std::size_t align_width = 0);
+
+/**
+ * @brief				Get display width of the widest code line with inline comment of source file encoded as UTF-8, UTF-16 or UTF-16LE
+ * @param filedata		File contents decoded to UTF-16
+ * @Param tab_width		Count of spaces ocupying a tab character
+ * @param spaces		Use spaces instead of tabs?
+ * @param normalize		Replace whitespace between code tokens with tabs or spaces according to spaces parameter
+ * @return				Display width of code, 0 if there are no inline comments
+*/
+[[nodiscard]] std::size_t GetCodeWidthW(const std::wstring& filedata, std::size_t tab_width, bool spaces, bool normalize);
+
+/**
+ * @brief				Get display width of the widest code line with inline comment of source file encoded as ANSI
+ * @param filedata		File contents
+ * @Param tab_width		Count of spaces ocupying a tab character
+ * @param spaces		Use spaces instead of tabs?
+ * @param normalize		Replace whitespace between code tokens with tabs or spaces according to spaces parameter
+ * @return				Display width of code, 0 if there are no inline comments
 */
-void FormatFileA(std::stringstream& filedata, std::size_t tab_width, bool spaces, bool compact, LineBreak line_break = LineBreak::Preserve);
+[[nodiscard]] std::size_t GetCodeWidthA(const std::string& filedata, std::size_t tab_width, bool spaces, bool normalize);
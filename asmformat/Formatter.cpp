@@ -0,0 +1,670 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\Formatter.cpp
+ *
+ * Function definitions which load, format and write back source files
+ *
+*/
+
+#include "pch.hpp"
+#include "Formatter.hpp"
+#include "Report.hpp"
+#include "Trace.hpp"
+#include "Probes.hpp"
+#include "Verify.hpp"
+#include "console.hpp"
+#include "Logger.hpp"
+#include "StringCast.hpp"
+#include "Kernels.hpp"
+#include "error.hpp"
+using namespace wsl;
+
+
+/**
+ * @brief			Count lines in file contents
+ * @tparam CharType	char or wchar_t
+ * @param data		File contents
+ * @return			Count of lines including last line which is not terminated
+*/
+template<typename CharType>
+[[nodiscard]] static std::size_t CountLines(const std::basic_string<CharType>& data)
+{
+	std::size_t lines = CountLineFeeds(std::basic_string_view<CharType>(data));
+
+	if (!data.empty() && (data.back() != static_cast<CharType>('\n')))
+		++lines;
+
+	return lines;
+}
+
+/**
+ * @brief			Show error returned by formatter or file I/O
+ * @param file_path	Full path to source file
+ * @param error		Error to show
+ * @return			Error code of the error
+*/
+static ErrorCode ShowFormatError(const std::filesystem::path& file_path, const FormatError& error)
+{
+	std::string message;
+
+	if ((error.code == ErrorCode::ParseFailure) && (std::string_view(error.operation) == "format"))
+		message = "Processing source file data failed after line " + std::to_string(error.position) + " of file " + file_path.string();
+	else if (error.code == ErrorCode::ParseFailure)
+		message = std::string("Failed to ") + error.operation + " file " + file_path.string() + ", invalid character at offset " + std::to_string(error.position);
+	else if (error.position != 0)
+		message = std::string("Failed to ") + error.operation + " file " + file_path.string() + " after " + std::to_string(error.position) + " bytes";
+	else
+		message = std::string("Failed to ") + error.operation + " file " + file_path.string();
+
+	if (error.system_error != ERROR_SUCCESS)
+	{
+		SetLastError(error.system_error);
+		ShowError(ERROR_INFO_HR, message.c_str());
+	}
+	else
+	{
+		ShowError(error.code, message);
+	}
+
+	return error.code;
+}
+
+/**
+ * @brief			Verify that formatting changed only whitespace and line breaks, show error otherwise
+ * @tparam CharType	char or wchar_t
+ * @param file_path	Full path to source file
+ * @param source	File contents before formatting
+ * @param formatted	File contents after formatting
+ * @param report	Receives time spent verifying
+ * @return			true if only whitespace was changed and it's safe to write the file
+*/
+template<typename CharType>
+[[nodiscard]] static bool VerifyFormatting(const std::filesystem::path& file_path,
+	const std::basic_string<CharType>& source, const std::basic_string<CharType>& formatted, FileReport& report)
+{
+	PhaseTimer timer(report, Phase::Verify);
+	const std::size_t pos = FindCodeChange(std::basic_string_view<CharType>(source), std::basic_string_view<CharType>(formatted));
+
+	if (pos == std::basic_string_view<CharType>::npos)
+		return true;
+
+	const std::size_t line = static_cast<std::size_t>(std::count(source.begin(), source.begin() + static_cast<std::ptrdiff_t>(pos), static_cast<CharType>('\n'))) + 1;
+	ShowError(ErrorCode::BadResult, "Formatting changed code on line " + std::to_string(line) + " of file " + file_path.filename().string() + ", the file was not written");
+	return false;
+}
+
+/**
+ * @brief			Copy whole file buffer and record the copy in file report
+ * @tparam CharType	char or wchar_t
+ * @param buffer	File contents which are still needed after the copy is moved on
+ * @param report	Receives count of bytes copied
+ * @return			Copy of buffer
+*/
+template<typename CharType>
+[[nodiscard]] static std::basic_string<CharType> CopyBuffer(const std::basic_string<CharType>& buffer, FileReport& report)
+{
+	report.bytes_copied += buffer.size() * sizeof(CharType);
+	return buffer;
+}
+
+/**
+ * @brief			Load, format and write back source file and fill in report about it
+ * @param file_path	Full path to source file
+ * @param options	Format options
+ * @param loaded	File contents if already loaded, contents are moved out
+ * @param report	Receives information about formatted file
+ * @return			Same as FormatSourceFile
+*/
+static ErrorCode FormatSource(const std::filesystem::path& file_path, const FormatOptions& options, std::optional<std::string>& loaded, FileReport& report)
+{
+	Encoding encoding = options.encoding;
+	std::vector<unsigned char> bom_bytes;
+	BOM bom = BOM::none;
+
+	{
+		PhaseTimer timer(report, Phase::Load);
+		TraceSpan span("bom");
+		const FormatResult<BOM> result = loaded ? GetBOM(*loaded, bom_bytes) : GetBOM(file_path, bom_bytes);
+
+		if (!result)
+			return ShowFormatError(file_path, result.error());
+
+		bom = *result;
+	}
+
+	const Encoding file_encoding = BomToEncoding(bom);
+	report.bom = bom;
+
+	switch (file_encoding)
+	{
+	case Encoding::UTF8:
+	case Encoding::UTF16LE:
+		if (encoding != file_encoding)
+		{
+			encoding = file_encoding;
+			Log() << EncodingToString(options.encoding) << " encoding option was ignored for file " << file_path.filename().string() << ", file is encoded as " << BomToString(bom);
+		}
+		break;
+	case Encoding::Unsupported:
+		goto invalid_encoding;
+	case Encoding::Unknown:
+		// TODO: Function to detect encoding based on file contents
+		// BOM not found in file, use default or user specified encoding
+		break;
+	case Encoding::ANSI:
+		// No such thing as "ANSI BOM"
+		assert(false);
+		break;
+	default:
+		// Use default or user specified encoding
+		break;
+	}
+
+	Log() << "Formatting file " << file_path.filename();
+	Log(Verbosity::Verbose) << "using " << EncodingToString(encoding) << " encoding and " << (bom == BOM::none ? "no" : BomToString(bom)) << " BOM";
+	report.encoding = encoding;
+
+	switch (encoding)
+	{
+	case Encoding::UTF8:
+	{
+		const bool has_bom = bom == BOM::utf8;
+		// Either user specified or no BOM
+		assert(has_bom || (bom == BOM::none));
+
+		if (options.console_code_page && !SetConsoleCodePage(DefaultConsoleCodePage().first, CP_UTF8))
+			return ErrorCode::FunctionFailed;
+
+		std::string filebytes;
+		std::wstring text;
+
+		{
+			PhaseTimer timer(report, Phase::Load);
+			FormatResult<std::string> result = loaded ? std::move(*loaded) : LoadFileBytes(file_path);
+
+			if (!result)
+				return ShowFormatError(file_path, result.error());
+
+			filebytes = std::move(*result);
+		}
+
+		report.bytes = filebytes.size();
+		report.lines = CountLines(filebytes);
+
+		// BOM is not formatted, it's put back as is
+		const std::size_t bom_size = has_bom ? bom_bytes.size() : 0;
+
+		{
+			PhaseTimer timer(report, Phase::Decode);
+			FormatResult<std::wstring> result = WidenUTF8(std::string_view(filebytes).substr(bom_size));
+
+			// Invalid UTF-8 isn't formatted as empty text, offset is reported from the start of file
+			if (!result)
+			{
+				FormatError error = result.error();
+				error.position += error.code == ErrorCode::ParseFailure ? bom_size : 0;
+				return ShowFormatError(file_path, error);
+			}
+
+			text = std::move(*result);
+		}
+
+		{
+			// Decoded text is handed over to formatter and formatted text is handed back
+			PhaseTimer timer(report, Phase::Format);
+			FormatResult<std::wstring> result = FormatTextW(std::move(text), options.tab_width, options.spaces, options.compact, options.line_break, options.normalize, options.code_width);
+
+			if (!result)
+				return ShowFormatError(file_path, result.error());
+
+			text = std::move(*result);
+		}
+
+		std::string formatted;
+
+		{
+			// BOM is taken from loaded file and encoded together with text
+			PhaseTimer timer(report, Phase::Encode);
+			FormatResult<std::string> result = NarrowUTF8(text, std::string_view(filebytes).substr(0, bom_size));
+
+			if (!result)
+				return ShowFormatError(file_path, result.error());
+
+			formatted = std::move(*result);
+		}
+
+		// Writing back identical contents would only touch the file
+		if (formatted == filebytes)
+		{
+			report.status = FileStatus::Unchanged;
+			break;
+		}
+
+		// Whitespace is ASCII, UTF-8 is verified without decoding
+		if (options.verify && !VerifyFormatting(file_path, filebytes, formatted, report))
+			return ErrorCode::BadResult;
+
+		// BOM and contents are written at once
+		PhaseTimer timer(report, Phase::Write);
+		const FormatResult<> written = WriteFileBytes(file_path, formatted, false);
+
+		if (!written)
+			return ShowFormatError(file_path, written.error());
+
+		report.bytes_written = formatted.size();
+		report.status = FileStatus::Changed;
+		break;
+	}
+	case Encoding::UTF16LE:
+	{
+		// If there is no BOM don't assume
+		assert(bom == BOM::utf16le);
+
+		// Console is touched only if it was modified by previous UTF-8 file
+		if (options.console_code_page && !RestoreConsoleCodePage())
+			return ErrorCode::FunctionFailed;
+
+		std::wstring filestring;
+		std::wstring formatted;
+
+		{
+			std::string filebytes;
+
+			{
+				PhaseTimer timer(report, Phase::Load);
+				FormatResult<std::string> result = loaded ? std::move(*loaded) : LoadFileBytes(file_path);
+
+				if (!result)
+					return ShowFormatError(file_path, result.error());
+
+				filebytes = std::move(*result);
+			}
+
+			report.bytes = filebytes.size();
+
+			// BOM is not formatted, it's put back as is
+			const std::string_view body = std::string_view(filebytes).substr(bom_bytes.size());
+
+			if (body.size() % sizeof(wchar_t) != 0)
+				return ShowFormatError(file_path, FormatError{ ErrorCode::ParseFailure, "decode", filebytes.size() - 1 });
+
+			// Line breaks are not translated, loaded bytes are UTF-16 code units as is
+			PhaseTimer timer(report, Phase::Decode);
+			filestring.resize(body.size() / sizeof(wchar_t));
+			std::memcpy(filestring.data(), body.data(), body.size());
+		}
+
+		report.lines = CountLines(filestring);
+
+		{
+			// Loaded contents are compared with formatted text thus a copy is handed over to formatter
+			PhaseTimer timer(report, Phase::Decode);
+			formatted = CopyBuffer(filestring, report);
+		}
+
+		{
+			// UTF-16 files are always formatted with CRLF line breaks
+			PhaseTimer timer(report, Phase::Format);
+			FormatResult<std::wstring> result = FormatTextW(std::move(formatted), options.tab_width, options.spaces, options.compact, LineBreak::CRLF, options.normalize, options.code_width);
+
+			if (!result)
+				return ShowFormatError(file_path, result.error());
+
+			formatted = std::move(*result);
+		}
+
+		if (formatted == filestring)
+		{
+			report.status = FileStatus::Unchanged;
+			break;
+		}
+
+		if (options.verify && !VerifyFormatting(file_path, filestring, formatted, report))
+			return ErrorCode::BadResult;
+
+		std::string filebytes;
+
+		{
+			// BOM and code units are written at once
+			PhaseTimer timer(report, Phase::Encode);
+			filebytes.reserve(bom_bytes.size() + formatted.size() * sizeof(wchar_t));
+			filebytes.assign(bom_bytes.begin(), bom_bytes.end());
+
+			SUPPRESS(26490)	// Don't use reinterpret_cast
+			filebytes.append(reinterpret_cast<const char*>(formatted.data()), formatted.size() * sizeof(wchar_t));
+		}
+
+		PhaseTimer timer(report, Phase::Write);
+		const FormatResult<> written = WriteFileBytes(file_path, filebytes, false);
+
+		if (!written)
+			return ShowFormatError(file_path, written.error());
+
+		report.bytes_written = filebytes.size();
+		report.status = FileStatus::Changed;
+		break;
+	}
+	case Encoding::ANSI:
+	case Encoding::Unknown:
+	{
+		assert(bom == BOM::none);
+
+		// Console is touched only if it was modified by previous UTF-8 file
+		if (options.console_code_page && !RestoreConsoleCodePage())
+			return ErrorCode::FunctionFailed;
+
+		std::string filebytes;
+		std::string formatted;
+
+		{
+			PhaseTimer timer(report, Phase::Load);
+			FormatResult<std::string> result = loaded ? std::move(*loaded) : LoadFileBytes(file_path);
+
+			if (!result)
+				return ShowFormatError(file_path, result.error());
+
+			filebytes = std::move(*result);
+		}
+
+		report.bytes = filebytes.size();
+		report.lines = CountLines(filebytes);
+
+		{
+			// ANSI is not decoded, loaded contents are compared with formatted text
+			// thus the only copy of file is the one handed over to formatter
+			PhaseTimer timer(report, Phase::Decode);
+			formatted = CopyBuffer(filebytes, report);
+		}
+
+		{
+			PhaseTimer timer(report, Phase::Format);
+			FormatResult<std::string> result = FormatTextA(std::move(formatted), options.tab_width, options.spaces, options.compact, options.line_break, options.normalize, options.code_width);
+
+			if (!result)
+				return ShowFormatError(file_path, result.error());
+
+			formatted = std::move(*result);
+		}
+
+		if (formatted == filebytes)
+		{
+			report.status = FileStatus::Unchanged;
+			break;
+		}
+
+		if (options.verify && !VerifyFormatting(file_path, filebytes, formatted, report))
+			return ErrorCode::BadResult;
+
+		PhaseTimer timer(report, Phase::Write);
+		const FormatResult<> written = WriteFileBytes(file_path, formatted, false);
+
+		if (!written)
+			return ShowFormatError(file_path, written.error());
+
+		report.bytes_written = formatted.size();
+		report.status = FileStatus::Changed;
+		break;
+	}
+	case Encoding::Unsupported:
+	default:
+		goto invalid_encoding;
+	}
+
+	if (report.status == FileStatus::Unchanged)
+		Log(Verbosity::Verbose) << "file is already formatted";
+
+	return ErrorCode::Success;
+
+invalid_encoding:
+	ShowError(ErrorCode::UnsuportedOperation, EncodingToString(encoding) + " was specified but file " + file_path.filename().string() + " is encoded as " + BomToString(bom));
+	return ErrorCode::UnsuportedOperation;
+}
+
+ErrorCode FormatSourceFile(const std::filesystem::path& file_path, const FormatOptions& options, std::optional<std::string> filebytes)
+{
+	// Records of this file are written together whether or not it was formatted
+	const LogBatch log_batch;
+	// In batch mode errors are recorded for this file
+	const ErrorContext context(file_path.string());
+	const std::size_t errors = ErrorCount();
+
+	// Spans of this file are tagged with its path and size
+	TraceFile trace(file_path);
+	TraceSpan span("file");
+
+	TraceLoggingWrite(probe_provider, "File",
+		TraceLoggingOpcode(WINEVENT_OPCODE_START),
+		TraceLoggingWideString(file_path.c_str(), "Path"));
+
+	FileReport report;
+	report.path = file_path;
+	ErrorCode status = ErrorCode::Success;
+
+	try
+	{
+		status = FormatSource(file_path, options, filebytes, report);
+	}
+	catch (...)
+	{
+		trace.SetSize(report.bytes);
+		report.status = FileStatus::Error;
+
+		TraceLoggingWrite(probe_provider, "File",
+			TraceLoggingOpcode(WINEVENT_OPCODE_STOP),
+			TraceLoggingWideString(file_path.c_str(), "Path"),
+			TraceLoggingUInt64(report.bytes, "Bytes"),
+			TraceLoggingString(FileStatusToString(report.status), "Status"));
+
+		SubmitReport(std::move(report));
+		throw;
+	}
+
+	trace.SetSize(report.bytes);
+
+	if (status == ErrorCode::UnsuportedOperation)
+		report.status = FileStatus::Skipped;
+	else if ((status != ErrorCode::Success) || (ErrorCount() != errors))
+		report.status = FileStatus::Error;
+
+	TraceLoggingWrite(probe_provider, "File",
+		TraceLoggingOpcode(WINEVENT_OPCODE_STOP),
+		TraceLoggingWideString(file_path.c_str(), "Path"),
+		TraceLoggingUInt64(report.bytes, "Bytes"),
+		TraceLoggingString(FileStatusToString(report.status), "Status"));
+
+	SubmitReport(std::move(report));
+	return status;
+}
+
+/**
+ * @brief			Get display width of the widest code line with inline comment of a loaded source file
+ * @param filebytes	File contents including BOM
+ * @param options	Formatting options
+ * @return			Display width of code, 0 if file encoding is not supported
+*/
+[[nodiscard]] static std::size_t MeasureSource(const std::string& filebytes, const FormatOptions& options)
+{
+	std::vector<unsigned char> bom_bytes;
+	const Encoding file_encoding = BomToEncoding(GetBOM(filebytes, bom_bytes));
+	const std::string_view text = std::string_view(filebytes).substr(bom_bytes.size());
+
+	// Encoding is chosen same as by FormatSource
+	const Encoding encoding = ((file_encoding == Encoding::UTF8) || (file_encoding == Encoding::UTF16LE)) ? file_encoding : options.encoding;
+
+	if (file_encoding == Encoding::Unsupported)
+		return 0;
+
+	switch (encoding)
+	{
+	case Encoding::UTF8:
+		// Invalid UTF-8 is measured as empty, formatting pass reports it
+		return GetCodeWidthW(WidenUTF8(text).value_or(std::wstring()), options.tab_width, options.spaces, options.normalize);
+	case Encoding::UTF16LE:
+	{
+		// Line breaks are not translated, trailing \r is trimmed as whitespace
+		std::wstring wide(text.size() / sizeof(wchar_t), L'\0');
+		std::memcpy(wide.data(), text.data(), wide.size() * sizeof(wchar_t));
+
+		return GetCodeWidthW(wide, options.tab_width, options.spaces, options.normalize);
+	}
+	case Encoding::ANSI:
+	case Encoding::Unknown:
+	default:
+		return GetCodeWidthA(filebytes, options.tab_width, options.spaces, options.normalize);
+	}
+}
+
+std::size_t GetGlobalCodeWidth(const std::vector<std::filesystem::path>& files, const FormatOptions& options,
+	std::vector<std::optional<std::string>>& contents)
+{
+	contents.assign(files.size(), std::nullopt);
+
+	if (files.empty())
+		return 0;
+
+	// Index of the next file to load, shared by threads
+	std::atomic<std::size_t> next = 0;
+
+	const auto measure = [&files, &options, &contents, &next](std::size_t& widest)
+	{
+		for (std::size_t index = next++; index < files.size(); index = next++)
+		{
+			TraceFile trace(files[index]);
+			TraceSpan span("measure");
+
+			// Errors are shown by the formatting pass which loads the file again
+			try
+			{
+				FormatResult<std::string> result = LoadFileBytes(files[index]);
+
+				if (!result)
+					continue;
+
+				trace.SetSize(result->size());
+				widest = std::max(widest, MeasureSource(*result, options));
+				contents[index] = std::move(*result);
+			}
+			catch (...)
+			{
+				contents[index].reset();
+			}
+		}
+	};
+
+	const std::size_t count = std::min<std::size_t>(std::max(std::thread::hardware_concurrency(), 1u), files.size());
+
+	// Each thread keeps its own maximum, maxima are reduced once all threads are done
+	std::vector<std::size_t> widths(count, 0);
+	std::vector<std::thread> threads;
+	threads.reserve(count - 1);
+
+	for (std::size_t thread = 1; thread < count; ++thread)
+		threads.emplace_back(measure, std::ref(widths[thread]));
+
+	measure(widths.front());
+
+	for (std::thread& thread : threads)
+		thread.join();
+
+	return *std::max_element(widths.begin(), widths.end());
+}
+
+ErrorCode FormatSourceFiles(const std::vector<std::filesystem::path>& files, const FormatOptions& options,
+	std::vector<std::optional<std::string>>& contents)
+{
+	if (files.empty())
+		return ErrorCode::Success;
+
+	const bool batch = GetErrorPolicy() == ErrorPolicy::Batch;
+
+	// Index of the next file to format, shared by threads
+	std::atomic<std::size_t> next = 0;
+	// Set once formatting can't continue, files which were started are finished
+	std::atomic<bool> stop = false;
+	// The first exception thrown outside of batch mode, rethrown once all threads are done
+	std::exception_ptr exception;
+	std::mutex exception_mutex;
+
+	// Called from catch block
+	const auto keep_exception = [&exception, &exception_mutex, &stop]()
+	{
+		std::lock_guard lock(exception_mutex);
+
+		if (!exception)
+			exception = std::current_exception();
+
+		stop = true;
+	};
+
+	// Outside of batch mode a failing file prompts the user, thus files are formatted one by one on calling thread
+	const std::size_t count = batch ? std::min<std::size_t>(std::max(std::thread::hardware_concurrency(), 1u), files.size()) : 1;
+
+	// Console code page is set once for all threads instead of each thread switching it per file
+	FormatOptions thread_options = options;
+	thread_options.console_code_page = count == 1;
+
+	if ((count > 1) && !SetConsoleCodePage(DefaultConsoleCodePage().first, CP_UTF8))
+		return ErrorCode::FunctionFailed;
+
+	const auto format = [&]()
+	{
+		for (std::size_t index = next++; (index < files.size()) && !stop; index = next++)
+		{
+			const std::filesystem::path& file_path = files[index];
+
+			// In batch mode one bad file must not stop formatting of remaining files
+			try
+			{
+				if ((FormatSourceFile(file_path, thread_options, contents.empty() ? std::nullopt : std::move(contents[index])) == ErrorCode::FunctionFailed) && !batch)
+					stop = true;
+			}
+			catch (Exception& custom)
+			{
+				if (!batch)
+				{
+					keep_exception();
+					continue;
+				}
+
+				const ErrorContext context(file_path.string());
+				ShowError(custom, ERROR_INFO);
+			}
+			catch (const std::exception& ex)
+			{
+				if (!batch)
+				{
+					keep_exception();
+					continue;
+				}
+
+				const ErrorContext context(file_path.string());
+				ShowError(ex, ERROR_INFO);
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(count - 1);
+
+	for (std::size_t thread = 1; thread < count; ++thread)
+		threads.emplace_back(format);
+
+	format();
+
+	for (std::thread& thread : threads)
+		thread.join();
+
+	if ((count > 1) && !RestoreConsoleCodePage())
+		stop = true;
+
+	if (exception)
+		std::rethrow_exception(exception);
+
+	return stop ? ErrorCode::FunctionFailed : ErrorCode::Success;
+}
@@ -0,0 +1,91 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\Formatter.hpp
+ *
+ * Function declarations which load, format and write back source files
+ *
+*/
+
+#pragma once
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+#include "FormatFile.hpp"
+#include "SourceFile.hpp"
+#include "ErrorCode.hpp"
+
+
+/**
+ * @brief Options used to format source files as specified on command line
+*/
+struct FormatOptions
+{
+	// Count of spaces ocupying a tab character
+	std::size_t tab_width = 4;
+	// Use spaces instead of tabs?
+	bool spaces = false;
+	// Replace all surplus blank lines with single blank line
+	bool compact = false;
+	// Encoding used for files which have no BOM
+	Encoding encoding = Encoding::ANSI;
+	// Line breaks conversion
+	LineBreak line_break = LineBreak::Preserve;
+	// Normalize whitespace between code tokens?
+	bool normalize = false;
+	// Verify that only whitespace was changed before writing the file?
+	bool verify = true;
+	// Display width of the widest code of all files to which inline comments are aligned, 0 to align each file on its own
+	std::size_t code_width = 0;
+	// Set console code page per file according to its encoding? Callers which format concurrently set it once instead
+	bool console_code_page = true;
+};
+
+/**
+ * Load source file, detect it's encoding, format it and write it back.
+ * If the file has a BOM then encoding specified by options is ignored.
+ *
+ * @param file_path		Full path to source file
+ * @param options		Formatting options
+ * @param filebytes		File contents including BOM if already loaded, otherwise the file is loaded
+ * @return				ErrorCode::Success if the file was formatted,
+ *						ErrorCode::UnsuportedOperation if the file encoding is not supported and the file was skipped,
+ *						ErrorCode::BadResult if verification failed and the file was not written,
+ *						ErrorCode::ParseFailure if the file couldn't be processed and was not written,
+ *						ErrorCode::FunctionFailed if formatting can't continue
+*/
+[[nodiscard]] wsl::ErrorCode FormatSourceFile(const std::filesystem::path& file_path, const FormatOptions& options, std::optional<std::string> filebytes = std::nullopt);
+
+/**
+ * Load source files concurrently and get display width of the widest code line with inline comment of all files.
+ * Files are only read, contents are kept so that formatting doesn't read files again.
+ * Files which fail to load are skipped, error is shown once they're formatted.
+ *
+ * @param files			Full paths to source files
+ * @param options		Formatting options, code_width is ignored
+ * @param contents		Receives contents of each file including BOM, empty for files which failed to load
+ * @return				Display width of code, 0 if none of the files has inline comments
+*/
+[[nodiscard]] std::size_t GetGlobalCodeWidth(const std::vector<std::filesystem::path>& files, const FormatOptions& options,
+	std::vector<std::optional<std::string>>& contents);
+
+/**
+ * Format source files in the order in which they're specified.
+ * In batch mode one thread per processor takes files, console code page is set once for all threads,
+ * exceptions are shown per file and formatting continues.
+ * Otherwise errors prompt the user thus files are formatted one by one on calling thread and remaining files
+ * are skipped once a file fails with ErrorCode::FunctionFailed or throws, in which case the exception is rethrown.
+ *
+ * @param files			Full paths to source files
+ * @param options		Formatting options
+ * @param contents		Contents loaded by GetGlobalCodeWidth, each is released once the file is formatted, empty to load files
+ * @return				ErrorCode::FunctionFailed if formatting was stopped, ErrorCode::Success otherwise
+*/
+[[nodiscard]] wsl::ErrorCode FormatSourceFiles(const std::vector<std::filesystem::path>& files, const FormatOptions& options,
+	std::vector<std::optional<std::string>>& contents);
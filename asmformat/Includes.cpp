@@ -0,0 +1,250 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\Includes.cpp
+ *
+ * Definitions used to batch files to format such that each file is formatted once
+ *
+*/
+
+#include "pch.hpp"
+#include "Includes.hpp"
+#include "Logger.hpp"
+#include "StringCast.hpp"
+using namespace wsl;
+namespace fs = std::filesystem;
+
+
+/**
+ * @brief			Get path which is the same for all paths referring to the same physical file
+ * @param path		Path to file
+ * @return			Canonical path, or normalized absolute path if file can't be resolved
+*/
+[[nodiscard]] static fs::path CanonicalPath(const fs::path& path)
+{
+	std::error_code error;
+	fs::path canonical = fs::canonical(path, error);
+
+	// File which can't be resolved is reported once it's formatted
+	if (error)
+		return fs::absolute(path, error).lexically_normal();
+
+	return canonical;
+}
+
+/**
+ * @brief			Check if character separates tokens
+ * @tparam CharType	char or wchar_t
+ * @param ch		Character to check
+ * @return			true if character is space or tab
+*/
+template<typename CharType>
+[[nodiscard]] static constexpr bool IsBlank(CharType ch) noexcept
+{
+	return (ch == static_cast<CharType>(' ')) || (ch == static_cast<CharType>('\t')) || (ch == static_cast<CharType>('\r'));
+}
+
+/**
+ * @brief			Compare token with directive name ignoring case
+ * @tparam CharType	char or wchar_t
+ * @param token		Token from source file
+ * @param directive	Directive name in lower case
+ * @return			true if token is the directive
+*/
+template<typename CharType>
+[[nodiscard]] static bool IsDirective(std::basic_string_view<CharType> token, std::string_view directive) noexcept
+{
+	return std::equal(token.begin(), token.end(), directive.begin(), directive.end(), [](CharType ch, char lower)
+	{
+		const CharType upper = static_cast<CharType>(lower - 'a' + 'A');
+		return (ch == static_cast<CharType>(lower)) || ((lower >= 'a') && (lower <= 'z') && (ch == upper));
+	});
+}
+
+/**
+ * @brief			Get file names specified by INCLUDE directives
+ * @tparam CharType	char or wchar_t
+ * @param text		File contents without BOM
+ * @return			File names as written in source file, without angle brackets or quotes
+*/
+template<typename CharType>
+[[nodiscard]] static std::vector<std::basic_string<CharType>> ScanIncludes(std::basic_string_view<CharType> text)
+{
+	using StringView = std::basic_string_view<CharType>;
+	std::vector<std::basic_string<CharType>> names;
+
+	std::size_t begin = 0;
+
+	while (begin < text.size())
+	{
+		std::size_t end = text.find(static_cast<CharType>('\n'), begin);
+
+		if (end == StringView::npos)
+			end = text.size();
+
+		const StringView line = text.substr(begin, end - begin);
+		begin = end + 1;
+
+		// Directive is the first token, comment lines begin with semicolon
+		std::size_t pos = 0;
+		while ((pos < line.size()) && IsBlank(line[pos]))
+			++pos;
+
+		const std::size_t token = pos;
+		while ((pos < line.size()) && !IsBlank(line[pos]) && (line[pos] != static_cast<CharType>(';')))
+			++pos;
+
+		// INCLUDELIB names a library which isn't formatted
+		if ((pos == line.size()) || !IsDirective(line.substr(token, pos - token), "include"))
+			continue;
+
+		while ((pos < line.size()) && IsBlank(line[pos]))
+			++pos;
+
+		if (pos == line.size())
+			continue;
+
+		// INCLUDE <file>, INCLUDE "file" or INCLUDE file
+		std::size_t name_end = StringView::npos;
+		const CharType open = line[pos];
+
+		if (open == static_cast<CharType>('<'))
+			name_end = line.find(static_cast<CharType>('>'), ++pos);
+		else if ((open == static_cast<CharType>('"')) || (open == static_cast<CharType>('\'')))
+			name_end = line.find(open, ++pos);
+		else
+		{
+			name_end = pos;
+			while ((name_end < line.size()) && !IsBlank(line[name_end]) && (line[name_end] != static_cast<CharType>(';')))
+				++name_end;
+		}
+
+		if ((name_end != StringView::npos) && (name_end > pos))
+			names.emplace_back(line.substr(pos, name_end - pos));
+	}
+
+	return names;
+}
+
+/**
+ * @brief			Get files included by source file
+ * @param file_path	Full path to source file
+ * @param encoding	Encoding of file if it has no BOM
+ * @return			Paths as written in INCLUDE directives, empty if file can't be read
+*/
+[[nodiscard]] static std::vector<fs::path> GetIncludes(const fs::path& file_path, Encoding encoding)
+{
+	std::vector<fs::path> includes;
+	const FormatResult<std::string> result = LoadFileBytes(file_path);
+
+	// Error is shown once the file is formatted
+	if (!result)
+		return includes;
+
+	std::vector<unsigned char> bom_bytes;
+	const Encoding file_encoding = BomToEncoding(GetBOM(*result, bom_bytes));
+	const std::string_view text = std::string_view(*result).substr(bom_bytes.size());
+
+	if ((file_encoding == Encoding::UTF8) || (file_encoding == Encoding::UTF16LE))
+		encoding = file_encoding;
+	else if (file_encoding == Encoding::Unsupported)
+		return includes;
+
+	switch (encoding)
+	{
+	case Encoding::UTF16LE:
+	{
+		std::wstring wide(text.size() / sizeof(wchar_t), L'\0');
+		std::memcpy(wide.data(), text.data(), wide.size() * sizeof(wchar_t));
+
+		for (const std::wstring& name : ScanIncludes(std::wstring_view(wide)))
+			includes.emplace_back(name);
+		break;
+	}
+	case Encoding::UTF8:
+	case Encoding::ANSI:
+	default:
+		// Directive is ASCII, only file name is converted from file encoding
+		for (const std::string& name : ScanIncludes(text))
+			includes.emplace_back(StringCast(name, encoding == Encoding::UTF8 ? CP_UTF8 : CP_ACP));
+		break;
+	}
+
+	return includes;
+}
+
+/**
+ * @brief			Find file specified by INCLUDE directive
+ * @param file_path	Full path to file which contains directive
+ * @param include	Path specified by directive
+ * @return			Path to included file, empty if file was not found
+*/
+[[nodiscard]] static fs::path ResolveInclude(const fs::path& file_path, const fs::path& include)
+{
+	std::error_code error;
+
+	if (include.is_absolute())
+		return fs::is_regular_file(include, error) ? include : fs::path();
+
+	const fs::path sibling = file_path.parent_path() / include;
+
+	if (fs::is_regular_file(sibling, error))
+		return sibling.lexically_normal();
+
+	if (fs::is_regular_file(include, error))
+		return fs::absolute(include, error).lexically_normal();
+
+	return fs::path();
+}
+
+std::size_t RemoveDuplicateFiles(std::vector<fs::path>& files)
+{
+	const std::size_t count = files.size();
+	std::set<fs::path> unique;
+
+	const auto duplicate = std::remove_if(files.begin(), files.end(), [&unique](const fs::path& file)
+	{
+		return !unique.insert(CanonicalPath(file)).second;
+	});
+
+	files.erase(duplicate, files.end());
+	return count - files.size();
+}
+
+std::size_t FollowIncludes(std::vector<fs::path>& files, Encoding encoding)
+{
+	const std::size_t count = files.size();
+	std::set<fs::path> known;
+
+	for (const fs::path& file : files)
+		known.insert(CanonicalPath(file));
+
+	// Included files are appended and scanned by the same loop until no new files are found
+	for (std::size_t index = 0; index < files.size(); ++index)
+	{
+		// Appending invalidates references
+		const fs::path file_path = files.at(index);
+
+		for (const fs::path& include : GetIncludes(file_path, encoding))
+		{
+			const fs::path resolved = ResolveInclude(file_path, include);
+
+			if (resolved.empty())
+			{
+				Log(Verbosity::Verbose) << "file " << include << " included by " << file_path.filename() << " was not found";
+			}
+			else if (known.insert(CanonicalPath(resolved)).second)
+			{
+				Log(Verbosity::Verbose) << "file " << resolved.filename() << " is included by " << file_path.filename();
+				files.push_back(resolved);
+			}
+		}
+	}
+
+	return files.size() - count;
+}
@@ -0,0 +1,42 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\Includes.hpp
+ *
+ * Declarations used to batch files to format such that each file is formatted once
+ *
+ * INCLUDE directive is resolved relative to directory of file which contains it and then
+ * relative to current working directory, directories of INCLUDE environment variable are not searched
+ * so that SDK headers aren't formatted. INCLUDELIB directives name libraries which are never formatted.
+ *
+*/
+
+#pragma once
+#include <vector>
+#include <filesystem>
+#include "SourceFile.hpp"
+
+
+/**
+ * Remove files which refer to the same physical file as a file preceding them,
+ * ex. same file specified by --path and found by --directory or reached trough a link.
+ *
+ * @param files		Files to format, order of remaining files is preserved
+ * @return			Count of files which were removed
+*/
+std::size_t RemoveDuplicateFiles(std::vector<std::filesystem::path>& files);
+
+/**
+ * Scan files for INCLUDE directives and append included files which exist, included files are scanned as well.
+ * Files which are already in the vector are not appended again.
+ *
+ * @param files		Files to format, receives included files
+ * @param encoding	Encoding of files which have no BOM
+ * @return			Count of files which were appended
+*/
+std::size_t FollowIncludes(std::vector<std::filesystem::path>& files, Encoding encoding);
@@ -0,0 +1,742 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\Kernels.cpp
+ *
+ * Definitions of scalar and vectorized kernels and selection of kernels
+ *
+ * Vectorized kernels process whole registers and leave the remainder to scalar kernel.
+ * MSVC compiles intrinsics of any instruction set regardless of /arch option, thus functions
+ * which use them must only be called once CPUID confirmed the instruction set is supported.
+ *
+*/
+
+#include "pch.hpp"
+#include "Kernels.hpp"
+#include "ErrorMacros.hpp"
+using namespace wsl;
+
+#if defined _M_X64 || defined _M_IX86
+#include <intrin.h>		// __cpuid, __cpuidex
+#include <immintrin.h>	// _xgetbv, SSE2, AVX2 and AVX-512 intrinsics
+#define KERNELS_X86
+#endif
+
+// 26490 Don't use reinterpret_cast, loads and stores of unaligned registers take pointers to register type
+DISABLE(26490)
+
+
+template<typename CharType>
+[[nodiscard]] static std::size_t FindLineBreakScalar(const CharType* data, std::size_t pos, std::size_t size) noexcept
+{
+	for (; pos < size; ++pos)
+	{
+		if ((data[pos] == static_cast<CharType>('\r')) || (data[pos] == static_cast<CharType>('\n')))
+			break;
+	}
+
+	return pos;
+}
+
+template<typename CharType>
+[[nodiscard]] static std::size_t CountLineFeedsScalar(const CharType* data, std::size_t size) noexcept
+{
+	return static_cast<std::size_t>(std::count(data, data + size, static_cast<CharType>('\n')));
+}
+
+template<typename CharType>
+[[nodiscard]] static std::size_t SkipBlanksScalar(const CharType* data, std::size_t size) noexcept
+{
+	std::size_t pos = 0;
+
+	while ((pos < size) && IsAsciiBlank(data[pos]))
+		++pos;
+
+	return pos;
+}
+
+template<typename CharType>
+[[nodiscard]] static std::size_t AsciiLengthScalar(const CharType* data, std::size_t size) noexcept
+{
+	std::size_t pos = 0;
+
+	while ((pos < size) && (CodeUnit(data[pos]) <= 0x7Fu))
+		++pos;
+
+	return pos;
+}
+
+static void WidenAsciiScalar(const char* data, std::size_t size, wchar_t* out) noexcept
+{
+	for (std::size_t pos = 0; pos < size; ++pos)
+		out[pos] = static_cast<wchar_t>(data[pos]);
+}
+
+static void NarrowAsciiScalar(const wchar_t* data, std::size_t size, char* out) noexcept
+{
+	for (std::size_t pos = 0; pos < size; ++pos)
+		out[pos] = static_cast<char>(data[pos]);
+}
+
+#ifdef KERNELS_X86
+/**
+ * Operations on 128 bit registers.
+ * Masks have one bit per byte, thus wide characters are represented by 2 bits.
+*/
+struct SSE2
+{
+	using Register = __m128i;
+	using Mask = std::uint32_t;
+	static constexpr std::size_t bytes = sizeof(Register);
+
+	// Count of mask bits per character
+	template<typename CharType>
+	static constexpr std::size_t unit = sizeof(CharType);
+
+	static Register Load(const void* data) noexcept
+	{
+		return _mm_loadu_si128(static_cast<const Register*>(data));
+	}
+
+	template<typename CharType>
+	static Register Set(std::uint32_t value) noexcept
+	{
+		if constexpr (sizeof(CharType) == 1)
+			return _mm_set1_epi8(static_cast<char>(value));
+		else return _mm_set1_epi16(static_cast<short>(value));
+	}
+
+	template<typename CharType>
+	static Register Subtract(Register a, Register b) noexcept
+	{
+		if constexpr (sizeof(CharType) == 1)
+			return _mm_sub_epi8(a, b);
+		else return _mm_sub_epi16(a, b);
+	}
+
+	template<typename CharType>
+	static Mask Equal(Register a, Register b) noexcept
+	{
+		if constexpr (sizeof(CharType) == 1)
+			return static_cast<Mask>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)));
+		else return static_cast<Mask>(_mm_movemask_epi8(_mm_cmpeq_epi16(a, b)));
+	}
+
+	// Unsigned a <= b, SSE2 has no unsigned compare but saturating subtraction is 0 exactly then
+	template<typename CharType>
+	static Mask AtMost(Register a, Register b) noexcept
+	{
+		if constexpr (sizeof(CharType) == 1)
+			return Equal<CharType>(_mm_subs_epu8(a, b), _mm_setzero_si128());
+		else return Equal<CharType>(_mm_subs_epu16(a, b), _mm_setzero_si128());
+	}
+
+	// Mask of all characters of a register
+	static constexpr Mask All() noexcept
+	{
+		return 0xFFFF;
+	}
+
+	static void Widen(const char* data, wchar_t* out) noexcept
+	{
+		const Register chunk = Load(data);
+		_mm_storeu_si128(reinterpret_cast<Register*>(out), _mm_unpacklo_epi8(chunk, _mm_setzero_si128()));
+		_mm_storeu_si128(reinterpret_cast<Register*>(out + 8), _mm_unpackhi_epi8(chunk, _mm_setzero_si128()));
+	}
+
+	static void Narrow(const wchar_t* data, char* out) noexcept
+	{
+		_mm_storeu_si128(reinterpret_cast<Register*>(out), _mm_packus_epi16(Load(data), Load(data + 8)));
+	}
+
+	// Count of characters converted by Widen and Narrow
+	static constexpr std::size_t widen = 16;
+	static constexpr std::size_t narrow = 16;
+};
+
+/**
+ * Operations on 256 bit registers.
+ * Masks have one bit per byte, thus wide characters are represented by 2 bits.
+*/
+struct AVX2
+{
+	using Register = __m256i;
+	using Mask = std::uint32_t;
+	static constexpr std::size_t bytes = sizeof(Register);
+
+	template<typename CharType>
+	static constexpr std::size_t unit = sizeof(CharType);
+
+	static Register Load(const void* data) noexcept
+	{
+		return _mm256_loadu_si256(static_cast<const Register*>(data));
+	}
+
+	template<typename CharType>
+	static Register Set(std::uint32_t value) noexcept
+	{
+		if constexpr (sizeof(CharType) == 1)
+			return _mm256_set1_epi8(static_cast<char>(value));
+		else return _mm256_set1_epi16(static_cast<short>(value));
+	}
+
+	template<typename CharType>
+	static Register Subtract(Register a, Register b) noexcept
+	{
+		if constexpr (sizeof(CharType) == 1)
+			return _mm256_sub_epi8(a, b);
+		else return _mm256_sub_epi16(a, b);
+	}
+
+	template<typename CharType>
+	static Mask Equal(Register a, Register b) noexcept
+	{
+		if constexpr (sizeof(CharType) == 1)
+			return static_cast<Mask>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)));
+		else return static_cast<Mask>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(a, b)));
+	}
+
+	template<typename CharType>
+	static Mask AtMost(Register a, Register b) noexcept
+	{
+		if constexpr (sizeof(CharType) == 1)
+			return Equal<CharType>(_mm256_subs_epu8(a, b), _mm256_setzero_si256());
+		else return Equal<CharType>(_mm256_subs_epu16(a, b), _mm256_setzero_si256());
+	}
+
+	static constexpr Mask All() noexcept
+	{
+		return 0xFFFFFFFF;
+	}
+
+	static void Widen(const char* data, wchar_t* out) noexcept
+	{
+		const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+		_mm256_storeu_si256(reinterpret_cast<Register*>(out), _mm256_cvtepu8_epi16(chunk));
+	}
+
+	static void Narrow(const wchar_t* data, char* out) noexcept
+	{
+		// Packing is done per 128 bit lane, quadwords are put back in order
+		const Register packed = _mm256_packus_epi16(Load(data), Load(data + 16));
+		_mm256_storeu_si256(reinterpret_cast<Register*>(out), _mm256_permute4x64_epi64(packed, 0xD8));
+	}
+
+	// Count of characters converted by Widen and Narrow
+	static constexpr std::size_t widen = 16;
+	static constexpr std::size_t narrow = 32;
+};
+
+/**
+ * Operations on 512 bit registers.
+ * Masks have one bit per character.
+*/
+struct AVX512
+{
+	using Register = __m512i;
+	using Mask = std::uint64_t;
+	static constexpr std::size_t bytes = sizeof(Register);
+
+	template<typename CharType>
+	static constexpr std::size_t unit = 1;
+
+	static Register Load(const void* data) noexcept
+	{
+		return _mm512_loadu_si512(data);
+	}
+
+	template<typename CharType>
+	static Register Set(std::uint32_t value) noexcept
+	{
+		if constexpr (sizeof(CharType) == 1)
+			return _mm512_set1_epi8(static_cast<char>(value));
+		else return _mm512_set1_epi16(static_cast<short>(value));
+	}
+
+	template<typename CharType>
+	static Register Subtract(Register a, Register b) noexcept
+	{
+		if constexpr (sizeof(CharType) == 1)
+			return _mm512_sub_epi8(a, b);
+		else return _mm512_sub_epi16(a, b);
+	}
+
+	template<typename CharType>
+	static Mask Equal(Register a, Register b) noexcept
+	{
+		if constexpr (sizeof(CharType) == 1)
+			return _mm512_cmpeq_epi8_mask(a, b);
+		else return _mm512_cmpeq_epi16_mask(a, b);
+	}
+
+	template<typename CharType>
+	static Mask AtMost(Register a, Register b) noexcept
+	{
+		if constexpr (sizeof(CharType) == 1)
+			return _mm512_cmple_epu8_mask(a, b);
+		else return _mm512_cmple_epu16_mask(a, b);
+	}
+
+	// Wide characters fill only half of the mask
+	template<typename CharType>
+	static constexpr Mask All() noexcept
+	{
+		return sizeof(CharType) == 1 ? ~Mask{ 0 } : 0xFFFFFFFF;
+	}
+
+	static void Widen(const char* data, wchar_t* out) noexcept
+	{
+		const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+		_mm512_storeu_si512(out, _mm512_cvtepu8_epi16(chunk));
+	}
+
+	static void Narrow(const wchar_t* data, char* out) noexcept
+	{
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm512_cvtepi16_epi8(Load(data)));
+	}
+
+	static constexpr std::size_t widen = 32;
+	static constexpr std::size_t narrow = 32;
+};
+
+/**
+ * @brief				Get mask of all characters of a register
+ * @tparam Simd			SSE2, AVX2 or AVX512
+ * @tparam CharType		char or wchar_t
+ * @return				Mask with bits of all characters set
+*/
+template<typename Simd, typename CharType>
+[[nodiscard]] static constexpr typename Simd::Mask AllOf() noexcept
+{
+	if constexpr (std::is_same_v<Simd, AVX512>)
+		return Simd::template All<CharType>();
+	else return Simd::All();
+}
+
+template<typename Simd, typename CharType>
+[[nodiscard]] static std::size_t FindLineBreakSimd(const CharType* data, std::size_t pos, std::size_t size) noexcept
+{
+	constexpr std::size_t lanes = Simd::bytes / sizeof(CharType);
+	const typename Simd::Register cr = Simd::template Set<CharType>('\r');
+	const typename Simd::Register lf = Simd::template Set<CharType>('\n');
+
+	for (; pos + lanes <= size; pos += lanes)
+	{
+		const typename Simd::Register chunk = Simd::Load(data + pos);
+		const typename Simd::Mask mask = Simd::template Equal<CharType>(chunk, cr) | Simd::template Equal<CharType>(chunk, lf);
+
+		if (mask != 0)
+			return pos + static_cast<std::size_t>(std::countr_zero(mask)) / Simd::template unit<CharType>;
+	}
+
+	return FindLineBreakScalar(data, pos, size);
+}
+
+template<typename Simd, typename CharType>
+[[nodiscard]] static std::size_t CountLineFeedsSimd(const CharType* data, std::size_t size) noexcept
+{
+	constexpr std::size_t lanes = Simd::bytes / sizeof(CharType);
+	const typename Simd::Register lf = Simd::template Set<CharType>('\n');
+
+	std::size_t count = 0;
+	std::size_t pos = 0;
+
+	for (; pos + lanes <= size; pos += lanes)
+		count += static_cast<std::size_t>(std::popcount(Simd::template Equal<CharType>(Simd::Load(data + pos), lf)));
+
+	return count / Simd::template unit<CharType> + CountLineFeedsScalar(data + pos, size - pos);
+}
+
+template<typename Simd, typename CharType>
+[[nodiscard]] static std::size_t SkipBlanksSimd(const CharType* data, std::size_t size) noexcept
+{
+	constexpr std::size_t lanes = Simd::bytes / sizeof(CharType);
+	const typename Simd::Register space = Simd::template Set<CharType>(' ');
+	const typename Simd::Register tab = Simd::template Set<CharType>('\t');
+	// \t, \n, \v, \f and \r are consecutive
+	const typename Simd::Register controls = Simd::template Set<CharType>('\r' - '\t');
+
+	std::size_t pos = 0;
+
+	for (; pos + lanes <= size; pos += lanes)
+	{
+		const typename Simd::Register chunk = Simd::Load(data + pos);
+		const typename Simd::Mask blanks = Simd::template Equal<CharType>(chunk, space) |
+			Simd::template AtMost<CharType>(Simd::template Subtract<CharType>(chunk, tab), controls);
+
+		if (blanks != AllOf<Simd, CharType>())
+			return pos + static_cast<std::size_t>(std::countr_one(blanks)) / Simd::template unit<CharType>;
+	}
+
+	return pos + SkipBlanksScalar(data + pos, size - pos);
+}
+
+template<typename Simd, typename CharType>
+[[nodiscard]] static std::size_t AsciiLengthSimd(const CharType* data, std::size_t size) noexcept
+{
+	constexpr std::size_t lanes = Simd::bytes / sizeof(CharType);
+	const typename Simd::Register ascii = Simd::template Set<CharType>(0x7F);
+
+	std::size_t pos = 0;
+
+	for (; pos + lanes <= size; pos += lanes)
+	{
+		const typename Simd::Mask mask = Simd::template AtMost<CharType>(Simd::Load(data + pos), ascii);
+
+		if (mask != AllOf<Simd, CharType>())
+			return pos + static_cast<std::size_t>(std::countr_one(mask)) / Simd::template unit<CharType>;
+	}
+
+	return pos + AsciiLengthScalar(data + pos, size - pos);
+}
+
+template<typename Simd>
+static void WidenAsciiSimd(const char* data, std::size_t size, wchar_t* out) noexcept
+{
+	constexpr std::size_t lanes = Simd::widen;
+	std::size_t pos = 0;
+
+	for (; pos + lanes <= size; pos += lanes)
+		Simd::Widen(data + pos, out + pos);
+
+	WidenAsciiScalar(data + pos, size - pos, out + pos);
+}
+
+template<typename Simd>
+static void NarrowAsciiSimd(const wchar_t* data, std::size_t size, char* out) noexcept
+{
+	constexpr std::size_t lanes = Simd::narrow;
+	std::size_t pos = 0;
+
+	for (; pos + lanes <= size; pos += lanes)
+		Simd::Narrow(data + pos, out + pos);
+
+	NarrowAsciiScalar(data + pos, size - pos, out + pos);
+}
+
+/**
+ * @brief			Get kernels of instruction set
+ * @tparam Simd		SSE2, AVX2 or AVX512
+ * @param isa		Instruction set of Simd
+ * @return			Kernels, wide string kernels are scalar if wchar_t is not UTF-16 code unit
+*/
+template<typename Simd>
+[[nodiscard]] static constexpr KernelTable MakeKernels(Isa isa) noexcept
+{
+	KernelTable table;
+	table.isa = isa;
+	table.find_line_break_a = FindLineBreakSimd<Simd, char>;
+	table.count_line_feeds_a = CountLineFeedsSimd<Simd, char>;
+	table.skip_blanks_a = SkipBlanksSimd<Simd, char>;
+	table.ascii_length_a = AsciiLengthSimd<Simd, char>;
+
+	if constexpr (sizeof(wchar_t) == 2)
+	{
+		table.find_line_break_w = FindLineBreakSimd<Simd, wchar_t>;
+		table.count_line_feeds_w = CountLineFeedsSimd<Simd, wchar_t>;
+		table.skip_blanks_w = SkipBlanksSimd<Simd, wchar_t>;
+		table.ascii_length_w = AsciiLengthSimd<Simd, wchar_t>;
+		table.widen_ascii = WidenAsciiSimd<Simd>;
+		table.narrow_ascii = NarrowAsciiSimd<Simd>;
+	}
+	else
+	{
+		table.find_line_break_w = FindLineBreakScalar<wchar_t>;
+		table.count_line_feeds_w = CountLineFeedsScalar<wchar_t>;
+		table.skip_blanks_w = SkipBlanksScalar<wchar_t>;
+		table.ascii_length_w = AsciiLengthScalar<wchar_t>;
+		table.widen_ascii = WidenAsciiScalar;
+		table.narrow_ascii = NarrowAsciiScalar;
+	}
+
+	return table;
+}
+#endif // KERNELS_X86
+
+/**
+ * @brief	Get scalar kernels
+ * @return	Kernels which run on any processor
+*/
+[[nodiscard]] static constexpr KernelTable MakeScalarKernels() noexcept
+{
+	KernelTable table;
+	table.isa = Isa::Scalar;
+	table.find_line_break_a = FindLineBreakScalar<char>;
+	table.find_line_break_w = FindLineBreakScalar<wchar_t>;
+	table.count_line_feeds_a = CountLineFeedsScalar<char>;
+	table.count_line_feeds_w = CountLineFeedsScalar<wchar_t>;
+	table.skip_blanks_a = SkipBlanksScalar<char>;
+	table.skip_blanks_w = SkipBlanksScalar<wchar_t>;
+	table.ascii_length_a = AsciiLengthScalar<char>;
+	table.ascii_length_w = AsciiLengthScalar<wchar_t>;
+	table.widen_ascii = WidenAsciiScalar;
+	table.narrow_ascii = NarrowAsciiScalar;
+	return table;
+}
+
+// Kernels of each instruction set, indexed by Isa
+static const KernelTable kernels[] = {
+	MakeScalarKernels(),
+	#ifdef KERNELS_X86
+	MakeKernels<SSE2>(Isa::SSE2),
+	MakeKernels<AVX2>(Isa::AVX2),
+	MakeKernels<AVX512>(Isa::AVX512)
+	#endif
+};
+
+// Kernels in use, nullptr until the first use or until overridden
+static std::atomic<const KernelTable*> selected = nullptr;
+
+/**
+ * @brief	Query processor and operating system for supported instruction sets
+ * @return	The newest supported instruction set
+*/
+[[nodiscard]] static Isa DetectIsa() noexcept
+{
+	#ifdef KERNELS_X86
+	// EAX, EBX, ECX and EDX
+	int info[4]{ };
+
+	__cpuid(info, 0);
+	const int max_leaf = info[0];
+
+	__cpuid(info, 1);
+	const bool sse2 = (info[3] & (1 << 26)) != 0;
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+
+	if (!sse2)
+		return Isa::Scalar;
+
+	if (!osxsave || !avx || (max_leaf < 7))
+		return Isa::SSE2;
+
+	// Processor may support registers which operating system doesn't preserve on context switch
+	const unsigned long long xcr0 = _xgetbv(0);
+
+	// XMM and YMM state
+	if ((xcr0 & 0x06) != 0x06)
+		return Isa::SSE2;
+
+	__cpuidex(info, 7, 0);
+	const bool avx2 = (info[1] & (1 << 5)) != 0;
+	const bool avx512f = (info[1] & (1 << 16)) != 0;
+	const bool avx512bw = (info[1] & (1 << 30)) != 0;
+
+	if (!avx2)
+		return Isa::SSE2;
+
+	// Opmask, upper halves of ZMM0-15 and ZMM16-31 state
+	if (avx512f && avx512bw && ((xcr0 & 0xE0) == 0xE0))
+		return Isa::AVX512;
+
+	return Isa::AVX2;
+	#else
+	return Isa::Scalar;
+	#endif // KERNELS_X86
+}
+
+Isa GetSupportedIsa() noexcept
+{
+	static const Isa isa = DetectIsa();
+	return isa;
+}
+
+const KernelTable& GetKernels() noexcept
+{
+	const KernelTable* table = selected.load(std::memory_order_acquire);
+
+	if (table == nullptr)
+	{
+		// Threads racing here select the same kernels
+		table = &kernels[static_cast<std::size_t>(GetSupportedIsa())];
+		selected.store(table, std::memory_order_release);
+	}
+
+	return *table;
+}
+
+bool SelectKernels(Isa isa) noexcept
+{
+	if (isa > GetSupportedIsa())
+		return false;
+
+	selected.store(&kernels[static_cast<std::size_t>(isa)], std::memory_order_release);
+	return true;
+}
+
+const char* IsaToString(Isa isa) noexcept
+{
+	switch (isa)
+	{
+	case Isa::SSE2:
+		return "sse2";
+	case Isa::AVX2:
+		return "avx2";
+	case Isa::AVX512:
+		return "avx512";
+	case Isa::Scalar:
+	default:
+		return "scalar";
+	}
+}
+
+bool StringToIsa(std::string_view name, Isa& isa) noexcept
+{
+	for (const Isa candidate : { Isa::Scalar, Isa::SSE2, Isa::AVX2, Isa::AVX512 })
+	{
+		if (name == IsaToString(candidate))
+		{
+			isa = candidate;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * @brief			Find the first byte which isn't part of a valid UTF-8 sequence, used only once conversion failed
+ * @param bytes		UTF-8 encoded text
+ * @return			Offset of the first byte of invalid sequence, size of bytes if all sequences are valid
+*/
+[[nodiscard]] static std::size_t FindInvalidUTF8(std::string_view bytes) noexcept
+{
+	std::size_t pos = 0;
+
+	while (pos < bytes.size())
+	{
+		const std::uint32_t lead = CodeUnit(bytes[pos]);
+		std::size_t length = 0;
+		// Range of the second byte which excludes overlong encodings, surrogates and code points above U+10FFFF
+		std::uint32_t low = 0x80, high = 0xBF;
+
+		if (lead < 0x80)
+		{
+			++pos;
+			continue;
+		}
+		else if ((lead >= 0xC2) && (lead <= 0xDF))
+			length = 2;
+		else if ((lead >= 0xE0) && (lead <= 0xEF))
+		{
+			length = 3;
+			low = lead == 0xE0 ? 0xA0 : low;
+			high = lead == 0xED ? 0x9F : high;
+		}
+		else if ((lead >= 0xF0) && (lead <= 0xF4))
+		{
+			length = 4;
+			low = lead == 0xF0 ? 0x90 : low;
+			high = lead == 0xF4 ? 0x8F : high;
+		}
+		else return pos;
+
+		if (pos + length > bytes.size())
+			return pos;
+
+		for (std::size_t index = 1; index < length; ++index)
+		{
+			const std::uint32_t unit = CodeUnit(bytes[pos + index]);
+
+			if ((unit < (index == 1 ? low : 0x80)) || (unit > (index == 1 ? high : 0xBF)))
+				return pos;
+		}
+
+		pos += length;
+	}
+
+	return pos;
+}
+
+/**
+ * @brief			Find the first unpaired surrogate, used only once conversion failed
+ * @param text		UTF-16 text
+ * @return			Offset of unpaired surrogate in code units, size of text if all surrogates are paired
+*/
+[[nodiscard]] static std::size_t FindInvalidUTF16(std::wstring_view text) noexcept
+{
+	for (std::size_t pos = 0; pos < text.size(); ++pos)
+	{
+		const std::uint32_t unit = CodeUnit(text[pos]);
+
+		if ((unit >= 0xDC00) && (unit <= 0xDFFF))
+			return pos;
+
+		if ((unit >= 0xD800) && (unit <= 0xDBFF))
+		{
+			if ((pos + 1 == text.size()) || (CodeUnit(text[pos + 1]) < 0xDC00) || (CodeUnit(text[pos + 1]) > 0xDFFF))
+				return pos;
+
+			++pos;
+		}
+	}
+
+	return text.size();
+}
+
+FormatResult<std::wstring> WidenUTF8(std::string_view bytes)
+{
+	const std::size_t ascii = AsciiLength(bytes);
+
+	// ASCII is never part of multibyte sequence, the rest starts on character boundary
+	const std::string_view rest = bytes.substr(ascii);
+	int wchars = 0;
+
+	// MultiByteToWideChar takes size as int, UTF-16 text is never longer than UTF-8 text it was decoded from
+	if (rest.size() > static_cast<std::size_t>(std::numeric_limits<int>::max()))
+		return wsl::unexpected(FormatError{ ErrorCode::OutOfRange, "decode" });
+
+	if (!rest.empty())
+	{
+		wchars = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, rest.data(), static_cast<int>(rest.size()), nullptr, 0);
+
+		if (wchars == 0)
+			return wsl::unexpected(FormatError{ ErrorCode::ParseFailure, "decode", ascii + FindInvalidUTF8(rest) });
+	}
+
+	// Both parts are converted into the same buffer which is allocated once
+	std::wstring result(ascii + static_cast<std::size_t>(wchars), L'\0');
+	GetKernels().widen_ascii(bytes.data(), ascii, result.data());
+
+	if ((wchars != 0) && (MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, rest.data(), static_cast<int>(rest.size()), result.data() + ascii, wchars) == 0))
+		return wsl::unexpected(FormatError{ ErrorCode::FunctionFailed, "decode", 0, GetLastError() });
+
+	return result;
+}
+
+FormatResult<std::string> NarrowUTF8(std::wstring_view text, std::string_view prefix)
+{
+	const std::size_t ascii = AsciiLength(text);
+
+	// ASCII is never part of surrogate pair, the rest starts on character boundary
+	const std::wstring_view rest = text.substr(ascii);
+	int bytes = 0;
+
+	// WideCharToMultiByte takes and returns size as int, UTF-16 code unit takes at most 3 bytes
+	if (rest.size() > static_cast<std::size_t>(std::numeric_limits<int>::max() / 3))
+		return wsl::unexpected(FormatError{ ErrorCode::OutOfRange, "encode" });
+
+	if (!rest.empty())
+	{
+		bytes = WideCharToMultiByte(CP_UTF8, WC_ERR_INVALID_CHARS, rest.data(), static_cast<int>(rest.size()), nullptr, 0, nullptr, nullptr);
+
+		if (bytes == 0)
+			return wsl::unexpected(FormatError{ ErrorCode::ParseFailure, "encode", ascii + FindInvalidUTF16(rest) });
+	}
+
+	// Prefix and both parts are written into the same buffer which is allocated once
+	std::string result(prefix.size() + ascii + static_cast<std::size_t>(bytes), '\0');
+	std::copy(prefix.begin(), prefix.end(), result.begin());
+	GetKernels().narrow_ascii(text.data(), ascii, result.data() + prefix.size());
+
+	if ((bytes != 0) && (WideCharToMultiByte(CP_UTF8, WC_ERR_INVALID_CHARS, rest.data(), static_cast<int>(rest.size()), result.data() + prefix.size() + ascii, bytes, nullptr, nullptr) == 0))
+		return wsl::unexpected(FormatError{ ErrorCode::FunctionFailed, "encode", 0, GetLastError() });
+
+	return result;
+}
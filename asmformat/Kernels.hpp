@@ -0,0 +1,200 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\Kernels.hpp
+ *
+ * Registry of vectorized kernels selected at run time by instruction sets supported by processor
+ *
+ * Solution is built for baseline instruction set so that one binary runs on every host,
+ * kernels for newer instruction sets are compiled in as well and selected trough CPUID once,
+ * on first use, unless selection is overridden by SelectKernels.
+ * Wide string kernels operate on UTF-16 code units.
+ *
+*/
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include "FormatError.hpp"
+
+
+/**
+ * @brief Instruction set of kernels, ordered from oldest to newest
+*/
+enum class Isa : std::uint8_t
+{
+	Scalar,
+	SSE2,
+	AVX2,
+	AVX512		// AVX-512 F and BW
+};
+
+/**
+ * Kernels of one instruction set, each kernel gives same results regardless of instruction set.
+ * Kernels ending with _a operate on bytes and kernels ending with _w on UTF-16 code units.
+*/
+struct KernelTable
+{
+	// Instruction set of kernels
+	Isa isa = Isa::Scalar;
+
+	// Position of the first CR or LF character at or after pos, size if not found
+	std::size_t(*find_line_break_a)(const char* data, std::size_t pos, std::size_t size) noexcept = nullptr;
+	std::size_t(*find_line_break_w)(const wchar_t* data, std::size_t pos, std::size_t size) noexcept = nullptr;
+
+	// Count of LF characters
+	std::size_t(*count_line_feeds_a)(const char* data, std::size_t size) noexcept = nullptr;
+	std::size_t(*count_line_feeds_w)(const wchar_t* data, std::size_t size) noexcept = nullptr;
+
+	// Count of leading ASCII whitespace characters, same set as matched by \s in C locale
+	std::size_t(*skip_blanks_a)(const char* data, std::size_t size) noexcept = nullptr;
+	std::size_t(*skip_blanks_w)(const wchar_t* data, std::size_t size) noexcept = nullptr;
+
+	// Count of leading ASCII characters
+	std::size_t(*ascii_length_a)(const char* data, std::size_t size) noexcept = nullptr;
+	std::size_t(*ascii_length_w)(const wchar_t* data, std::size_t size) noexcept = nullptr;
+
+	// Convert ASCII characters between bytes and UTF-16 code units
+	void(*widen_ascii)(const char* data, std::size_t size, wchar_t* out) noexcept = nullptr;
+	void(*narrow_ascii)(const wchar_t* data, std::size_t size, char* out) noexcept = nullptr;
+};
+
+/**
+ * @brief	Get the newest instruction set supported by both processor and operating system
+ * @return	Instruction set detected by CPUID the first time this function is called
+*/
+[[nodiscard]] Isa GetSupportedIsa() noexcept;
+
+/**
+ * @brief	Get kernels in use
+ * @return	Kernels of the newest supported instruction set, or of the instruction set selected by SelectKernels
+*/
+[[nodiscard]] const KernelTable& GetKernels() noexcept;
+
+/**
+ * @brief		Override selection of kernels, must be called before any file is formatted
+ * @param isa	Instruction set of kernels to use
+ * @return		false if instruction set is not supported and selection was not changed
+*/
+[[nodiscard]] bool SelectKernels(Isa isa) noexcept;
+
+/**
+ * @brief		Get name of instruction set
+ * @param isa	Instruction set
+ * @return		Name as accepted by --kernels option
+*/
+[[nodiscard]] const char* IsaToString(Isa isa) noexcept;
+
+/**
+ * @brief		Parse name of instruction set
+ * @param name	scalar, sse2, avx2 or avx512
+ * @param isa	Receives instruction set
+ * @return		false if name is not recognized
+*/
+[[nodiscard]] bool StringToIsa(std::string_view name, Isa& isa) noexcept;
+
+/**
+ * @brief			Convert UTF-8 to UTF-16, ASCII prefix is widened by kernel and the rest is converted by MultiByteToWideChar
+ * @param bytes		UTF-8 encoded text
+ * @return			UTF-16 text, or ErrorCode::ParseFailure with offset of the first invalid byte if bytes are not valid UTF-8,
+ *					ErrorCode::OutOfRange if non ASCII part is longer than MultiByteToWideChar can convert
+*/
+[[nodiscard]] FormatResult<std::wstring> WidenUTF8(std::string_view bytes);
+
+/**
+ * @brief			Convert UTF-16 to UTF-8, ASCII prefix is narrowed by kernel and the rest is converted by WideCharToMultiByte
+ * @param text		UTF-16 text
+ * @param prefix	Bytes put in front of converted text as is, ex. BOM
+ * @return			UTF-8 encoded text, or ErrorCode::ParseFailure with offset of unpaired surrogate if text is not valid UTF-16,
+ *					ErrorCode::OutOfRange if non ASCII part is longer than WideCharToMultiByte can convert
+*/
+[[nodiscard]] FormatResult<std::string> NarrowUTF8(std::wstring_view text, std::string_view prefix = { });
+
+/**
+ * @brief				Get character as unsigned number
+ * @tparam CharType		char or wchar_t
+ * @param ch			Character
+ * @return				Code unit
+*/
+template<typename CharType>
+[[nodiscard]] constexpr std::uint32_t CodeUnit(CharType ch) noexcept
+{
+	return static_cast<std::make_unsigned_t<CharType>>(ch);
+}
+
+/**
+ * @brief				Check if character is ASCII whitespace, that is space, \t, \n, \v, \f or \r
+ * @tparam CharType		char or wchar_t
+ * @param ch			Character to check
+ * @return				true if character is ASCII whitespace
+*/
+template<typename CharType>
+[[nodiscard]] constexpr bool IsAsciiBlank(CharType ch) noexcept
+{
+	return (ch == static_cast<CharType>(' ')) || (CodeUnit(ch) - 9u <= 4u);
+}
+
+/**
+ * @brief				Find the first CR or LF character
+ * @tparam CharType		char or wchar_t
+ * @param data			Characters to search
+ * @param pos			Position from which to search
+ * @param size			Count of characters in data
+ * @return				Position of CR or LF character, size if not found
+*/
+template<typename CharType>
+[[nodiscard]] inline std::size_t FindLineBreak(const CharType* data, std::size_t pos, std::size_t size) noexcept
+{
+	if constexpr (sizeof(CharType) == 1)
+		return GetKernels().find_line_break_a(data, pos, size);
+	else return GetKernels().find_line_break_w(data, pos, size);
+}
+
+/**
+ * @brief				Count LF characters, that is lines terminated by LF or CRLF
+ * @tparam CharType		char or wchar_t
+ * @param text			Text to search
+ * @return				Count of LF characters
+*/
+template<typename CharType>
+[[nodiscard]] inline std::size_t CountLineFeeds(std::basic_string_view<CharType> text) noexcept
+{
+	if constexpr (sizeof(CharType) == 1)
+		return GetKernels().count_line_feeds_a(text.data(), text.size());
+	else return GetKernels().count_line_feeds_w(text.data(), text.size());
+}
+
+/**
+ * @brief				Count leading ASCII whitespace characters
+ * @tparam CharType		char or wchar_t
+ * @param text			Text to search
+ * @return				Position of the first character which is not ASCII whitespace, size of text if there is none
+*/
+template<typename CharType>
+[[nodiscard]] inline std::size_t SkipBlanks(std::basic_string_view<CharType> text) noexcept
+{
+	if constexpr (sizeof(CharType) == 1)
+		return GetKernels().skip_blanks_a(text.data(), text.size());
+	else return GetKernels().skip_blanks_w(text.data(), text.size());
+}
+
+/**
+ * @brief				Count leading ASCII characters, these are the same in every supported encoding
+ * @tparam CharType		char or wchar_t
+ * @param text			Text to search
+ * @return				Position of the first character which is not ASCII, size of text if text is ASCII
+*/
+template<typename CharType>
+[[nodiscard]] inline std::size_t AsciiLength(std::basic_string_view<CharType> text) noexcept
+{
+	if constexpr (sizeof(CharType) == 1)
+		return GetKernels().ascii_length_a(text.data(), text.size());
+	else return GetKernels().ascii_length_w(text.data(), text.size());
+}
@@ -0,0 +1,115 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\LineBreak.cpp
+ *
+ * Line break conversion function definitions
+ *
+*/
+
+#include "pch.hpp"
+#include "LineBreak.hpp"
+#include "Kernels.hpp"
+
+
+/**
+ * @brief				Get size of string once its line breaks are converted
+ * @tparam CharType		char or wchar_t
+ * @param source		String which to convert
+ * @param line_break	Target line break, not Preserve
+ * @return				Count of characters of converted string
+*/
+template<typename CharType>
+[[nodiscard]] static std::size_t ConvertedSize(std::basic_string_view<CharType> source, LineBreak line_break) noexcept
+{
+	constexpr CharType cr = static_cast<CharType>('\r');
+	constexpr CharType lf = static_cast<CharType>('\n');
+
+	// LF is counted by kernel, CR is searched for separately because LF line breaks are the common case
+	const std::size_t line_feeds = CountLineFeeds(source);
+	std::size_t carriage_returns = 0;
+	std::size_t pairs = 0;
+
+	for (std::size_t pos = source.find(cr); pos != source.npos; pos = source.find(cr, pos + 1))
+	{
+		++carriage_returns;
+
+		if ((pos + 1 < source.size()) && (source[pos + 1] == lf))
+			++pairs;
+	}
+
+	// CRLF is a single line break, every other CR or LF is a line break too
+	const std::size_t line_breaks = line_feeds + carriage_returns - pairs;
+	const std::size_t text = source.size() - line_feeds - carriage_returns;
+
+	return text + (line_break == LineBreak::CRLF ? 2 * line_breaks : line_breaks);
+}
+
+/**
+ * @brief				Implementation of ConvertLineBreaks
+ * @tparam CharType		char or wchar_t
+ * @param source		String which to convert
+ * @param line_break	Target line break
+ * @return				Converted string
+*/
+template<typename CharType>
+[[nodiscard]] static std::basic_string<CharType> Convert(std::basic_string_view<CharType> source, LineBreak line_break)
+{
+	constexpr CharType cr = static_cast<CharType>('\r');
+	constexpr CharType lf = static_cast<CharType>('\n');
+
+	if (line_break == LineBreak::Preserve)
+		return std::basic_string<CharType>(source);
+
+	// Output is reserved rather than resized so that it's not zero filled before it's written
+	std::basic_string<CharType> result;
+	result.reserve(ConvertedSize(source, line_break));
+
+	const CharType* const data = source.data();
+	const std::size_t size = source.size();
+	std::size_t pos = 0;
+
+	while (pos < size)
+	{
+		const std::size_t next = FindLineBreak(data, pos, size);
+		result.append(data + pos, next - pos);
+
+		if (next == size)
+			break;
+
+		// CRLF is a single line break, anything else is one character line break
+		pos = next + (((data[next] == cr) && (next + 1 < size) && (data[next + 1] == lf)) ? 2 : 1);
+
+		switch (line_break)
+		{
+		case LineBreak::LF:
+			result.push_back(lf);
+			break;
+		case LineBreak::CR:
+			result.push_back(cr);
+			break;
+		case LineBreak::CRLF:
+		default:
+			result.push_back(cr);
+			result.push_back(lf);
+			break;
+		}
+	}
+
+	return result;
+}
+
+std::string ConvertLineBreaks(std::string_view source, LineBreak line_break)
+{
+	return Convert(source, line_break);
+}
+
+std::wstring ConvertLineBreaks(std::wstring_view source, LineBreak line_break)
+{
+	return Convert(source, line_break);
+}
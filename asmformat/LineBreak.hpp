@@ -0,0 +1,49 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\LineBreak.hpp
+ *
+ * Line break conversion function declarations
+ *
+*/
+
+#pragma once
+#include <string>
+#include <string_view>
+
+
+/**
+ * Line breaks used in file
+*/
+enum class LineBreak
+{
+	LF,
+	CRLF,
+	CR,
+	Preserve	// Use existing line breaks
+};
+
+/**
+ * Convert all line breaks to specified line break in a single pass.
+ * LF, CRLF and lone CR are all recognized in source, thus mixed line breaks are normalized.
+ *
+ * @param source		String which to convert
+ * @param line_break	Target line break, LineBreak::Preserve returns source unchanged
+ * @return				Converted string
+*/
+[[nodiscard]] std::string ConvertLineBreaks(std::string_view source, LineBreak line_break);
+
+/**
+ * Convert all line breaks to specified line break in a single pass.
+ * LF, CRLF and lone CR are all recognized in source, thus mixed line breaks are normalized.
+ *
+ * @param source		Wide string which to convert
+ * @param line_break	Target line break, LineBreak::Preserve returns source unchanged
+ * @return				Converted wide string
+*/
+[[nodiscard]] std::wstring ConvertLineBreaks(std::wstring_view source, LineBreak line_break);
@@ -0,0 +1,211 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\Logger.cpp
+ *
+ * Buffered console logging function definitions
+ *
+*/
+
+#include "pch.hpp"
+#include "Logger.hpp"
+
+
+namespace wsl
+{
+	// Current verbosity level
+	static std::atomic<Verbosity> verbosity = Verbosity::Normal;
+
+	// Records logged by this thread and not yet committed
+	static thread_local std::ostringstream thread_buffer;
+
+	/**
+	 * @brief Background sink state shared by all threads
+	*/
+	struct LogSink
+	{
+		// Protects all members below
+		std::mutex mutex;
+		// Signaled when records are queued or sink should stop
+		std::condition_variable queued;
+		// Signaled when sink is done writing queued records
+		std::condition_variable drained;
+		// Committed buffers in order of commit
+		std::deque<std::string> queue;
+		// Set while sink writes records outside of lock
+		bool writing = false;
+		// Set to stop background thread
+		bool stop = false;
+		// Background thread which writes records
+		std::thread thread;
+	};
+
+	static LogSink& GetSink();
+
+	/**
+	 * @brief Write queued records and stop background thread.
+	 * Doesn't touch calling thread's buffer because thread local objects are already destroyed when called on exit
+	*/
+	static void StopSink() noexcept
+	{
+		try
+		{
+			LogSink& sink = GetSink();
+
+			{
+				std::lock_guard lock(sink.mutex);
+				sink.stop = true;
+			}
+
+			sink.queued.notify_one();
+
+			if (sink.thread.joinable())
+				sink.thread.join();
+
+			std::fflush(stdout);
+		}
+		catch (...)
+		{
+			// Nothing can be done on exit
+		}
+	}
+
+	/**
+	 * @brief	Get sink instance and start background thread on first use
+	 * @return	Reference to sink
+	*/
+	static LogSink& GetSink()
+	{
+		static LogSink sink;
+		static std::once_flag started;
+
+		std::call_once(started, []
+		{
+			sink.thread = std::thread([]
+			{
+				std::unique_lock lock(sink.mutex);
+
+				for (;;)
+				{
+					sink.queued.wait(lock, [] { return sink.stop || !sink.queue.empty(); });
+
+					if (sink.queue.empty() && sink.stop)
+						break;
+
+					std::deque<std::string> records;
+					records.swap(sink.queue);
+					sink.writing = true;
+					lock.unlock();
+
+					// Console is not flushed here, only by LogFlush
+					for (const std::string& record : records)
+						std::fwrite(record.data(), sizeof(char), record.size(), stdout);
+
+					lock.lock();
+					sink.writing = false;
+					sink.drained.notify_all();
+				}
+			});
+
+			// Background thread must not outlive the sink, ex. on std::exit or if LogShutdown was not called
+			std::atexit(StopSink);
+		});
+
+		return sink;
+	}
+
+	void SetVerbosity(Verbosity level) noexcept
+	{
+		verbosity = level;
+	}
+
+	bool IsLogged(Verbosity level) noexcept
+	{
+		return (level != Verbosity::Quiet) && (level <= verbosity.load());
+	}
+
+	LogRecord::LogRecord(Verbosity level) :
+		mBuffer(IsLogged(level) ? &thread_buffer : nullptr)
+	{
+	}
+
+	LogRecord::~LogRecord()
+	{
+		if (mBuffer != nullptr)
+			*mBuffer << '\n';
+	}
+
+	void LogCommit()
+	{
+		std::string records = thread_buffer.str();
+
+		if (records.empty())
+			return;
+
+		// Clear contents of the buffer
+		thread_buffer.str(std::string());
+
+		LogSink& sink = GetSink();
+		{
+			std::lock_guard lock(sink.mutex);
+
+			// Once background thread is stopped records are written by calling thread, ex. errors shown after LogShutdown
+			if (sink.stop)
+			{
+				std::fwrite(records.data(), sizeof(char), records.size(), stdout);
+				return;
+			}
+
+			sink.queue.push_back(std::move(records));
+		}
+
+		sink.queued.notify_one();
+	}
+
+	void LogFlush()
+	{
+		LogCommit();
+		LogSink& sink = GetSink();
+
+		std::unique_lock lock(sink.mutex);
+		sink.drained.wait(lock, [&sink] { return sink.queue.empty() && !sink.writing; });
+
+		std::fflush(stdout);
+	}
+
+	void LogShutdown() noexcept
+	{
+		try
+		{
+			LogCommit();
+		}
+		catch (...)
+		{
+			// Records which couldn't be committed are lost
+		}
+
+		StopSink();
+	}
+
+	LogSession::~LogSession()
+	{
+		LogShutdown();
+	}
+
+	LogBatch::~LogBatch()
+	{
+		try
+		{
+			LogCommit();
+		}
+		catch (...)
+		{
+			// Records stay in thread's buffer and are committed with the next batch
+		}
+	}
+}
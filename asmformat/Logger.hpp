@@ -0,0 +1,153 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\Logger.hpp
+ *
+ * Buffered console logging function declarations
+ *
+ * Log records are collected into a buffer private to calling thread,
+ * once the thread commits it's buffer (ex. when done with a file) the records are handed
+ * over to a background sink which writes them to standard output in one chunk.
+ * This way records of one thread are never interleaved with records of another thread
+ * and console is flushed only on exit or before an error is shown.
+ *
+*/
+
+#pragma once
+#include <sstream>
+
+
+namespace wsl
+{
+	/**
+	 * @brief Logging verbosity levels
+	*/
+	enum class Verbosity : unsigned char
+	{
+		Quiet,		// Log nothing, errors are still shown
+		Normal,		// Log options used and files formatted
+		Verbose		// Log additional details per file
+	};
+
+	/**
+	 * @brief		Set verbosity level, records above this level are discarded
+	 * @param level	Verbosity level to set
+	*/
+	void SetVerbosity(Verbosity level) noexcept;
+
+	/**
+	 * @brief		Check if records of the specified level are logged
+	 * @param level	Verbosity level of a record
+	 * @return		true if records of this level are logged
+	*/
+	[[nodiscard]] bool IsLogged(Verbosity level) noexcept;
+
+	/**
+	 * @brief Single log record, appended as one line to calling thread's buffer when destroyed
+	*/
+	class LogRecord
+	{
+		//
+		// Constructors
+		//
+	public:
+		explicit LogRecord(Verbosity level);
+		~LogRecord();
+
+		LogRecord(const LogRecord&) = delete;
+		LogRecord(LogRecord&&) = delete;
+
+		//
+		// Operators
+		//
+		LogRecord& operator=(const LogRecord&) = delete;
+		LogRecord& operator=(LogRecord&&) = delete;
+
+		/** Append value to log record */
+		template<typename Type>
+		LogRecord& operator<<(const Type& value)
+		{
+			if (mBuffer != nullptr)
+				*mBuffer << value;
+
+			return *this;
+		}
+
+		//
+		// Members
+		//
+	private:
+		// Buffer of calling thread or nullptr if the record is discarded
+		std::ostringstream* mBuffer;
+	};
+
+	/**
+	 * @brief		Start log record
+	 * @param level	Verbosity level of the record
+	 * @return		Log record to which values are streamed
+	*/
+	[[nodiscard]] inline LogRecord Log(Verbosity level = Verbosity::Normal)
+	{
+		return LogRecord(level);
+	}
+
+	/** Hand over records buffered by calling thread to background sink */
+	void LogCommit();
+
+	/** Commit calling thread's records and wait until the sink wrote all records and flushed the console */
+	void LogFlush();
+
+	/** Commit calling thread's records, write all records and stop background sink, records logged afterwards are written right away */
+	void LogShutdown() noexcept;
+
+	/**
+	 * @brief Calls LogShutdown when destroyed, instance is created at the top of main
+	 * such that records of the main thread are written on every return path while the thread's buffer is still alive
+	*/
+	class LogSession
+	{
+		//
+		// Constructors
+		//
+	public:
+		LogSession() noexcept = default;
+		~LogSession();
+
+		LogSession(const LogSession&) = delete;
+		LogSession(LogSession&&) = delete;
+
+		//
+		// Operators
+		//
+		LogSession& operator=(const LogSession&) = delete;
+		LogSession& operator=(LogSession&&) = delete;
+	};
+
+	/**
+	 * @brief Calls LogCommit when destroyed, instance is created for the duration of a unit of work
+	 * such that its records are handed over together on every return path, including errors and exceptions
+	*/
+	class LogBatch
+	{
+		//
+		// Constructors
+		//
+	public:
+		LogBatch() noexcept = default;
+		~LogBatch();
+
+		LogBatch(const LogBatch&) = delete;
+		LogBatch(LogBatch&&) = delete;
+
+		//
+		// Operators
+		//
+		LogBatch& operator=(const LogBatch&) = delete;
+		LogBatch& operator=(LogBatch&&) = delete;
+	};
+}
@@ -0,0 +1,41 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\Probes.cpp
+ *
+ * Static tracepoint definitions
+ *
+*/
+
+#include "pch.hpp"
+#include "Probes.hpp"
+
+
+// Name hash GUID of "ASMFormatter" provider name
+TRACELOGGING_DEFINE_PROVIDER(
+	probe_provider,
+	"ASMFormatter",
+	(0x0f25e901, 0xce0f, 0x556f, 0x09, 0x63, 0xaf, 0xe2, 0xb5, 0x12, 0x1a, 0xfb));
+
+void RegisterProbes() noexcept
+{
+	static std::once_flag registered;
+
+	std::call_once(registered, []
+	{
+		// Probes of unregistered provider are ignored, thus failure to register isn't an error
+		if (FAILED(TraceLoggingRegister(probe_provider)))
+			return;
+
+		// Provider must be unregistered before the module is unloaded, atexit of a DLL runs when it's unloaded
+		std::atexit([]
+		{
+			TraceLoggingUnregister(probe_provider);
+		});
+	});
+}
@@ -0,0 +1,28 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\Probes.hpp
+ *
+ * Static tracepoint declarations
+ *
+ * Probes are TraceLogging events of "ASMFormatter" ETW provider {0f25e901-ce0f-556f-0963-afe2b5121afb},
+ * the GUID is derived from provider name so that tools can enable it by name, ex. PerfView /OnlyProviders=*ASMFormatter
+ * Probes are fired with TraceLoggingWrite which evaluates its arguments only if a session enabled the provider,
+ * otherwise a probe costs a single test of a flag.
+ *
+*/
+
+#pragma once
+#include <TraceLoggingProvider.h>
+
+
+// Provider of all probes
+TRACELOGGING_DECLARE_PROVIDER(probe_provider);
+
+/** Register probe provider with ETW once per module, provider is unregistered at exit */
+void RegisterProbes() noexcept;
@@ -0,0 +1,332 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\Report.cpp
+ *
+ * Machine readable run report function definitions
+ *
+*/
+
+#include "pch.hpp"
+#include "Report.hpp"
+#include "Probes.hpp"
+#include "StringCast.hpp"
+#include "utils.hpp"
+#include "error.hpp"
+using namespace wsl;
+namespace fs = std::filesystem;
+using clock_type = std::chrono::steady_clock;
+
+
+/**
+ * @brief Report writer state
+*/
+struct ReportWriter
+{
+	// Protects all members below
+	std::mutex mutex;
+	// Signaled when reports are queued or writer should stop
+	std::condition_variable queued;
+	// Reports submitted and not yet written
+	std::vector<FileReport> queue;
+	// Set to stop writer thread
+	bool stop = false;
+	// Report file, nullptr if report isn't open
+	FILE* file = nullptr;
+	// Writer thread
+	std::thread thread;
+	// Time when report was opened
+	clock_type::time_point start;
+};
+
+// The only report writer
+static ReportWriter writer;
+
+// Buffer copies are counted even if report isn't open
+static std::atomic<std::size_t> copied_files = 0;
+static std::atomic<std::size_t> copied_bytes = 0;
+
+/**
+ * @brief Totals accumulated by writer thread
+*/
+struct ReportTotals
+{
+	std::size_t files = 0;
+	std::array<std::size_t, 4> status{ };
+	std::size_t bytes = 0;
+	std::size_t lines = 0;
+	std::size_t bytes_written = 0;
+	std::size_t bytes_copied = 0;
+	std::array<clock_type::duration, static_cast<std::size_t>(Phase::Count)> phases{ };
+};
+
+/**
+ * @brief			Convert duration to milliseconds
+ * @param duration	Duration to convert
+ * @return			Fractional milliseconds
+*/
+[[nodiscard]] static double ToMilliseconds(clock_type::duration duration) noexcept
+{
+	return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+/**
+ * @brief			Serialize single file report as JSON object
+ * @param report	File report to serialize
+ * @param first		Is this the first object in files array?
+ * @return			JSON object
+*/
+static std::string SerializeReport(const FileReport& report, bool first)
+{
+	std::ostringstream json;
+	json << std::fixed << std::setprecision(3);
+
+	json << (first ? "\n" : ",\n") << "    {"
+		<< "\"path\": \"" << JsonEscape(StringCast(report.path.wstring())) << "\", "
+		<< "\"bom\": \"" << (report.bom == BOM::none ? "none" : BomToString(report.bom)) << "\", "
+		<< "\"encoding\": \"" << EncodingToString(report.encoding) << "\", "
+		<< "\"bytes\": " << report.bytes << ", "
+		<< "\"lines\": " << report.lines << ", "
+		<< "\"status\": \"" << FileStatusToString(report.status) << "\", "
+		<< "\"bytes_written\": " << report.bytes_written << ", "
+		<< "\"bytes_copied\": " << report.bytes_copied << ", "
+		<< "\"phases_ms\": {";
+
+	for (std::size_t i = 0; i < report.phases.size(); ++i)
+	{
+		json << (i == 0 ? "" : ", ") << "\"" << PhaseToString(static_cast<Phase>(i)) << "\": " << ToMilliseconds(report.phases.at(i));
+	}
+
+	json << "}}";
+	return json.str();
+}
+
+/**
+ * @brief			Serialize totals and throughput as JSON object
+ * @param totals	Totals accumulated by writer
+ * @param elapsed	Wall time of the run
+ * @return			JSON object
+*/
+static std::string SerializeTotals(const ReportTotals& totals, clock_type::duration elapsed)
+{
+	const double seconds = std::chrono::duration<double>(elapsed).count();
+	std::ostringstream json;
+	json << std::fixed << std::setprecision(3);
+
+	json << "  \"totals\": {"
+		<< "\"files\": " << totals.files << ", ";
+
+	for (std::size_t i = 0; i < totals.status.size(); ++i)
+		json << "\"" << FileStatusToString(static_cast<FileStatus>(i)) << "\": " << totals.status.at(i) << ", ";
+
+	json << "\"bytes\": " << totals.bytes << ", "
+		<< "\"lines\": " << totals.lines << ", "
+		<< "\"bytes_written\": " << totals.bytes_written << ", "
+		<< "\"bytes_copied\": " << totals.bytes_copied << ", "
+		<< "\"phases_ms\": {";
+
+	for (std::size_t i = 0; i < totals.phases.size(); ++i)
+		json << (i == 0 ? "" : ", ") << "\"" << PhaseToString(static_cast<Phase>(i)) << "\": " << ToMilliseconds(totals.phases.at(i));
+
+	json << "}, "
+		<< "\"elapsed_ms\": " << seconds * 1000.0 << ", "
+		<< "\"files_per_second\": " << (seconds > 0.0 ? static_cast<double>(totals.files) / seconds : 0.0) << ", "
+		<< "\"megabytes_per_second\": " << (seconds > 0.0 ? static_cast<double>(totals.bytes) / (1024.0 * 1024.0) / seconds : 0.0)
+		<< "}\n";
+
+	return json.str();
+}
+
+/**
+ * @brief Writer thread procedure, writes reports as they're submitted and totals once stopped
+*/
+static void WriterThread()
+{
+	ReportTotals totals;
+	std::vector<FileReport> reports;
+	std::unique_lock lock(writer.mutex);
+
+	for (;;)
+	{
+		writer.queued.wait(lock, [] { return writer.stop || !writer.queue.empty(); });
+
+		const bool stop = writer.stop;
+		reports.swap(writer.queue);
+		lock.unlock();
+
+		// Serialization and file I/O happens outside of lock, workers are never blocked by it
+		for (const FileReport& report : reports)
+		{
+			const std::string json = SerializeReport(report, totals.files == 0);
+			std::fwrite(json.data(), sizeof(char), json.size(), writer.file);
+
+			++totals.files;
+			++totals.status.at(static_cast<std::size_t>(report.status));
+			totals.bytes += report.bytes;
+			totals.lines += report.lines;
+			totals.bytes_written += report.bytes_written;
+			totals.bytes_copied += report.bytes_copied;
+
+			for (std::size_t i = 0; i < totals.phases.size(); ++i)
+				totals.phases.at(i) += report.phases.at(i);
+		}
+
+		reports.clear();
+		lock.lock();
+
+		if (stop && writer.queue.empty())
+			break;
+	}
+
+	lock.unlock();
+
+	const std::string json = std::string(totals.files == 0 ? "" : "\n") + "  ],\n" + SerializeTotals(totals, clock_type::now() - writer.start) + "}\n";
+	std::fwrite(json.data(), sizeof(char), json.size(), writer.file);
+}
+
+PhaseTimer::PhaseTimer(FileReport& report, Phase phase) noexcept :
+	mReport(report),
+	mPhase(phase),
+	mStart(clock_type::now()),
+	mSpan(PhaseToString(phase))
+{
+	TraceLoggingWrite(probe_provider, "Phase",
+		TraceLoggingOpcode(WINEVENT_OPCODE_START),
+		TraceLoggingString(PhaseToString(phase), "Phase"));
+}
+
+PhaseTimer::~PhaseTimer()
+{
+	const clock_type::duration elapsed = clock_type::now() - mStart;
+	mReport.phases.at(static_cast<std::size_t>(mPhase)) += elapsed;
+
+	TraceLoggingWrite(probe_provider, "Phase",
+		TraceLoggingOpcode(WINEVENT_OPCODE_STOP),
+		TraceLoggingString(PhaseToString(mPhase), "Phase"),
+		TraceLoggingFloat64(ToMilliseconds(elapsed), "Milliseconds"));
+}
+
+bool OpenReport(const fs::path& filepath, const std::string& shard)
+{
+	assert(writer.file == nullptr);
+
+	_set_errno(0);
+	if (_wfopen_s(&writer.file, filepath.c_str(), L"wb") != 0)
+	{
+		ShowCrtError(Exception(ErrorCode::FunctionFailed, "Failed to open report file " + filepath.string()), ERROR_INFO);
+		writer.file = nullptr;
+		return false;
+	}
+
+	// Reports of all shards can be merged once all of them are done
+	const std::string header = (shard.empty() ? "{\n" : "{\n  \"shard\": \"" + shard + "\",\n") + "  \"files\": [";
+	std::fwrite(header.data(), sizeof(char), header.size(), writer.file);
+
+	writer.stop = false;
+	writer.start = clock_type::now();
+	writer.thread = std::thread(WriterThread);
+
+	// Report must be completed even if main exits early, ex. on exception
+	static std::once_flag registered;
+	std::call_once(registered, []
+	{
+		std::atexit([]
+		{
+			try
+			{
+				CloseReport();
+			}
+			catch (...)
+			{
+				// Nothing can be done on exit
+			}
+		});
+	});
+
+	return true;
+}
+
+void SubmitReport(FileReport report)
+{
+	++copied_files;
+	copied_bytes += report.bytes_copied;
+
+	if (writer.file == nullptr)
+		return;
+
+	{
+		std::lock_guard lock(writer.mutex);
+		writer.queue.push_back(std::move(report));
+	}
+
+	writer.queued.notify_one();
+}
+
+void CloseReport()
+{
+	if (writer.file == nullptr)
+		return;
+
+	{
+		std::lock_guard lock(writer.mutex);
+		writer.stop = true;
+	}
+
+	writer.queued.notify_one();
+	writer.thread.join();
+
+	if (std::fclose(writer.file) != 0)
+	{
+		ShowError(ErrorCode::FunctionFailed, "Failed to close report file");
+	}
+
+	writer.file = nullptr;
+}
+
+CopyTotals GetCopyTotals() noexcept
+{
+	return CopyTotals{ copied_files.load(), copied_bytes.load() };
+}
+
+const char* FileStatusToString(FileStatus status) noexcept
+{
+	switch (status)
+	{
+	case FileStatus::Changed:
+		return "changed";
+	case FileStatus::Unchanged:
+		return "unchanged";
+	case FileStatus::Skipped:
+		return "skipped";
+	case FileStatus::Error:
+	default:
+		return "error";
+	}
+}
+
+const char* PhaseToString(Phase phase) noexcept
+{
+	switch (phase)
+	{
+	case Phase::Load:
+		return "load";
+	case Phase::Decode:
+		return "decode";
+	case Phase::Format:
+		return "format";
+	case Phase::Encode:
+		return "encode";
+	case Phase::Verify:
+		return "verify";
+	case Phase::Write:
+		return "write";
+	case Phase::Count:
+	default:
+		return "unknown";
+	}
+}
@@ -0,0 +1,154 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\Report.hpp
+ *
+ * Machine readable run report function declarations
+ *
+ * Each formatted file produces a FileReport which is handed over to a single report writer thread,
+ * the writer serializes reports to JSON file as they arrive and appends totals once the run is done.
+ *
+*/
+
+#pragma once
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include "SourceFile.hpp"
+#include "Trace.hpp"
+
+
+/**
+ * @brief Outcome of formatting a file
+*/
+enum class FileStatus
+{
+	Changed,	// File was formatted and written back
+	Unchanged,	// File was already formatted, nothing written
+	Skipped,	// File was not formatted, ex. unsupported encoding
+	Error		// An error occurred while processing file
+};
+
+/**
+ * @brief Phases of processing a file which are timed
+*/
+enum class Phase
+{
+	Load,	// Reading file and detecting BOM
+	Decode,	// Conversion from file encoding
+	Format,	// Formatting file contents
+	Encode,	// Conversion to file encoding
+	Verify,	// Verifying that only whitespace was changed
+	Write,	// Writing file back
+	Count	// Count of phases, not a phase
+};
+
+/**
+ * @brief Information about single formatted file
+*/
+struct FileReport
+{
+	// Full path to file
+	std::filesystem::path path;
+	// BOM detected in file
+	BOM bom = BOM::none;
+	// Encoding used to format file
+	Encoding encoding = Encoding::Unknown;
+	// Size of the file before formatting
+	std::size_t bytes = 0;
+	// Count of lines before formatting
+	std::size_t lines = 0;
+	// Size of the file written back, 0 if file was not written
+	std::size_t bytes_written = 0;
+	// Bytes of whole file buffers copied between phases, conversions between encodings are not copies
+	std::size_t bytes_copied = 0;
+	FileStatus status = FileStatus::Skipped;
+	// Time spent in each phase
+	std::array<std::chrono::steady_clock::duration, static_cast<std::size_t>(Phase::Count)> phases{ };
+};
+
+/**
+ * @brief Buffer copies of all files submitted so far, counted whether or not report is open
+*/
+struct CopyTotals
+{
+	// Count of submitted files
+	std::size_t files = 0;
+	// Sum of bytes copied of submitted files
+	std::size_t bytes_copied = 0;
+};
+
+/**
+ * @brief Measures time spent in phase for the lifetime of an object and adds it to file report,
+ * the phase is also recorded as trace span if tracing is enabled
+*/
+class PhaseTimer
+{
+	//
+	// Constructors
+	//
+public:
+	PhaseTimer(FileReport& report, Phase phase) noexcept;
+	~PhaseTimer();
+
+	PhaseTimer(const PhaseTimer&) = delete;
+	PhaseTimer(PhaseTimer&&) = delete;
+
+	//
+	// Operators
+	//
+	PhaseTimer& operator=(const PhaseTimer&) = delete;
+	PhaseTimer& operator=(PhaseTimer&&) = delete;
+
+	//
+	// Members
+	//
+private:
+	FileReport& mReport;
+	const Phase mPhase;
+	const std::chrono::steady_clock::time_point mStart;
+	TraceSpan mSpan;
+};
+
+/**
+ * @brief			Open JSON report file and start report writer
+ * @param filepath	Path to report file which is overwritten if it exists
+ * @param shard		Shard as I/N which is recorded in report, empty if files are not sharded
+ * @return			true if report file was opened
+*/
+[[nodiscard]] bool OpenReport(const std::filesystem::path& filepath, const std::string& shard = "");
+
+/**
+ * @brief			Hand over file report to report writer, does nothing if report isn't open
+ * @param report	File report to write
+*/
+void SubmitReport(FileReport report);
+
+/**
+ * @brief	Get buffer copies of all files submitted so far, used by --stats
+ * @return	Count of files and bytes copied
+*/
+[[nodiscard]] CopyTotals GetCopyTotals() noexcept;
+
+/** Wait for report writer to write all submitted reports, append totals and close report file */
+void CloseReport();
+
+/**
+ * @brief			Convert file status to string used in report
+ * @param status	File status
+ * @return			Lower case status name
+*/
+[[nodiscard]] const char* FileStatusToString(FileStatus status) noexcept;
+
+/**
+ * @brief			Convert phase to string used in report
+ * @param phase		Phase enum
+ * @return			Lower case phase name
+*/
+[[nodiscard]] const char* PhaseToString(Phase phase) noexcept;
@@ -0,0 +1,404 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\Server.cpp
+ *
+ * Function definitions of format server and client which forwards formatting to it
+ *
+ * Request is UTF-8 text, one item per line: protocol, working directory of client,
+ * options as numbers in order of FormatOptions followed by global align and batch flags, and then one path per line.
+ * Response has one entry per file in the same order: error code and size of message on one line, followed by message.
+ *
+*/
+
+#include "pch.hpp"
+#include "Server.hpp"
+#include "Kernels.hpp"
+#include "console.hpp"
+#include "Logger.hpp"
+#include "StringCast.hpp"
+#include "error.hpp"
+using namespace wsl;
+namespace fs = std::filesystem;
+
+
+// Protocol tag which is the first line of request, server closes connection of client which speaks another protocol
+constexpr std::string_view SERVER_PROTOCOL = "asmformat 1";
+
+// Size of pipe buffers, larger messages are transferred in several reads
+constexpr DWORD PIPE_BUFFER_SIZE = 64 * 1024;
+
+/**
+ * @brief			Read whole message from pipe in message read mode
+ * @param hPipe		Pipe handle
+ * @param message	Receives message, bytes already read are kept in front
+ * @return			false if pipe was broken or read failed
+*/
+[[nodiscard]] static bool ReadMessage(HANDLE hPipe, std::string& message)
+{
+	std::array<char, 4 * 1024> buffer{ };
+
+	for (;;)
+	{
+		DWORD bytes_read = 0;
+		const BOOL result = ReadFile(hPipe, buffer.data(), static_cast<DWORD>(buffer.size()), &bytes_read, nullptr);
+
+		message.append(buffer.data(), bytes_read);
+
+		if (result != FALSE)
+			return true;
+
+		// MSDN: If a named pipe is being read in message mode and the next message is longer than
+		// the nNumberOfBytesToRead parameter specifies, ReadFile returns FALSE and GetLastError returns ERROR_MORE_DATA
+		if (GetLastError() != ERROR_MORE_DATA)
+			return false;
+	}
+}
+
+/**
+ * @brief			Write message to pipe
+ * @param hPipe		Pipe handle
+ * @param message	Message which to write
+ * @return			false if pipe was broken or write failed
+*/
+[[nodiscard]] static bool WriteMessage(HANDLE hPipe, std::string_view message)
+{
+	DWORD bytes_written = 0;
+	return (WriteFile(hPipe, message.data(), static_cast<DWORD>(message.size()), &bytes_written, nullptr) != FALSE) &&
+		(bytes_written == message.size());
+}
+
+/**
+ * @brief			Get the next line of request or response
+ * @param text		Text which to read, receives rest of the text after the line
+ * @param line		Receives line without line break
+ * @return			false if there are no more lines
+*/
+[[nodiscard]] static bool NextLine(std::string_view& text, std::string_view& line) noexcept
+{
+	if (text.empty())
+		return false;
+
+	const std::size_t end = text.find('\n');
+	line = text.substr(0, end);
+	text = end == std::string_view::npos ? std::string_view() : text.substr(end + 1);
+	return true;
+}
+
+/**
+ * @brief			Parse next number separated by space
+ * @param text		Text which to read, receives rest of the text after the number
+ * @param value		Receives number
+ * @return			false if text doesn't begin with a number
+*/
+[[nodiscard]] static bool NextNumber(std::string_view& text, std::size_t& value) noexcept
+{
+	const auto [ptr, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+
+	if ((error != std::errc()) || ((ptr != text.data() + text.size()) && (*ptr != ' ')))
+		return false;
+
+	text.remove_prefix(std::min<std::size_t>(ptr - text.data() + 1, text.size()));
+	return true;
+}
+
+/**
+ * @brief			Format files requested by client and build response
+ * @param request	Request received from client
+ * @param response	Receives response to send back
+ * @return			false if request is not valid in which case response is empty
+*/
+[[nodiscard]] static bool ServeRequest(std::string_view request, std::string& response)
+{
+	std::string_view line;
+
+	if (!NextLine(request, line) || (line != SERVER_PROTOCOL))
+		return false;
+
+	FormatResult<std::wstring> directory;
+
+	if (!NextLine(request, line) || !(directory = WidenUTF8(line)))
+		return false;
+
+	std::size_t tab_width = 0, spaces = 0, compact = 0, encoding = 0, line_break = 0, normalize = 0, verify = 0, global_align = 0, batch = 0;
+
+	if (!NextLine(request, line) ||
+		!NextNumber(line, tab_width) || !NextNumber(line, spaces) || !NextNumber(line, compact) || !NextNumber(line, encoding) ||
+		!NextNumber(line, line_break) || !NextNumber(line, normalize) || !NextNumber(line, verify) ||
+		!NextNumber(line, global_align) || !NextNumber(line, batch) ||
+		(encoding > static_cast<std::size_t>(Encoding::UTF16LE)) || (line_break > static_cast<std::size_t>(LineBreak::Preserve)))
+	{
+		return false;
+	}
+
+	FormatOptions options;
+	options.tab_width = tab_width;
+	options.spaces = spaces != 0;
+	options.compact = compact != 0;
+	options.encoding = static_cast<Encoding>(encoding);
+	options.line_break = static_cast<LineBreak>(line_break);
+	options.normalize = normalize != 0;
+	options.verify = verify != 0;
+	// Console code page is set once by RunServer for all threads
+	options.console_code_page = false;
+
+	// Paths are relative to working directory of client, working directory of server is shared by all threads
+	std::vector<fs::path> files;
+	while (NextLine(request, line))
+	{
+		const FormatResult<std::wstring> file = WidenUTF8(line);
+
+		if (!file)
+			return false;
+
+		files.push_back(fs::path(*directory) / *file);
+	}
+
+	// Contents of files loaded by the pre-pass, each is released once the file is formatted
+	std::vector<std::optional<std::string>> contents;
+
+	if (global_align != 0)
+		options.code_width = GetGlobalCodeWidth(files, options, contents);
+
+	bool stop = false;
+
+	for (std::size_t index = 0; index < files.size(); ++index)
+	{
+		ErrorCode code = ErrorCode::FunctionFailed;
+		std::string message = "Formatting was stopped by previous error";
+
+		if (!stop)
+		{
+			// Errors are sent to client which shows them as if the file was formatted in process
+			ErrorCapture capture;
+
+			try
+			{
+				code = FormatSourceFile(files.at(index), options, contents.empty() ? std::nullopt : std::move(contents.at(index)));
+			}
+			catch (Exception& custom)
+			{
+				ShowError(custom, ERROR_INFO);
+			}
+			catch (const std::exception& ex)
+			{
+				ShowError(ex, ERROR_INFO);
+			}
+
+			if (capture.Failed())
+			{
+				code = capture.Error();
+				message = capture.Message();
+			}
+			else message.clear();
+
+			// Without batch mode client stops on the first file which fails
+			stop = (code == ErrorCode::FunctionFailed) && (batch == 0);
+		}
+
+		response += std::to_string(static_cast<std::size_t>(code)) + " " + std::to_string(message.size()) + "\n" + message;
+	}
+
+	return true;
+}
+
+/**
+ * @brief			Create instance of the pipe
+ * @param pipe		Full name of pipe
+ * @param first		Fail if the pipe already exists, ex. created by another user to receive requests of this one
+ * @return			Handle to instance of the pipe, INVALID_HANDLE_VALUE on failure
+*/
+[[nodiscard]] static HANDLE CreatePipeInstance(const std::wstring& pipe, bool first)
+{
+	return CreateNamedPipeW(
+		pipe.c_str(),
+		// Client writes request and reads response
+		PIPE_ACCESS_DUPLEX | (first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+		// Request and response are a single message each, clients from other computers are not served
+		PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+		PIPE_UNLIMITED_INSTANCES,
+		PIPE_BUFFER_SIZE,
+		PIPE_BUFFER_SIZE,
+		// Default time-out of WaitNamedPipe
+		0,
+		// Default security, only the same user and administrators can connect or create more instances
+		nullptr);
+}
+
+/**
+ * @brief			Serve clients one at a time on an instance of the pipe
+ * @param pipe		Full name of pipe
+ * @param hPipe		Instance of the pipe which was already created, INVALID_HANDLE_VALUE to create one
+ * @param status	Receives error code if thread stops
+*/
+static void ServeClients(const std::wstring& pipe, HANDLE hPipe, ErrorCode& status)
+{
+	if (hPipe == INVALID_HANDLE_VALUE)
+		hPipe = CreatePipeInstance(pipe, false);
+
+	if (hPipe == INVALID_HANDLE_VALUE)
+	{
+		ShowError(ERROR_INFO_HR, ("Failed to create pipe " + StringCast(pipe)).c_str());
+		status = ErrorCode::FunctionFailed;
+		return;
+	}
+
+	// Instance is reused for every client so that the pipe never ceases to exist and can't be taken over
+	for (;;)
+	{
+		// MSDN: If a client connects before the function is called, the function returns zero and GetLastError returns ERROR_PIPE_CONNECTED
+		if ((ConnectNamedPipe(hPipe, nullptr) != FALSE) || (GetLastError() == ERROR_PIPE_CONNECTED))
+		{
+			std::string request;
+			std::string response;
+
+			// Client which disconnects or sends invalid request isn't answered, it formats files on it's own
+			if (ReadMessage(hPipe, request) && ServeRequest(request, response))
+			{
+				if (WriteMessage(hPipe, response))
+					FlushFileBuffers(hPipe);
+			}
+
+			LogFlush();
+		}
+
+		DisconnectNamedPipe(hPipe);
+	}
+}
+
+std::wstring GetServerPipe(const std::wstring& fallback)
+{
+	std::array<wchar_t, MAX_PATH> name{ };
+	const DWORD length = GetEnvironmentVariableW(L"ASMFORMAT_SERVER", name.data(), static_cast<DWORD>(name.size()));
+
+	// Value which doesn't fit is not a valid pipe name
+	if ((length == 0) || (length >= name.size()))
+		return fallback.empty() ? std::wstring() : L"\\\\.\\pipe\\" + fallback;
+
+	return L"\\\\.\\pipe\\" + std::wstring(name.data(), length);
+}
+
+ErrorCode RunServer(const std::wstring& pipe)
+{
+	const std::size_t count = std::max(std::thread::hardware_concurrency(), 1u);
+
+	// Threads serve files of all encodings concurrently, code page isn't switched per file
+	if (!SetConsoleCodePage(DefaultConsoleCodePage().first, CP_UTF8))
+		return ErrorCode::FunctionFailed;
+
+	// Pipe which exists is not served, its owner would receive requests and paths of files
+	HANDLE hPipe = CreatePipeInstance(pipe, true);
+
+	if (hPipe == INVALID_HANDLE_VALUE)
+	{
+		ShowError(ERROR_INFO_HR, ("Failed to create pipe " + StringCast(pipe) + ", pipe may be in use by another server").c_str());
+		return ErrorCode::FunctionFailed;
+	}
+
+	Log() << "listening on " << StringCast(pipe) << " with " << count << " threads, press CTRL + C to stop";
+	LogFlush();
+
+	// Each thread has its own pipe instance, threads and caches stay warm between clients
+	std::vector<ErrorCode> status(count, ErrorCode::Success);
+	std::vector<std::thread> threads;
+	threads.reserve(count);
+
+	for (std::size_t thread = 0; thread < count; ++thread)
+		threads.emplace_back(ServeClients, std::cref(pipe), thread == 0 ? hPipe : INVALID_HANDLE_VALUE, std::ref(status[thread]));
+
+	for (std::thread& thread : threads)
+		thread.join();
+
+	if (!RestoreConsoleCodePage())
+		return ErrorCode::FunctionFailed;
+
+	const auto failed = std::find_if(status.begin(), status.end(), [](ErrorCode code) { return code != ErrorCode::Success; });
+	return failed == status.end() ? ErrorCode::Success : *failed;
+}
+
+bool FormatOnServer(const std::wstring& pipe, const std::vector<fs::path>& files,
+	const FormatOptions& options, bool global_align, std::vector<ServerResult>& results)
+{
+	// Path which isn't valid UTF-16 can't be sent, files are then formatted in process
+	const FormatResult<std::string> directory = NarrowUTF8(fs::current_path().wstring());
+
+	if (!directory)
+		return false;
+
+	std::string request(SERVER_PROTOCOL);
+	request += "\n" + *directory + "\n";
+	request += std::to_string(options.tab_width) + " " + std::to_string(options.spaces) + " " + std::to_string(options.compact) + " " +
+		std::to_string(static_cast<int>(options.encoding)) + " " + std::to_string(static_cast<int>(options.line_break)) + " " +
+		std::to_string(options.normalize) + " " + std::to_string(options.verify) + " " + std::to_string(global_align) + " " +
+		std::to_string(GetErrorPolicy() == ErrorPolicy::Batch) + "\n";
+
+	for (const fs::path& file : files)
+	{
+		const FormatResult<std::string> path = NarrowUTF8(file.wstring());
+
+		if (!path)
+			return false;
+
+		request += *path + "\n";
+	}
+
+	HANDLE hPipe = INVALID_HANDLE_VALUE;
+
+	// All instances are busy if server threads are serving other clients
+	for (int attempt = 0; attempt < 3; ++attempt)
+	{
+		hPipe = CreateFileW(pipe.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+
+		if ((hPipe != INVALID_HANDLE_VALUE) || (GetLastError() != ERROR_PIPE_BUSY) ||
+			(WaitNamedPipeW(pipe.c_str(), SERVER_WAIT_MS) == FALSE))
+		{
+			break;
+		}
+	}
+
+	if (hPipe == INVALID_HANDLE_VALUE)
+		return false;
+
+	DWORD mode = PIPE_READMODE_MESSAGE;
+	if (SetNamedPipeHandleState(hPipe, &mode, nullptr, nullptr) == FALSE)
+	{
+		CloseHandle(hPipe);
+		return false;
+	}
+
+	std::string response;
+	const bool transferred = WriteMessage(hPipe, request) && ReadMessage(hPipe, response);
+	CloseHandle(hPipe);
+
+	// Server which closed the connection rejected the request, files were not formatted
+	if (!transferred || response.empty())
+		return false;
+
+	results.clear();
+	results.reserve(files.size());
+
+	std::string_view rest = response;
+	std::string_view line;
+
+	while ((results.size() < files.size()) && NextLine(rest, line))
+	{
+		std::size_t code = 0, size = 0;
+
+		if (!NextNumber(line, code) || !NextNumber(line, size) || (size > rest.size()))
+			break;
+
+		results.push_back({ static_cast<ErrorCode>(code), std::string(rest.substr(0, size)) });
+		rest.remove_prefix(size);
+	}
+
+	// Response which is cut short is reported as a failure of remaining files, server may have written them already
+	while (results.size() < files.size())
+		results.push_back({ ErrorCode::FunctionFailed, "Format server didn't return result of the file" });
+
+	return true;
+}
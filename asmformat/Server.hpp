@@ -0,0 +1,74 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\Server.hpp
+ *
+ * Function declarations of format server and client which forwards formatting to it
+ *
+ * Server listens on a local named pipe and formats files on behalf of clients, each server thread
+ * serves one client at a time so that startup cost and cold caches are paid once per server.
+ * Client is the regular command line with ASMFORMAT_SERVER environment variable set to the pipe name,
+ * request is a single message with working directory, options and paths which is answered by a single message
+ * with result of each file. If no server is listening client formats files in process.
+ *
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+#include <filesystem>
+#include "Formatter.hpp"
+#include "ErrorCode.hpp"
+
+
+/**
+ * @brief Time in milliseconds client waits for a server thread to become available before it formats files in process
+*/
+constexpr unsigned long SERVER_WAIT_MS = 2000;
+
+/**
+ * @brief Result of formatting a file on server
+*/
+struct ServerResult
+{
+	// Error code of the first error, ErrorCode::Success if file was formatted
+	wsl::ErrorCode code = wsl::ErrorCode::Success;
+	// Message of the first error
+	std::string message;
+};
+
+/**
+ * @brief			Get name of server pipe specified by ASMFORMAT_SERVER environment variable
+ * @param fallback	Name used if variable is not set, ex. by server
+ * @return			Full pipe name as \\.\pipe\NAME, empty if variable is not set and there is no fallback
+*/
+[[nodiscard]] std::wstring GetServerPipe(const std::wstring& fallback = L"");
+
+/**
+ * Run format server until process is stopped with CTRL + C.
+ * One server thread per processor serves clients, formatting errors are sent to client rather than shown.
+ * Server fails to start if the pipe already exists, so that another user can't receive requests in its place.
+ *
+ * @param pipe		Full name of pipe on which to listen
+ * @return			Error code which caused server to stop
+*/
+[[nodiscard]] wsl::ErrorCode RunServer(const std::wstring& pipe);
+
+/**
+ * Forward files to format to server, files are formatted same as by FormatSourceFile.
+ * Relative paths are resolved against current working directory of client.
+ *
+ * @param pipe			Full name of server pipe
+ * @param files			Files to format
+ * @param options		Formatting options
+ * @param global_align	Align inline comments of all files to the same column
+ * @param results		Receives result of each file in the same order as files
+ * @return				false if no server is listening or it didn't respond in which case files were not formatted
+*/
+[[nodiscard]] bool FormatOnServer(const std::wstring& pipe, const std::vector<std::filesystem::path>& files,
+	const FormatOptions& options, bool global_align, std::vector<ServerResult>& results);
@@ -0,0 +1,133 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\Shard.cpp
+ *
+ * Function definitions used to split files between multiple runs
+ *
+*/
+
+#include "pch.hpp"
+#include "Shard.hpp"
+namespace fs = std::filesystem;
+
+
+/**
+ * @brief File which is assigned to a shard
+*/
+struct ShardFile
+{
+	// Index of file in the input vector
+	std::size_t position = 0;
+	// Size of file in bytes, 0 if size can't be determined
+	std::uintmax_t bytes = 0;
+	// Path relative to current working directory, with forward slashes
+	std::string key;
+};
+
+/**
+ * @brief			Parse unsigned decimal number which must span whole string
+ * @param text		Text to parse
+ * @param value		Receives parsed number
+ * @return			true if text is a number
+*/
+[[nodiscard]] static bool ParseNumber(std::string_view text, std::size_t& value) noexcept
+{
+	const std::from_chars_result result = std::from_chars(text.data(), text.data() + text.size(), value);
+	return !text.empty() && (result.ec == std::errc()) && (result.ptr == text.data() + text.size());
+}
+
+bool ParseShard(const std::string& arg, Shard& shard)
+{
+	const std::size_t separator = arg.find('/');
+
+	if (separator == std::string::npos)
+		return false;
+
+	Shard result;
+	const std::string_view text = arg;
+
+	if (!ParseNumber(text.substr(0, separator), result.index) || !ParseNumber(text.substr(separator + 1), result.count))
+		return false;
+
+	if ((result.count == 0) || (result.index == 0) || (result.index > result.count))
+		return false;
+
+	shard = result;
+	return true;
+}
+
+std::string ShardToString(const Shard& shard)
+{
+	return std::to_string(shard.index) + "/" + std::to_string(shard.count);
+}
+
+std::uintmax_t SelectShard(const Shard& shard, std::vector<fs::path>& files)
+{
+	assert((shard.index > 0) && (shard.index <= shard.count));
+
+	std::error_code error;
+	const fs::path current = fs::current_path(error);
+	std::vector<ShardFile> entries;
+	entries.reserve(files.size());
+
+	for (std::size_t i = 0; i < files.size(); ++i)
+	{
+		ShardFile entry;
+		entry.position = i;
+		entry.bytes = fs::file_size(files.at(i), error);
+
+		// File which can't be read is assigned like an empty file, formatting reports the error
+		if (error)
+			entry.bytes = 0;
+
+		// Absolute paths differ between machines, relative paths don't
+		entry.key = fs::absolute(files.at(i), error).lexically_proximate(current).generic_string();
+		entries.push_back(std::move(entry));
+	}
+
+	// Largest first, ties are broken by path so that the order doesn't depend on discovery order
+	std::sort(entries.begin(), entries.end(), [](const ShardFile& lhs, const ShardFile& rhs)
+	{
+		return lhs.bytes != rhs.bytes ? lhs.bytes > rhs.bytes : lhs.key < rhs.key;
+	});
+
+	// Same file specified more than once, ex. by both --directory and --changed-since
+	entries.erase(std::unique(entries.begin(), entries.end(), [](const ShardFile& lhs, const ShardFile& rhs)
+	{
+		return lhs.key == rhs.key;
+	}), entries.end());
+
+	std::vector<std::uintmax_t> loads(shard.count, 0);
+	std::vector<bool> selected(files.size(), false);
+	std::uintmax_t total = 0;
+
+	for (const ShardFile& entry : entries)
+	{
+		// The first shard with the least bytes wins ties, this keeps the assignment deterministic
+		const std::size_t target = static_cast<std::size_t>(std::distance(loads.begin(), std::min_element(loads.begin(), loads.end())));
+		loads.at(target) += entry.bytes;
+
+		if (target == shard.index - 1)
+		{
+			selected.at(entry.position) = true;
+			total += entry.bytes;
+		}
+	}
+
+	std::vector<fs::path> result;
+
+	for (std::size_t i = 0; i < files.size(); ++i)
+	{
+		if (selected.at(i))
+			result.push_back(std::move(files.at(i)));
+	}
+
+	files = std::move(result);
+	return total;
+}
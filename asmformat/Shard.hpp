@@ -0,0 +1,61 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\Shard.hpp
+ *
+ * Function declarations used to split files between multiple runs
+ *
+ * Files are partitioned by size with greedy bin packing, the largest file goes first to the shard
+ * with the least bytes so far. Files are ordered by size and then by path relative to current
+ * working directory, thus every run which discovers same files computes same partition.
+ *
+*/
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+
+/**
+ * @brief Shard of files which to format
+*/
+struct Shard
+{
+	// 1 based index of shard
+	std::size_t index = 0;
+	// Count of shards, 0 if files are not sharded
+	std::size_t count = 0;
+};
+
+/**
+ * @brief			Parse shard specified as I/N
+ * @param arg		Argument of --shard option
+ * @param shard		Receives parsed shard
+ * @return			true if N is greater than zero and I is in range from 1 to N
+*/
+[[nodiscard]] bool ParseShard(const std::string& arg, Shard& shard);
+
+/**
+ * @brief			Convert shard to string
+ * @param shard		Shard to convert
+ * @return			Shard as I/N
+*/
+[[nodiscard]] std::string ShardToString(const Shard& shard);
+
+/**
+ * Keep only files which belong to the specified shard.
+ * Duplicate files are removed so that each file belongs to exactly one shard,
+ * remaining files retain their order.
+ *
+ * @param shard		Shard which to keep
+ * @param files		Files of all shards, receives files of the specified shard
+ * @return			Total size in bytes of files which were kept
+*/
+std::uintmax_t SelectShard(const Shard& shard, std::vector<std::filesystem::path>& files);
@@ -18,11 +18,14 @@
 using namespace wsl;
 
 
-BOM GetBOM(const std::filesystem::path& filepath, std::vector<unsigned char>& bom)
+FormatResult<BOM> GetBOM(const std::filesystem::path& filepath, std::vector<unsigned char>& bom)
 {
-	std::string buffer = LoadFileBytes(filepath, 4);
-	buffer.shrink_to_fit();
-	return GetBOM(buffer, bom);
+	const FormatResult<std::string> buffer = LoadFileBytes(filepath, 4);
+
+	if (!buffer)
+		return unexpected(buffer.error());
+
+	return GetBOM(*buffer, bom);
 }
 
 std::vector<unsigned char> GetBOM(BOM bom)
@@ -159,26 +162,28 @@ Encoding BomToEncoding(BOM bom) noexcept
 	}
 }
 
-std::size_t GetFileByteCount(const std::filesystem::path& filepath)
+FormatResult<std::size_t> GetFileByteCount(const std::filesystem::path& filepath)
 {
 	struct _stat fileinfo{ 0 };
 	// MSDN: Returns 0 if the file-status information is obtained
 	int status = _stat(filepath.string().c_str(), &fileinfo);
 
 	if (status != 0)
-	{
-		ShowError(ErrorCode::FunctionFailed, "Failed to get file size of " + filepath.string());
-	}
+		return unexpected(FormatError{ ErrorCode::FunctionFailed, "get size of" });
 
 	// MSDN: Size of the file in bytes
 	// a 64-bit integer for variations with the i64 suffix
 	return static_cast<std::size_t>(fileinfo.st_size);
 }
 
-std::string LoadFileBytes(const std::filesystem::path& filepath, std::size_t bytes)
+FormatResult<std::string> LoadFileBytes(const std::filesystem::path& filepath, std::size_t bytes)
 {
-	const std::size_t filesize = GetFileByteCount(filepath);
-	const std::size_t file_bytes = bytes == 0 ? filesize : std::min(bytes, filesize);
+	const FormatResult<std::size_t> filesize = GetFileByteCount(filepath);
+
+	if (!filesize)
+		return unexpected(filesize.error());
+
+	const std::size_t file_bytes = bytes == 0 ? *filesize : std::min(bytes, *filesize);
 
 	if (file_bytes == 0)
 		return std::string();
@@ -200,10 +205,7 @@ std::string LoadFileBytes(const std::filesystem::path& filepath, std::size_t byt
 
 	// MSDN: If the function fails, the return value is INVALID_HANDLE_VALUE
 	if (hFile == INVALID_HANDLE_VALUE)
-	{
-		ShowError(ERROR_INFO_HR, ("Failed to open file " + filepath.string()).c_str());
-		return std::string();
-	}
+		return unexpected(FormatError{ ErrorCode::FunctionFailed, "open", 0, GetLastError() });
 
 	std::string buffer;
 	buffer.resize(file_bytes);
@@ -229,20 +231,20 @@ std::string LoadFileBytes(const std::filesystem::path& filepath, std::size_t byt
 			nullptr
 		);
 
+		TraceLoggingWrite(probe_provider, "ReadFile",
+			TraceLoggingWideString(filepath.c_str(), "Path"),
+			TraceLoggingUInt32(bytes_to_read, "Requested"),
+			TraceLoggingUInt32(bytes_read, "Transferred"),
+			TraceLoggingBool(status, "Succeeded"));
+
 		// MSDN: If the function fails, or is completing asynchronously, the return value is zero (FALSE)
 		// To get extended error information, call the GetLastError function
 		if (status == FALSE)
 		{
+			// The first error is reported, failure to close is secondary
 			const DWORD error = GetLastError();
-
-			if (CloseHandle(hFile) == FALSE)
-			{
-				ShowError(ERROR_INFO_HR, ("Failed to close file " + filepath.string()).c_str());
-			}
-
-			SetLastError(error);
-			ShowError(ERROR_INFO_HR, ("Failed to read file " + filepath.string()).c_str());
-			return std::string();
+			CloseHandle(hFile);
+			return unexpected(FormatError{ ErrorCode::FunctionFailed, "read", total_bytes_read, error });
 		}
 
 		// If no bytes are read then infinite loop
@@ -254,10 +256,8 @@ std::string LoadFileBytes(const std::filesystem::path& filepath, std::size_t byt
 		total_bytes_read += bytes_read;
 	}
 
-	if (CloseHandle(hFile) == FALSE)
-	{
-		ShowError(ERROR_INFO_HR, ("Failed to close file" + filepath.string()).c_str());
-	}
+	// All data was read, failure to close read only handle loses nothing
+	CloseHandle(hFile);
 
 	assert(total_bytes_read == file_bytes);
 	return buffer;
@@ -19,6 +19,8 @@
 #include <type_traits>
 #include "error.hpp"
 #include "ErrorCode.hpp"
+#include "Probes.hpp"
+#include "FormatError.hpp"
 
 
 /**
@@ -58,9 +60,9 @@ enum class BOM
  * @brief			Get Byte Order Mark from file if there is one
  * @param filepath	Full path to file
  * @param bom		receives BOM enumeration
- * @return			BOM enumeration which also handles no BOM case
+ * @return			BOM enumeration which also handles no BOM case, or error if file couldn't be read
 */
-[[nodiscard]] BOM GetBOM(const std::filesystem::path& filepath, std::vector<unsigned char>& bom);
+[[nodiscard]] FormatResult<BOM> GetBOM(const std::filesystem::path& filepath, std::vector<unsigned char>& bom);
 
 /**
  * @brief			Get Byte Order Mark from string buffer if there is one
@@ -99,190 +101,17 @@ enum class BOM
 /**
  * @brief			Get size of a file in bytes
  * @param filepath	file path for which to get byte count
- * @return			Size of the file in bytes
-*/
-[[nodiscard]] std::size_t GetFileByteCount(const std::filesystem::path& filepath);
-
-/**
- * Read source file into memory encoded as UTF-8, UTF-16 or UTF-16LE
- * If the source file contains BOM then encoding parameter is ignored
- *
- * @tparam StringType	std::string or std::wstring depending on file encoding
- * @param filepath		Full path and file name of a source file
- * @param encoding		Specify predefined file encoding
- * @return				Source file contents as wide or ANSI string
+ * @return			Size of the file in bytes, or error if file status couldn't be obtained
 */
-template<typename StringType>
-requires std::is_same_v<std::string, StringType> || std::is_same_v<std::wstring, StringType>
-[[nodiscard]] StringType LoadFile(const std::filesystem::path& filepath, const Encoding& encoding)
-{
-	// TODO: This function does not read \r in ANSI mode, question is what else does it not read?
-	FILE* file = nullptr;
-	StringType buffer{ };
-
-	using namespace wsl;
-	constexpr bool iswide = std::is_same_v<std::wstring, StringType>;
-
-	// MSDN: Opens for reading.
-	// If the file doesn't exist or can't be found, the fopen_s call fails.
-	std::string mode = "r";
-
-	switch (encoding)
-	{
-	case Encoding::UTF8:
-		if (!iswide)
-			goto bad_argument;
-		mode += ", ccs=UTF-8";
-		break;
-	case Encoding::UTF16LE:
-		if (!iswide)
-			goto bad_argument;
-		mode += ", ccs=UTF-16LE";
-		break;
-	case Encoding::ANSI:
-		if (iswide)
-			goto bad_argument;
-		break;
-	case Encoding::Unknown:
-	case Encoding::Unsupported:
-	default:
-		ShowError(ErrorCode::UnsuportedOperation, "Encoding not supported by LoadFile");
-		return StringType();
-	}
-
-	_set_errno(0);
-	// MSDN: The fopen_s doesn't open a file for sharing
-	// the byte order mark (BOM), if present in the file, determines the encoding.
-	// The BOM encoding takes precedence over the encoding that's specified by the ccs flag.
-	// The ccs encoding is only used when no BOM is present or if the file is a new file
-	// Files that are opened for writing in Unicode mode have a BOM written to them automatically
-	// Zero if successful, If an error occurs, the error code is returned, and the global variable errno is set
-	if (fopen_s(&file, filepath.string().c_str(), mode.c_str()) == 0)
-	{
-		SUPPRESS(26496)	// mark it as const
-		std::size_t filesize = GetFileByteCount(filepath);
-
-		if (filesize > 0)
-		{
-			if constexpr (iswide)
-				filesize /= 2;
-
-			buffer.resize(filesize);
-
-			// MSDN: The fread function reads up to count items of size bytes from the input stream
-			// fread returns the number of full items the function read, which may be less than count if an error occurs,
-			// or if it encounters the end of the file before reaching count
-			const std::size_t wchars_read = fread(&(buffer.front()), sizeof(typename StringType::value_type), filesize, file);
-
-			// MSDN: If no error has occurred on stream, ferror returns 0
-			if (ferror(file) != 0)
-			{
-				ShowError(ErrorCode::BadResult, "Failed to read file " + filepath.string());
-				return StringType();
-			}
-
-			buffer.resize(wchars_read);
-			buffer.shrink_to_fit();
-		}
-
-		// MSDN: fclose returns 0 if the stream is successfully closed.
-		if (fclose(file) != 0)
-		{
-			ShowError(ErrorCode::FunctionFailed, "Failed to close file " + filepath.string());
-		}
-	}
-	else
-	{
-		ShowCrtError(Exception(ErrorCode::FunctionFailed, "Failed to open file " + filepath.string()), ERROR_INFO);
-	}
-
-	return buffer;
-
-bad_argument:
-	ShowError(ErrorCode::InvalidArgument, (std::string("Invalid combination of arguments: ") + typeid(typename StringType::value_type).name() + " and " + EncodingToString(encoding)).c_str());
-	return StringType();
-}
+[[nodiscard]] FormatResult<std::size_t> GetFileByteCount(const std::filesystem::path& filepath);
 
 /**
  * @brief			Read source file into memory as byte stream
  * @param filepath	Full path and file name of a source file
  * @param bytes		Specify maximum bytes to read, if 0 all bytes are read
- * @return			Source file contents as ANSI string
-*/
-[[nodiscard]] std::string LoadFileBytes(const std::filesystem::path& filepath, std::size_t bytes = 0);
-
-/**
- * Write formatted source file contents back to file encoded as ANSI, UTF-8, UTF-16 or UTF-16LE.
- * This function puts BOM into file if it doesn't exist for the specified UTF encoding.
- * This function converts LF to CRLF
- *
- * @tparam StringType	std::string or std::wstring
- * @param filepath		Full path and file name of a source file
- * @param filedata		Wide or ANSI string contents which to write to file
- * @param encoding		Specify predefined file encoding to use
+ * @return			Source file contents as ANSI string, or error with count of bytes read before failure
 */
-template<typename StringType>
-requires std::is_same_v<std::string, StringType> || std::is_same_v<std::wstring, StringType>
-void WriteFile(const std::filesystem::path& filepath, const StringType& filedata, const Encoding encoding)
-{
-	FILE* file = nullptr;
-	using namespace wsl;
-	constexpr bool iswide = std::is_same_v<std::wstring, StringType>;
-
-	// MSDN: Opens an empty file for writing.
-	// If the given file exists, its contents are destroyed.
-	std::string mode = "w";
-
-	switch (encoding)
-	{
-	case Encoding::UTF8:
-		if (!iswide)
-			goto bad_argument;
-		mode += ", ccs=UTF-8";
-		break;
-	case Encoding::UTF16LE:
-		if (!iswide)
-			goto bad_argument;
-		mode += ", ccs=UTF-16LE";
-		break;
-	case Encoding::ANSI:
-		if (iswide)
-			goto bad_argument;
-		break;
-	case Encoding::Unknown:
-	case Encoding::Unsupported:
-	default:
-		ShowError(ErrorCode::UnsuportedOperation, "Encoding not supported by WriteFile");
-		return;
-	}
-
-	_set_errno(0);
-	if (fopen_s(&file, filepath.string().c_str(), mode.c_str()) == 0)
-	{
-		// MSDN: fwrite returns the number of full items the function writes, which may be less than count if an error occurs
-		// if an odd number of bytes to be written is specified in Unicode mode, the function invokes the invalid parameter handler
-		// If execution is allowed to continue, this function sets errno to EINVAL and returns 0
-		if (fwrite(filedata.c_str(), sizeof(typename StringType::value_type), filedata.size(), file) == 0)
-		{
-			ShowCrtError(Exception(ErrorCode::FunctionFailed, "Failed to write file " + filepath.string()), ERROR_INFO);
-		}
-
-		if (fclose(file) != 0)
-		{
-			ShowError(ErrorCode::FunctionFailed, "Failed to close file " + filepath.string());
-		}
-	}
-	else
-	{
-		ShowCrtError(Exception(ErrorCode::FunctionFailed, "Failed to open file " + filepath.string()), ERROR_INFO);
-	}
-
-	return;
-
-bad_argument:
-	ShowError(ErrorCode::InvalidArgument, (std::string("Invalid combination of arguments: ") + typeid(typename StringType::value_type).name() + " and " + EncodingToString(encoding)).c_str());
-	return;
-}
+[[nodiscard]] FormatResult<std::string> LoadFileBytes(const std::filesystem::path& filepath, std::size_t bytes = 0);
 
 // 'argument': conversion from 'int'\'long' to 'DWORD', signed/unsigned mismatch
 PUSH DISABLE(4365)
@@ -294,14 +123,17 @@ PUSH DISABLE(4365)
  * @param filepath	Full path and file name of a source file
  * @param filedata	ANSI string contents which to write to file
  * @param append	Set to true to append data to file, by default file contents are replaced
+ * @return			Error with count of bytes written before failure
 */
 template<typename DataType>
 requires std::is_same_v<std::vector<unsigned char>, DataType> || std::is_same_v<std::string, DataType>
-void WriteFileBytes(const std::filesystem::path& filepath, const DataType& filedata, bool append)
+[[nodiscard]] FormatResult<> WriteFileBytes(const std::filesystem::path& filepath, const DataType& filedata, bool append)
 {
+	using namespace wsl;
+
 	std::size_t size = filedata.size();
 	if (size == 0)
-		return;
+		return { };
 
 	HANDLE hFile = CreateFileW(
 		filepath.c_str(),
@@ -324,10 +156,7 @@ void WriteFileBytes(const std::filesystem::path& filepath, const DataType& filed
 	);
 
 	if (hFile == INVALID_HANDLE_VALUE)
-	{
-		ShowError(ERROR_INFO_HR, ("Failed to open file " + filepath.string()).c_str());
-		return;
-	}
+		return unexpected(FormatError{ ErrorCode::FunctionFailed, "open", 0, GetLastError() });
 
 	if (!append)
 	{
@@ -336,8 +165,7 @@ void WriteFileBytes(const std::filesystem::path& filepath, const DataType& filed
 	}
 	else if (GetLastError() == ERROR_FILE_NOT_FOUND)
 	{
-		ShowError(ERROR_INFO_HR, ("Failed to open file " + filepath.string()).c_str());
-		return;
+		return unexpected(FormatError{ ErrorCode::FunctionFailed, "open", 0, ERROR_FILE_NOT_FOUND });
 	}
 	else
 	{
@@ -347,15 +175,10 @@ void WriteFileBytes(const std::filesystem::path& filepath, const DataType& filed
 
 		if (bytes_moved == INVALID_SET_FILE_POINTER)
 		{
+			// The first error is reported, failure to close is secondary
 			const DWORD error = GetLastError();
-			if (CloseHandle(hFile) == FALSE)
-			{
-				ShowError(ERROR_INFO_HR, ("Failed to close file " + filepath.string()).c_str());
-			}
-
-			SetLastError(error);
-			ShowError(ERROR_INFO_HR, ("Failed to move file pointer to the end of file " + filepath.string()).c_str());
-			return;
+			CloseHandle(hFile);
+			return unexpected(FormatError{ ErrorCode::FunctionFailed, "seek end of", 0, error });
 		}
 	}
 
@@ -378,17 +201,17 @@ void WriteFileBytes(const std::filesystem::path& filepath, const DataType& filed
 			nullptr
 		);
 
+		TraceLoggingWrite(probe_provider, "WriteFile",
+			TraceLoggingWideString(filepath.c_str(), "Path"),
+			TraceLoggingUInt32(bytes_to_write, "Requested"),
+			TraceLoggingUInt32(bytes_written, "Transferred"),
+			TraceLoggingBool(status, "Succeeded"));
+
 		if (status == FALSE)
 		{
 			const DWORD error = GetLastError();
-			if (CloseHandle(hFile) == FALSE)
-			{
-				ShowError(ERROR_INFO_HR, ("Failed to close file " + filepath.string()).c_str());
-			}
-
-			SetLastError(error);
-			ShowError(ERROR_INFO_HR, ("Failed to read file " + filepath.string()).c_str());
-			return;
+			CloseHandle(hFile);
+			return unexpected(FormatError{ ErrorCode::FunctionFailed, "write", total_bytes_written, error });
 		}
 
 		// If no bytes are writen then infinite loop
@@ -400,12 +223,12 @@ void WriteFileBytes(const std::filesystem::path& filepath, const DataType& filed
 		total_bytes_written += bytes_written;
 	}
 
+	// Written data may be lost if closing fails
 	if (CloseHandle(hFile) == FALSE)
-	{
-		ShowError(ERROR_INFO_HR, ("Failed to close file " + filepath.string()).c_str());
-	}
+		return unexpected(FormatError{ ErrorCode::FunctionFailed, "close", total_bytes_written, GetLastError() });
 
 	assert(total_bytes_written == filedata.size());
+	return { };
 }
 
 POP
@@ -0,0 +1,307 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\Trace.cpp
+ *
+ * Trace event recording function definitions
+ *
+*/
+
+#include "pch.hpp"
+#include "Trace.hpp"
+#include "StringCast.hpp"
+#include "utils.hpp"
+#include "error.hpp"
+using namespace wsl;
+namespace fs = std::filesystem;
+using clock_type = std::chrono::steady_clock;
+
+
+// File tag of spans recorded outside of TraceFile
+static constexpr std::uint64_t no_file = std::numeric_limits<std::uint64_t>::max();
+
+// Count of events in ring buffer of each thread
+static constexpr std::size_t ring_capacity = 16384;
+
+// Count of file tags in ring buffer of each thread, every file records several spans
+static constexpr std::size_t file_capacity = ring_capacity / 4;
+
+/**
+ * @brief Single complete span
+*/
+struct TraceEvent
+{
+	// String literal passed to TraceSpan
+	const char* name = nullptr;
+	clock_type::time_point start;
+	clock_type::duration duration{ };
+	// Sequence number of file tag of the thread which recorded event
+	std::uint64_t file = no_file;
+};
+
+/**
+ * @brief File which spans are tagged with
+*/
+struct FileTag
+{
+	fs::path path;
+	std::size_t bytes = 0;
+};
+
+/**
+ * @brief Events recorded by a single thread, written by owning thread only
+*/
+struct ThreadBuffer
+{
+	DWORD thread_id = GetCurrentThreadId();
+	std::vector<TraceEvent> events = std::vector<TraceEvent>(ring_capacity);
+	// Count of events ever recorded, next event goes into slot written % ring_capacity
+	std::atomic<std::uint64_t> written = 0;
+	// Files referred to by events, slots are reused so that paths are copied without allocation once warm
+	std::vector<FileTag> files = std::vector<FileTag>(file_capacity);
+	// Count of files ever tagged, next file goes into slot files_written % file_capacity
+	std::atomic<std::uint64_t> files_written = 0;
+	// Sequence number of the file which new events are tagged with
+	std::uint64_t current_file = no_file;
+};
+
+/**
+ * @brief Trace recorder state
+*/
+struct TraceRecorder
+{
+	// Set while recording, checked by spans without lock
+	std::atomic<bool> enabled = false;
+	// Protects buffers
+	std::mutex mutex;
+	// Buffers of all threads which recorded an event, kept alive after thread exits
+	std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+	// Trace file, nullptr if tracing isn't started
+	FILE* file = nullptr;
+	// Time when tracing started, timestamps are relative to it
+	clock_type::time_point start;
+};
+
+// The only trace recorder
+static TraceRecorder recorder;
+
+/**
+ * @brief	Get buffer of calling thread, buffer is created and registered on first use by a thread
+ * @return	Buffer of calling thread
+*/
+static ThreadBuffer& GetThreadBuffer()
+{
+	// Lock is taken once per thread, recording events afterwards takes no lock
+	static thread_local const std::shared_ptr<ThreadBuffer> buffer = []
+	{
+		std::shared_ptr<ThreadBuffer> result = std::make_shared<ThreadBuffer>();
+
+		std::lock_guard lock(recorder.mutex);
+		recorder.buffers.push_back(result);
+		return result;
+	}();
+
+	return *buffer;
+}
+
+/**
+ * @brief			Convert duration to trace time unit
+ * @param duration	Duration to convert
+ * @return			Fractional microseconds
+*/
+[[nodiscard]] static double ToMicroseconds(clock_type::duration duration) noexcept
+{
+	return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+/**
+ * @brief			Serialize events of one thread in the order in which they were recorded
+ * @param buffer	Buffer of a thread
+ * @param json		Stream which receives events, each preceded by comma
+ * @return			Count of events which were overwritten
+*/
+static std::uint64_t SerializeBuffer(const ThreadBuffer& buffer, std::ostream& json)
+{
+	const std::uint64_t written = buffer.written.load(std::memory_order_acquire);
+	const std::uint64_t first = written > ring_capacity ? written - ring_capacity : 0;
+	const std::uint64_t files_written = buffer.files_written.load(std::memory_order_acquire);
+	const DWORD process_id = GetCurrentProcessId();
+
+	for (std::uint64_t i = first; i < written; ++i)
+	{
+		const TraceEvent& event = buffer.events.at(static_cast<std::size_t>(i % ring_capacity));
+
+		json << ",\n    {\"name\": \"" << event.name << "\", \"cat\": \"asmformat\", \"ph\": \"X\", "
+			<< "\"pid\": " << process_id << ", \"tid\": " << buffer.thread_id << ", "
+			<< "\"ts\": " << ToMicroseconds(event.start - recorder.start) << ", "
+			<< "\"dur\": " << ToMicroseconds(event.duration);
+
+		// Tag of a file whose slot was reused by later files is lost, the event is written without it
+		if ((event.file != no_file) && (event.file + file_capacity > files_written))
+		{
+			const FileTag& tag = buffer.files.at(static_cast<std::size_t>(event.file % file_capacity));
+			json << ", \"args\": {\"file\": \"" << JsonEscape(StringCast(tag.path.wstring())) << "\", \"bytes\": " << tag.bytes << "}";
+		}
+
+		json << "}";
+	}
+
+	return first;
+}
+
+bool StartTrace(const fs::path& filepath)
+{
+	assert(recorder.file == nullptr);
+
+	_set_errno(0);
+	if (_wfopen_s(&recorder.file, filepath.c_str(), L"wb") != 0)
+	{
+		ShowCrtError(Exception(ErrorCode::FunctionFailed, "Failed to open trace file " + filepath.string()), ERROR_INFO);
+		recorder.file = nullptr;
+		return false;
+	}
+
+	recorder.start = clock_type::now();
+	recorder.enabled = true;
+
+	// Trace must be written even if main exits early, ex. on exception
+	static std::once_flag registered;
+	std::call_once(registered, []
+	{
+		std::atexit([]
+		{
+			try
+			{
+				StopTrace();
+			}
+			catch (...)
+			{
+				// Nothing can be done on exit
+			}
+		});
+	});
+
+	return true;
+}
+
+void StopTrace()
+{
+	if (recorder.file == nullptr)
+		return;
+
+	recorder.enabled = false;
+	std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+
+	{
+		std::lock_guard lock(recorder.mutex);
+		buffers = recorder.buffers;
+	}
+
+	std::ostringstream json;
+	json << std::fixed << std::setprecision(3);
+
+	// Metadata event comes first so that every event which follows is preceded by comma
+	json << "{\n  \"traceEvents\": [\n    {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << GetCurrentProcessId()
+		<< ", \"args\": {\"name\": \"asmformat\"}}";
+
+	std::uint64_t dropped = 0;
+
+	for (const std::shared_ptr<ThreadBuffer>& buffer : buffers)
+		dropped += SerializeBuffer(*buffer, json);
+
+	json << "\n  ],\n  \"displayTimeUnit\": \"ms\",\n  \"otherData\": {\"dropped_events\": " << dropped << "}\n}\n";
+
+	const std::string trace = json.str();
+	std::fwrite(trace.data(), sizeof(char), trace.size(), recorder.file);
+
+	if (std::fclose(recorder.file) != 0)
+	{
+		ShowError(ErrorCode::FunctionFailed, "Failed to close trace file");
+	}
+
+	recorder.file = nullptr;
+}
+
+TraceSpan::TraceSpan(const char* name) noexcept :
+	mName(recorder.enabled.load(std::memory_order_relaxed) ? name : nullptr),
+	mStart(mName == nullptr ? clock_type::time_point() : clock_type::now())
+{
+}
+
+TraceSpan::~TraceSpan()
+{
+	End();
+}
+
+void TraceSpan::End() noexcept
+{
+	if (mName == nullptr)
+		return;
+
+	const clock_type::time_point end = clock_type::now();
+
+	try
+	{
+		ThreadBuffer& buffer = GetThreadBuffer();
+		const std::uint64_t index = buffer.written.load(std::memory_order_relaxed);
+
+		TraceEvent& event = buffer.events.at(static_cast<std::size_t>(index % ring_capacity));
+		event.name = mName;
+		event.start = mStart;
+		event.duration = end - mStart;
+		event.file = buffer.current_file;
+
+		// Publishes the event to StopTrace
+		buffer.written.store(index + 1, std::memory_order_release);
+	}
+	catch (...)
+	{
+		// Buffer couldn't be allocated, the span is lost
+	}
+
+	mName = nullptr;
+}
+
+TraceFile::TraceFile(const fs::path& filepath) :
+	mIndex(no_file),
+	mPrevious(no_file)
+{
+	if (!recorder.enabled.load(std::memory_order_relaxed))
+		return;
+
+	ThreadBuffer& buffer = GetThreadBuffer();
+	const std::uint64_t index = buffer.files_written.load(std::memory_order_relaxed);
+
+	FileTag& tag = buffer.files.at(static_cast<std::size_t>(index % file_capacity));
+	tag.path = filepath;
+	tag.bytes = 0;
+
+	// Publishes the file tag to StopTrace
+	buffer.files_written.store(index + 1, std::memory_order_release);
+
+	mIndex = index;
+	mPrevious = buffer.current_file;
+	buffer.current_file = mIndex;
+}
+
+TraceFile::~TraceFile()
+{
+	if (mIndex != no_file)
+		GetThreadBuffer().current_file = mPrevious;
+}
+
+void TraceFile::SetSize(std::size_t bytes) noexcept
+{
+	if (mIndex == no_file)
+		return;
+
+	ThreadBuffer& buffer = GetThreadBuffer();
+
+	if (mIndex + file_capacity > buffer.files_written.load(std::memory_order_relaxed))
+		buffer.files[static_cast<std::size_t>(mIndex % file_capacity)].bytes = bytes;
+}
@@ -0,0 +1,118 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\Trace.hpp
+ *
+ * Trace event recording function declarations
+ *
+ * Spans are recorded into a ring buffer private to calling thread, writing an event takes no lock.
+ * Buffers of all threads are merged into a Chrome trace event JSON file once tracing stops,
+ * the file can be opened with chrome://tracing or https://ui.perfetto.dev
+ * If the ring buffer of a thread is full its oldest events are overwritten, files which spans are tagged with
+ * are kept in a ring buffer of their own and events whose file was overwritten are written without it.
+ *
+*/
+
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+
+
+/**
+ * @brief			Open trace file and start recording trace events
+ * @param filepath	Path to trace file which is overwritten if it exists
+ * @return			true if trace file was opened
+*/
+[[nodiscard]] bool StartTrace(const std::filesystem::path& filepath);
+
+/** Stop recording, merge events of all threads and write them to trace file, does nothing if tracing isn't started */
+void StopTrace();
+
+/**
+ * @brief Records a span of calling thread from construction until destruction or End
+*/
+class TraceSpan
+{
+	//
+	// Constructors
+	//
+public:
+	/**
+	 * @brief		Start span if tracing is enabled
+	 * @param name	Name of span, must be a string literal
+	*/
+	explicit TraceSpan(const char* name) noexcept;
+	~TraceSpan();
+
+	TraceSpan(const TraceSpan&) = delete;
+	TraceSpan(TraceSpan&&) = delete;
+
+	//
+	// Operators
+	//
+	TraceSpan& operator=(const TraceSpan&) = delete;
+	TraceSpan& operator=(TraceSpan&&) = delete;
+
+	//
+	// Public methods
+	//
+	/** End span before the object is destroyed, subsequent calls do nothing */
+	void End() noexcept;
+
+	//
+	// Members
+	//
+private:
+	// nullptr if span is not recorded
+	const char* mName;
+	std::chrono::steady_clock::time_point mStart;
+};
+
+/**
+ * @brief Tags spans recorded by calling thread with the file being processed, for the lifetime of an object
+*/
+class TraceFile
+{
+	//
+	// Constructors
+	//
+public:
+	/**
+	 * @brief			Start tagging spans with file if tracing is enabled
+	 * @param filepath	Full path to file
+	*/
+	explicit TraceFile(const std::filesystem::path& filepath);
+	~TraceFile();
+
+	TraceFile(const TraceFile&) = delete;
+	TraceFile(TraceFile&&) = delete;
+
+	//
+	// Operators
+	//
+	TraceFile& operator=(const TraceFile&) = delete;
+	TraceFile& operator=(TraceFile&&) = delete;
+
+	//
+	// Public methods
+	//
+	/**
+	 * @brief		Set file size shown with spans, including spans which were already recorded
+	 * @param bytes	Size of file in bytes
+	*/
+	void SetSize(std::size_t bytes) noexcept;
+
+	//
+	// Members
+	//
+private:
+	// Sequence number of file in calling thread's file ring, previous tag is restored on destruction
+	std::uint64_t mIndex;
+	std::uint64_t mPrevious;
+};
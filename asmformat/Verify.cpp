@@ -0,0 +1,371 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\Verify.cpp
+ *
+ * Function definitions which verify that formatting changed only whitespace
+ *
+*/
+
+#include "pch.hpp"
+#include "Verify.hpp"
+#include "ErrorMacros.hpp"
+
+#if defined _M_X64 || defined _M_IX86
+// SSE2 is baseline on x64 and default for x86 since VS 2012
+#include <emmintrin.h>
+#define VERIFY_SSE2
+#endif
+
+
+/**
+ * @brief				Check if character is whitespace, same as std::isspace in "C" locale
+ * @tparam CharType		char or wchar_t
+ * @param ch			Character to check
+ * @return				true if character is space, \t, \n, \v, \f or \r
+*/
+template<typename CharType>
+[[nodiscard]] static constexpr bool IsWhitespace(CharType ch) noexcept
+{
+	return (ch == static_cast<CharType>(' ')) || ((ch >= static_cast<CharType>('\t')) && (ch <= static_cast<CharType>('\r')));
+}
+
+/**
+ * @brief				Check if character starts a comment or quoted literal
+ * @tparam CharType		char or wchar_t
+ * @param ch			Character to check
+ * @return				true if character is ;, " or '
+*/
+template<typename CharType>
+[[nodiscard]] static constexpr bool IsDelimiter(CharType ch) noexcept
+{
+	return (ch == static_cast<CharType>(';')) || (ch == static_cast<CharType>('"')) || (ch == static_cast<CharType>('\''));
+}
+
+/**
+ * @brief				Check if character is whitespace within a line
+ * @tparam CharType		char or wchar_t
+ * @param ch			Character to check
+ * @return				true if character is whitespace other than \n or \r
+*/
+template<typename CharType>
+[[nodiscard]] static constexpr bool IsBlank(CharType ch) noexcept
+{
+	return IsWhitespace(ch) && (ch != static_cast<CharType>('\n')) && (ch != static_cast<CharType>('\r'));
+}
+
+#ifdef VERIFY_SSE2
+/**
+ * @brief				Get mask of comment and quote delimiters in 16 bytes
+ * @tparam CharType		char or wchar_t
+ * @param chunk			Characters to check
+ * @return				One bit per byte, for wide characters both bits of delimiter are set
+*/
+template<typename CharType>
+[[nodiscard]] static unsigned int DelimiterMask(__m128i chunk) noexcept
+{
+	__m128i mask;
+
+	if constexpr (sizeof(CharType) == 1)
+	{
+		mask = _mm_cmpeq_epi8(chunk, _mm_set1_epi8(';'));
+		mask = _mm_or_si128(mask, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('"')));
+		mask = _mm_or_si128(mask, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\'')));
+	}
+	else
+	{
+		mask = _mm_cmpeq_epi16(chunk, _mm_set1_epi16(L';'));
+		mask = _mm_or_si128(mask, _mm_cmpeq_epi16(chunk, _mm_set1_epi16(L'"')));
+		mask = _mm_or_si128(mask, _mm_cmpeq_epi16(chunk, _mm_set1_epi16(L'\'')));
+	}
+
+	return static_cast<unsigned int>(_mm_movemask_epi8(mask));
+}
+
+/**
+ * @brief				Get mask of whitespace characters in 16 bytes
+ * @tparam CharType		char or wchar_t
+ * @param chunk			Characters to check
+ * @return				One bit per byte, for wide characters both bits of whitespace are set
+*/
+template<typename CharType>
+[[nodiscard]] static unsigned int WhitespaceMask(__m128i chunk) noexcept
+{
+	__m128i space, control;
+
+	// \t to \r are consecutive, once \t is subtracted saturated subtraction of 4 yields 0 for these 5 characters only
+	if constexpr (sizeof(CharType) == 1)
+	{
+		space = _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' '));
+		control = _mm_subs_epu8(_mm_sub_epi8(chunk, _mm_set1_epi8('\t')), _mm_set1_epi8(4));
+		control = _mm_cmpeq_epi8(control, _mm_setzero_si128());
+	}
+	else
+	{
+		space = _mm_cmpeq_epi16(chunk, _mm_set1_epi16(L' '));
+		control = _mm_subs_epu16(_mm_sub_epi16(chunk, _mm_set1_epi16(L'\t')), _mm_set1_epi16(4));
+		control = _mm_cmpeq_epi16(control, _mm_setzero_si128());
+	}
+
+	return static_cast<unsigned int>(_mm_movemask_epi8(_mm_or_si128(space, control)));
+}
+#endif // VERIFY_SSE2
+
+/**
+ * @brief				Skip whitespace characters
+ * @tparam CharType		char or wchar_t
+ * @param data			Characters to search
+ * @param pos			Position from which to search
+ * @param size			Count of characters in data
+ * @return				Position of the first character which is not whitespace, size if not found
+*/
+template<typename CharType>
+[[nodiscard]] static std::size_t SkipWhitespace(const CharType* data, std::size_t pos, std::size_t size) noexcept
+{
+	#ifdef VERIFY_SSE2
+	if constexpr (sizeof(CharType) <= 2)
+	{
+		constexpr std::size_t lanes = sizeof(__m128i) / sizeof(CharType);
+
+		for (; pos + lanes <= size; pos += lanes)
+		{
+			SUPPRESS(26490)	// Don't use reinterpret_cast
+			const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+			const unsigned int mask = ~WhitespaceMask<CharType>(chunk) & 0xFFFF;
+
+			if (mask != 0)
+				return pos + static_cast<std::size_t>(std::countr_zero(mask)) / sizeof(CharType);
+		}
+	}
+	#endif // VERIFY_SSE2
+
+	// Remainder which doesn't fill whole register
+	while ((pos < size) && IsWhitespace(data[pos]))
+		++pos;
+
+	return pos;
+}
+
+/**
+ * @brief				Find comment or quote delimiter
+ * @tparam CharType		char or wchar_t
+ * @param data			Characters to search
+ * @param pos			Position from which to search
+ * @param size			Position up to which to search
+ * @return				Position of the first delimiter, size if not found
+*/
+template<typename CharType>
+[[nodiscard]] static std::size_t FindDelimiter(const CharType* data, std::size_t pos, std::size_t size) noexcept
+{
+	#ifdef VERIFY_SSE2
+	if constexpr (sizeof(CharType) <= 2)
+	{
+		constexpr std::size_t lanes = sizeof(__m128i) / sizeof(CharType);
+
+		for (; pos + lanes <= size; pos += lanes)
+		{
+			SUPPRESS(26490)	// Don't use reinterpret_cast
+			const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+			const unsigned int mask = DelimiterMask<CharType>(chunk);
+
+			if (mask != 0)
+				return pos + static_cast<std::size_t>(std::countr_zero(mask)) / sizeof(CharType);
+		}
+	}
+	#endif // VERIFY_SSE2
+
+	// Remainder which doesn't fill whole register
+	while ((pos < size) && !IsDelimiter(data[pos]))
+		++pos;
+
+	return pos;
+}
+
+/**
+ * @brief				Find end of line
+ * @tparam CharType		char or wchar_t
+ * @param data			Characters to search
+ * @param pos			Position from which to search
+ * @param size			Count of characters in data
+ * @return				Position of the first \n or \r, size if not found
+*/
+template<typename CharType>
+[[nodiscard]] static std::size_t FindLineEnd(const CharType* data, std::size_t pos, std::size_t size) noexcept
+{
+	while ((pos < size) && (data[pos] != static_cast<CharType>('\n')) && (data[pos] != static_cast<CharType>('\r')))
+		++pos;
+
+	return pos;
+}
+
+/**
+ * @brief				Count equal characters at the start of two strings
+ * @tparam CharType		char or wchar_t
+ * @param lhs			First string
+ * @param rhs			Second string
+ * @param size			Count of characters to compare, must not exceed size of either string
+ * @return				Count of equal characters
+*/
+template<typename CharType>
+[[nodiscard]] static std::size_t CountEqual(const CharType* lhs, const CharType* rhs, std::size_t size) noexcept
+{
+	std::size_t count = 0;
+
+	#ifdef VERIFY_SSE2
+	if constexpr (sizeof(CharType) <= 2)
+	{
+		constexpr std::size_t lanes = sizeof(__m128i) / sizeof(CharType);
+
+		for (; count + lanes <= size; count += lanes)
+		{
+			SUPPRESS(26490)	// Don't use reinterpret_cast
+			const __m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs + count));
+			SUPPRESS(26490)	// Don't use reinterpret_cast
+			const __m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs + count));
+
+			// Byte wise compare works for wide characters too since only the first difference matters
+			const unsigned int mask = ~static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(left, right))) & 0xFFFF;
+
+			if (mask != 0)
+				return count + static_cast<std::size_t>(std::countr_zero(mask)) / sizeof(CharType);
+		}
+	}
+	#endif // VERIFY_SSE2
+
+	// Remainder which doesn't fill whole register
+	while ((count < size) && (lhs[count] == rhs[count]))
+		++count;
+
+	return count;
+}
+
+/**
+ * @brief				Get range of comment text, semicolon and whitespace which follows it are excluded
+ * @tparam CharType		char or wchar_t
+ * @param data			Characters to search
+ * @param pos			Position of semicolon which starts the comment
+ * @param size			Count of characters in data
+ * @return				Begin and end of comment text, trailing whitespace is excluded
+*/
+template<typename CharType>
+[[nodiscard]] static std::pair<std::size_t, std::size_t> GetCommentText(const CharType* data, std::size_t pos, std::size_t size) noexcept
+{
+	std::size_t begin = pos + 1;
+	std::size_t end = FindLineEnd(data, begin, size);
+
+	// Formatter leaves single space between semicolon and comment
+	while ((begin < end) && IsBlank(data[begin]))
+		++begin;
+
+	while ((end > begin) && IsBlank(data[end - 1]))
+		--end;
+
+	return { begin, end };
+}
+
+/**
+ * @brief				Implementation of FindCodeChange
+ * @tparam CharType		char or wchar_t
+ * @param source		Source before formatting
+ * @param formatted		Source after formatting
+ * @return				Position in source of the first character which differs, npos if only whitespace differs
+*/
+template<typename CharType>
+[[nodiscard]] static std::size_t FindChange(std::basic_string_view<CharType> source, std::basic_string_view<CharType> formatted) noexcept
+{
+	const std::size_t source_size = source.size();
+	const std::size_t formatted_size = formatted.size();
+	std::size_t pos = 0;
+	std::size_t formatted_pos = 0;
+
+	for (;;)
+	{
+		// Identical text is skipped 16 bytes at a time, whether it's code or whitespace,
+		// this leaves only the places where whitespace was changed to be inspected character wise
+		const std::size_t equal = CountEqual(source.data() + pos, formatted.data() + formatted_pos,
+			std::min(source_size - pos, formatted_size - formatted_pos));
+
+		// Comments and quoted literals within identical text may continue past it and are compared as a whole
+		const std::size_t delimiter = FindDelimiter(source.data(), pos, pos + equal);
+
+		if (delimiter != pos + equal)
+		{
+			formatted_pos += delimiter - pos;
+			pos = delimiter;
+
+			if (source[pos] == static_cast<CharType>(';'))
+			{
+				// Comment text must be identical, only whitespace which surrounds it may change
+				const auto [begin, end] = GetCommentText(source.data(), pos, source_size);
+				const auto [formatted_begin, formatted_end] = GetCommentText(formatted.data(), formatted_pos, formatted_size);
+
+				const std::size_t length = end - begin;
+				const std::size_t count = CountEqual(source.data() + begin, formatted.data() + formatted_begin, std::min(length, formatted_end - formatted_begin));
+
+				if ((count != length) || (length != formatted_end - formatted_begin))
+					return begin + count;
+
+				pos = end;
+				formatted_pos = formatted_end;
+			}
+			else
+			{
+				// Quoted literal must be identical including whitespace, unterminated one ends with line
+				std::size_t end = FindLineEnd(source.data(), pos + 1, source_size);
+				const std::size_t quote = source.find(source[pos], pos + 1);
+
+				if (quote < end)
+				{
+					end = quote + 1;
+				}
+				else
+				{
+					// Trailing whitespace of the line is not part of literal
+					while ((end > pos + 1) && IsBlank(source[end - 1]))
+						--end;
+				}
+
+				const std::size_t length = end - pos;
+				const std::size_t count = CountEqual(source.data() + pos, formatted.data() + formatted_pos, std::min(length, formatted_size - formatted_pos));
+
+				if (count != length)
+					return pos + count;
+
+				pos += length;
+				formatted_pos += length;
+			}
+
+			continue;
+		}
+
+		pos = SkipWhitespace(source.data(), pos + equal, source_size);
+		formatted_pos = SkipWhitespace(formatted.data(), formatted_pos + equal, formatted_size);
+
+		if ((pos == source_size) || (formatted_pos == formatted_size))
+			break;
+
+		if (source[pos] != formatted[formatted_pos])
+			return pos;
+	}
+
+	// Both must end at the same time, otherwise code was either removed or added at the end
+	if ((pos == source_size) && (formatted_pos == formatted_size))
+		return std::basic_string_view<CharType>::npos;
+
+	return pos;
+}
+
+std::size_t FindCodeChange(std::string_view source, std::string_view formatted) noexcept
+{
+	return FindChange(source, formatted);
+}
+
+std::size_t FindCodeChange(std::wstring_view source, std::wstring_view formatted) noexcept
+{
+	return FindChange(source, formatted);
+}
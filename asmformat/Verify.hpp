@@ -0,0 +1,40 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\Verify.hpp
+ *
+ * Function declarations which verify that formatting changed only whitespace
+ *
+ * Formatter is allowed to change only whitespace and line breaks between code tokens, thus source before
+ * formatting and source after formatting must be identical once whitespace between code tokens is removed.
+ * Quoted literals must be identical including whitespace, comment text must be identical except for
+ * whitespace between semicolon and text and whitespace at the end of line.
+ *
+*/
+
+#pragma once
+#include <string_view>
+
+
+/**
+ * @brief				Find first character which differs between source and formatted source, whitespace between code tokens is ignored
+ * @param source		Source before formatting
+ * @param formatted		Source after formatting
+ * @return				Position in source of the first character which differs,
+ *						std::string_view::npos if only whitespace differs
+*/
+[[nodiscard]] std::size_t FindCodeChange(std::string_view source, std::string_view formatted) noexcept;
+
+/**
+ * @brief				Find first character which differs between source and formatted source, whitespace between code tokens is ignored
+ * @param source		Source before formatting
+ * @param formatted		Source after formatting
+ * @return				Position in source of the first character which differs,
+ *						std::wstring_view::npos if only whitespace differs
+*/
+[[nodiscard]] std::size_t FindCodeChange(std::wstring_view source, std::wstring_view formatted) noexcept;
@@ -19,8 +19,34 @@
 #include "ErrorCode.hpp"
 
 
+// Code page originally used by the console, zero until queried by DefaultConsoleCodePage
+std::pair<UINT, UINT> default_CP;
+
 namespace wsl
 {
+	// Protects current_CP
+	static std::mutex code_page_mutex;
+	// Code page currently set, valid once default code page was queried
+	static std::pair<UINT, UINT> current_CP;
+	// Set once default code page was queried
+	static std::atomic<bool> code_page_queried = false;
+
+	/** Query default console code page and register console handler, only the first call does it */
+	static void QueryDefaultCodePage()
+	{
+		static std::once_flag queried;
+
+		std::call_once(queried, []
+		{
+			default_CP = GetConsoleCodePage();
+			current_CP = default_CP;
+
+			// Handler restores the code page on CTRL + C, until now there was nothing to restore
+			RegisterConsoleHandler();
+			code_page_queried = true;
+		});
+	}
+
 	BOOL WINAPI HandlerRoutine(DWORD signal) noexcept
 	{
 		switch (signal)
@@ -62,6 +88,15 @@ namespace wsl
 
 	bool SetConsoleCodePage(DWORD input, DWORD output)
 	{
+		// Default code page must be known before it's modified
+		QueryDefaultCodePage();
+
+		std::lock_guard lock(code_page_mutex);
+
+		// Formatting multiple files of same encoding doesn't need to touch the console
+		if ((current_CP.first == input) && (current_CP.second == output))
+			return true;
+
 		// MSDN: Determines if a specified code page is valid
 		// Returns a nonzero value if the code page is valid, or 0 if the code page is invalid
 		if (IsValidCodePage(input) == FALSE)
@@ -92,6 +127,9 @@ namespace wsl
 			ShowError(ERROR_INFO_HR, "Failed to set console input code page");
 		}
 
+		if (!failed)
+			current_CP = std::make_pair(input, output);
+
 		return !failed;
 	}
 
@@ -115,4 +153,18 @@ namespace wsl
 
 		return std::make_pair(input, output);
 	}
+
+	std::pair<UINT, UINT> DefaultConsoleCodePage()
+	{
+		QueryDefaultCodePage();
+		return default_CP;
+	}
+
+	bool RestoreConsoleCodePage()
+	{
+		if (!code_page_queried)
+			return true;
+
+		return SetConsoleCodePage(default_CP.first, default_CP.second);
+	}
 }
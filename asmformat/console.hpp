@@ -43,7 +43,7 @@ namespace wsl
 	bool RegisterConsoleHandler() noexcept(false);
 
 	/**
-	 * @brief Set console input and output code page
+	 * @brief Set console input and output code page, setting code page which is already set does nothing
 	 * https://learn.microsoft.com/en-us/windows/win32/intl/code-page-identifiers
 	 *
 	 * @param input		console input code page which to set
@@ -57,4 +57,19 @@ namespace wsl
 	 * @return	Input followed by Output code page pair
 	*/
 	std::pair<UINT, UINT> GetConsoleCodePage() noexcept(false);
+
+	/**
+	 * Get console code page which was in use before it was modified by the program.
+	 * The code page is queried and console handler which restores it is registered on first call only,
+	 * thus runs which never modify console code page don't pay for it.
+	 *
+	 * @return	Input followed by Output code page pair
+	*/
+	[[nodiscard]] std::pair<UINT, UINT> DefaultConsoleCodePage();
+
+	/**
+	 * @brief	Restore console code page modified by SetConsoleCodePage, does nothing if it was never modified
+	 * @return	true if function succeeds
+	*/
+	bool RestoreConsoleCodePage();
 }
@@ -16,10 +16,153 @@
 #include "pch.hpp"
 #include "error.hpp"
 #include "console.hpp"
+#include "Logger.hpp"
 
 
 namespace wsl
 {
+	/**
+	 * @brief Error recorded in batch mode
+	*/
+	struct ErrorRecord
+	{
+		// File which was processed when the error occurred
+		std::string file_name;
+		std::string error_title;
+		std::string error_message;
+		DWORD error_code;
+		// Error code by which exit code is determined
+		ErrorCode error_enum;
+		long flags;
+	};
+
+	// Current error policy
+	static std::atomic<ErrorPolicy> error_policy = ErrorPolicy::Interactive;
+
+	// File processed by calling thread, empty if none
+	static thread_local std::string error_context;
+
+	// Capture active on calling thread, nullptr if none
+	static thread_local ErrorCapture* error_capture = nullptr;
+
+	// Count of errors reported by calling thread
+	static thread_local std::size_t error_count = 0;
+
+	// Serializes console access of concurrent callers and protects error_records
+	static std::mutex error_mutex;
+
+	// Errors recorded in batch mode in the order in which they occurred
+	static std::vector<ErrorRecord> error_records;
+
+	void SetErrorPolicy(ErrorPolicy policy) noexcept
+	{
+		error_policy = policy;
+	}
+
+	ErrorPolicy GetErrorPolicy() noexcept
+	{
+		return error_policy.load();
+	}
+
+	ErrorContext::ErrorContext(std::string file_name) :
+		mPrevious(std::exchange(error_context, std::move(file_name)))
+	{
+	}
+
+	ErrorContext::~ErrorContext()
+	{
+		error_context.swap(mPrevious);
+	}
+
+	ErrorCapture::ErrorCapture() noexcept :
+		mPrevious(std::exchange(error_capture, this))
+	{
+	}
+
+	ErrorCapture::~ErrorCapture()
+	{
+		error_capture = mPrevious;
+	}
+
+	void ErrorCapture::Capture(DWORD error_code, ErrorCode error_enum, const std::string& error_message)
+	{
+		if (mFailed)
+			return;
+
+		mFailed = true;
+		mCode = error_code;
+		mError = error_enum;
+		mMessage = error_message;
+	}
+
+	std::size_t ErrorCount() noexcept
+	{
+		return error_count;
+	}
+
+	ErrorCode ToErrorCode(const std::error_code& code) noexcept
+	{
+		if (code.category() == make_error_code(ErrorCode::Success).category())
+			return static_cast<ErrorCode>(code.value());
+
+		// Win32, HRESULT and CRT errors are failures of a function which was called
+		return code ? ErrorCode::FunctionFailed : ErrorCode::Success;
+	}
+
+	int ReportErrors()
+	{
+		std::lock_guard lock(error_mutex);
+
+		if (error_records.empty())
+			return 0;
+
+		LogFlush();
+
+		// Files in the order in which first error occurred
+		std::vector<std::string> files;
+		std::unordered_map<std::string, std::vector<const ErrorRecord*>> file_errors;
+
+		for (const ErrorRecord& record : error_records)
+		{
+			auto& records = file_errors[record.file_name];
+			if (records.empty())
+				files.push_back(record.file_name);
+
+			records.push_back(&record);
+		}
+
+		ErrorCode worst = ErrorCode::Success;
+		std::size_t errors = 0;
+
+		for (const std::string& file_name : files)
+		{
+			std::cerr << std::endl << file_name << std::endl;
+
+			for (const ErrorRecord* record : file_errors[file_name])
+			{
+				std::cerr << std::endl << record->error_title << std::endl;
+				std::cerr << record->error_message << std::endl;
+
+				// Warnings and information don't affect exit code
+				if ((LOWORD(record->flags) == MB_ICONWARNING) || (LOWORD(record->flags) == MB_ICONINFORMATION))
+					continue;
+
+				++errors;
+				worst = std::max(worst, record->error_enum);
+			}
+		}
+
+		std::cerr << std::endl << errors << " errors and " << error_records.size() - errors << " warnings in " << files.size() << " files" << std::endl;
+
+		// Error shown as an error whose code says success still fails the run
+		if ((errors != 0) && (worst == ErrorCode::Success))
+			worst = ErrorCode::UnspecifiedError;
+
+		// Watch mode reports after each batch of changes, errors are reported only once
+		error_records.clear();
+		return ExitCode(worst);
+	}
+
 	const std::shared_ptr<std::array<char, msg_buff_size>>
 		FormatErrorMessageA(const DWORD& error_code, DWORD& dwChars)
 	{
@@ -43,10 +186,17 @@ namespace wsl
 		std::string& error_message,
 		const std::string& error_info,
 		const DWORD error_code,
+		const ErrorCode error_enum,
 		const long flags)
 	{
+		const bool is_error = (LOWORD(flags) != MB_ICONWARNING) && (LOWORD(flags) != MB_ICONINFORMATION);
+
+		if (is_error)
+			++error_count;
+
 		int response = 0;
 		const bool console = IsConsole();
+		const bool batch = error_policy == ErrorPolicy::Batch;
 
 		if (!error_info.empty())
 		{
@@ -60,7 +210,36 @@ namespace wsl
 				error_message.append("\r\n");
 		}
 
-		if (console)
+		// Captured errors are never shown
+		if (error_capture != nullptr)
+		{
+			if (is_error)
+				error_capture->Capture(error_code, error_enum, error_message);
+
+			return;
+		}
+
+		// Only one caller at a time may record error or use the console
+		std::lock_guard lock(error_mutex);
+
+		if (batch && !error_context.empty())
+		{
+			// Reported by ReportErrors once all files are processed
+			error_records.push_back({ error_context, error_title, error_message, error_code, error_enum, flags });
+			return;
+		}
+
+		// Make sure buffered log records are shown before the error
+		LogFlush();
+
+		if (batch)
+		{
+			// Not associated with any file, show error but don't ask the user
+			std::cerr << std::endl << error_title.c_str() << std::endl;
+			std::cerr << error_message.c_str() << std::endl;
+			return;
+		}
+		else if (console)
 		{
 			MessageBeep(static_cast<UINT>(flags));
 
@@ -118,7 +297,7 @@ namespace wsl
 			SetConsoleCP(default_CP.first);
 			SetConsoleOutputCP(default_CP.second);
 
-			std::exit(static_cast<int>(error_code));
+			std::exit(ExitCode(error_enum));
 		}
 	}
 
@@ -237,7 +416,8 @@ namespace wsl
 			error_message.append("\r\n");
 		}
 
-		GetUserResponse(error_title, error_message, info, error_code, flags);
+		// Win32 and COM errors are failures of a function which was called
+		GetUserResponse(error_title, error_message, info, error_code, ErrorCode::FunctionFailed, flags);
 	}
 	catch (...)
 	{
@@ -306,7 +486,27 @@ namespace wsl
 		// for exceptions and HRESULTS we add manually
 		// so for consistency we add it for exception errors too.
 		error_message.append("\r\n");
-		GetUserResponse(error_title, error_message, error_info, error_code, flags);
+		GetUserResponse(error_title, error_message, error_info, error_code, ToErrorCode(exception.code()), flags);
+	}
+	catch (...)
+	{
+		// Restore modified console code page and exit program
+		// Using SetConsoleCodePage() would produce infinite loop if code page is invalid
+		SetConsoleCP(default_CP.first);
+		SetConsoleOutputCP(default_CP.second);
+
+		MessageBoxA(nullptr, "Likely string constructor exception", "Exception in ShowError", MB_ICONERROR);
+		std::exit(wsl::ExitCode(ErrorCode::UnspecifiedError));
+	}
+
+	void ShowErrorMessageA(
+		ErrorCode error_enum,
+		const std::string& message,
+		long flags) try
+	{
+		// Message already has file, function, category and info lines, it's shown as is
+		std::string error_message = message;
+		GetUserResponse(GenerateErrorTitle(flags), error_message, "", static_cast<DWORD>(error_enum), error_enum, flags);
 	}
 	catch (...)
 	{
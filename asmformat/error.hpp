@@ -16,6 +16,7 @@
 #pragma once
 #include <memory>
 #include <array>
+#include <string>
 #include <type_traits>
 #include <Windows.h>
 #include "exception.hpp"
@@ -46,6 +47,142 @@ namespace wsl
 	/* Error message buffer size used by ForamtMessage API **/
 	constexpr short msg_buff_size = 512;
 
+	/**
+	 * @brief How errors are handled once they're formatted
+	*/
+	enum class ErrorPolicy
+	{
+		Interactive,	// Show error and ask user whether to continue or exit
+		Batch			// Record error for the file being processed and continue without asking
+	};
+
+	/**
+	 * @brief			Set how errors are handled
+	 * @param policy	Error policy to use
+	*/
+	void SetErrorPolicy(ErrorPolicy policy) noexcept;
+
+	/** Get error policy currently in use */
+	[[nodiscard]] ErrorPolicy GetErrorPolicy() noexcept;
+
+	/**
+	 * @brief Associates errors which occur on the calling thread with a file for the lifetime of an object.
+	 * In batch mode errors are recorded per file, errors not associated with a file are shown immediately
+	*/
+	class ErrorContext
+	{
+		//
+		// Constructors
+		//
+	public:
+		explicit ErrorContext(std::string file_name);
+		~ErrorContext();
+
+		ErrorContext(const ErrorContext&) = delete;
+		ErrorContext(ErrorContext&&) = delete;
+
+		//
+		// Operators
+		//
+		ErrorContext& operator=(const ErrorContext&) = delete;
+		ErrorContext& operator=(ErrorContext&&) = delete;
+
+		//
+		// Members
+		//
+	private:
+		// File name of the context which is restored on destruction
+		std::string mPrevious;
+	};
+
+	/**
+	 * @brief Captures errors which occur on the calling thread for the lifetime of an object instead of showing them.
+	 * Only the first error is kept, warnings and information are discarded.
+	 * Used by library entry points which must not have console or message box side effects
+	*/
+	class ErrorCapture
+	{
+		//
+		// Constructors
+		//
+	public:
+		ErrorCapture() noexcept;
+		~ErrorCapture();
+
+		ErrorCapture(const ErrorCapture&) = delete;
+		ErrorCapture(ErrorCapture&&) = delete;
+
+		//
+		// Operators
+		//
+		ErrorCapture& operator=(const ErrorCapture&) = delete;
+		ErrorCapture& operator=(ErrorCapture&&) = delete;
+
+		//
+		// Public methods
+		//
+		/** Record error unless one was already recorded */
+		void Capture(DWORD error_code, ErrorCode error_enum, const std::string& error_message);
+
+		/** Check if an error was captured */
+		[[nodiscard]] inline bool Failed() const noexcept
+		{
+			return mFailed;
+		}
+
+		/** Get error code of the first error captured, 0 if none */
+		[[nodiscard]] inline DWORD Code() const noexcept
+		{
+			return mCode;
+		}
+
+		/** Get error code of the first error captured as ErrorCode, ErrorCode::Success if none */
+		[[nodiscard]] inline ErrorCode Error() const noexcept
+		{
+			return mError;
+		}
+
+		/** Get error message of the first error captured */
+		[[nodiscard]] inline const std::string& Message() const noexcept
+		{
+			return mMessage;
+		}
+
+		//
+		// Members
+		//
+	private:
+		// Capture which is restored on destruction
+		ErrorCapture* mPrevious;
+		bool mFailed = false;
+		DWORD mCode = 0;
+		ErrorCode mError = ErrorCode::Success;
+		std::string mMessage;
+	};
+
+	/**
+	 * @brief	Get count of errors shown or recorded on the calling thread, warnings and information excluded.
+	 *			Callers compare counts before and after an operation to find out if it reported an error
+	 * @return	Count of errors
+	*/
+	[[nodiscard]] std::size_t ErrorCount() noexcept;
+
+	/**
+	 * @brief			Get ErrorCode by which exit code is determined, error codes of other categories are not comparable to it
+	 * @param code		Error code of any category
+	 * @return			Value of ErrorCode category as is, ErrorCode::FunctionFailed for errors of other categories
+	*/
+	[[nodiscard]] ErrorCode ToErrorCode(const std::error_code& code) noexcept;
+
+	/**
+	 * Print summary of errors recorded in batch mode.
+	 * Errors and warnings are grouped by file in the order of files processed.
+	 * Reported errors are removed, subsequent call reports only errors recorded since.
+	 *
+	 * @return Exit code of the worst error recorded, never 0 if an error was recorded, or 0 if no errors were recorded
+	*/
+	[[nodiscard]] int ReportErrors();
+
 	/**
 	 * @brief				Converts an error code to human readable string
 	 * @param error_code	Error code which to format
@@ -69,6 +206,7 @@ namespace wsl
 		std::string& error_message,
 		const std::string& error_info,
 		const DWORD error_code,
+		const ErrorCode error_enum,
 		const long flags);
 
 	/**
@@ -105,6 +243,20 @@ namespace wsl
 		int line,
 		long flags = MB_ICONERROR);
 
+	/**
+	 * Show error message which was already formatted by ShowError, ex. in another process.
+	 * Arguments of ShowError are not known, thus message is not formatted again
+	 *
+	 * @param error_enum	Error code which determines exit code
+	 * @param message		Error message with file, function, category and info lines
+	 * @param flags			Sound of error message and in case of Window app,
+	 *						message box appearance
+	*/
+	void ShowErrorMessageA(
+		ErrorCode error_enum,
+		const std::string& message,
+		long flags = MB_ICONERROR);
+
 	/**
 	 * Show error message from exception objects in MessageBox or Console.
 	 * Accepts std exceptions and custom Exception class
@@ -136,6 +288,7 @@ namespace wsl
 		error_message.append("\r\nCategory:\t");
 
 		DWORD error_code{ };
+		ErrorCode error_enum = ErrorCode::UnspecifiedError;
 
 		if constexpr (HasCodeMethod<ExceptionClass, const std::error_code & ()>::value)
 		{
@@ -145,6 +298,7 @@ namespace wsl
 			const ExceptionClass& ref = dynamic_cast<ExceptionClass&>(exception);
 			const std::error_code& ref_code = ref.code();
 			error_code = static_cast<DWORD>(ref_code.value());
+			error_enum = ToErrorCode(ref_code);
 
 			if (!error_code)
 			{
@@ -195,7 +349,7 @@ namespace wsl
 		// for exceptions and HRESULTS we add manually
 		// so for consistency we add it for exception errors too.
 		error_message.append("\r\n");
-		GetUserResponse(error_title, error_message, error_info, error_code, flags);
+		GetUserResponse(error_title, error_message, error_info, error_code, error_enum, flags);
 	}
 	catch (...)
 	{
@@ -0,0 +1,236 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\expected.hpp
+ *
+ * Value or error return type
+ *
+ * std::expected is C++23 while solution is built as C++20, until then a subset of it is provided
+ * with same names and semantics so that the switch is a matter of removing this header.
+ * value() of the subset doesn't throw std::bad_expected_access, accessing the value of an error is asserted.
+ *
+*/
+
+#pragma once
+#include <version>
+
+#if __cpp_lib_expected >= 202202L
+#include <expected>
+
+namespace wsl
+{
+	using std::expected;
+	using std::unexpected;
+}
+#else
+#include <cassert>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+
+namespace wsl
+{
+	/**
+	 * @brief			Error which is converted to expected
+	 * @tparam E		Error type
+	*/
+	template<typename E>
+	class unexpected
+	{
+		//
+		// Constructors
+		//
+	public:
+		constexpr explicit unexpected(E error) noexcept(std::is_nothrow_move_constructible_v<E>) :
+			mError(std::move(error))
+		{
+		}
+
+		//
+		// Public methods
+		//
+		[[nodiscard]] constexpr const E& error() const& noexcept
+		{
+			return mError;
+		}
+
+		[[nodiscard]] constexpr E& error() & noexcept
+		{
+			return mError;
+		}
+
+		//
+		// Members
+		//
+	private:
+		E mError;
+	};
+
+	/**
+	 * @brief			Value or error
+	 * @tparam T		Value type
+	 * @tparam E		Error type
+	*/
+	template<typename T, typename E>
+	class expected
+	{
+		//
+		// Constructors
+		//
+	public:
+		using value_type = T;
+		using error_type = E;
+
+		constexpr expected() requires std::is_default_constructible_v<T> :
+			mStorage(std::in_place_index<0>)
+		{
+		}
+
+		template<typename U = T>
+		requires std::is_constructible_v<T, U&&> &&
+			(!std::is_same_v<std::remove_cvref_t<U>, expected>) && (!std::is_same_v<std::remove_cvref_t<U>, unexpected<E>>)
+		constexpr expected(U&& value) :
+			mStorage(std::in_place_index<0>, std::forward<U>(value))
+		{
+		}
+
+		template<typename G>
+		constexpr expected(const unexpected<G>& error) :
+			mStorage(std::in_place_index<1>, error.error())
+		{
+		}
+
+		//
+		// Operators
+		//
+		constexpr explicit operator bool() const noexcept
+		{
+			return has_value();
+		}
+
+		[[nodiscard]] constexpr T& operator*() & noexcept
+		{
+			assert(has_value());
+			return *std::get_if<0>(&mStorage);
+		}
+
+		[[nodiscard]] constexpr const T& operator*() const& noexcept
+		{
+			assert(has_value());
+			return *std::get_if<0>(&mStorage);
+		}
+
+		[[nodiscard]] constexpr T* operator->() noexcept
+		{
+			assert(has_value());
+			return std::get_if<0>(&mStorage);
+		}
+
+		[[nodiscard]] constexpr const T* operator->() const noexcept
+		{
+			assert(has_value());
+			return std::get_if<0>(&mStorage);
+		}
+
+		//
+		// Public methods
+		//
+		[[nodiscard]] constexpr bool has_value() const noexcept
+		{
+			return mStorage.index() == 0;
+		}
+
+		[[nodiscard]] constexpr T& value() & noexcept
+		{
+			return **this;
+		}
+
+		[[nodiscard]] constexpr const T& value() const& noexcept
+		{
+			return **this;
+		}
+
+		[[nodiscard]] constexpr const E& error() const& noexcept
+		{
+			assert(!has_value());
+			return *std::get_if<1>(&mStorage);
+		}
+
+		template<typename U>
+		[[nodiscard]] constexpr T value_or(U&& default_value) const&
+		{
+			return has_value() ? **this : static_cast<T>(std::forward<U>(default_value));
+		}
+
+		template<typename U>
+		[[nodiscard]] constexpr T value_or(U&& default_value) &&
+		{
+			return has_value() ? std::move(**this) : static_cast<T>(std::forward<U>(default_value));
+		}
+
+		//
+		// Members
+		//
+	private:
+		std::variant<T, E> mStorage;
+	};
+
+	/**
+	 * @brief			Success or error
+	 * @tparam E		Error type
+	*/
+	template<typename E>
+	class expected<void, E>
+	{
+		//
+		// Constructors
+		//
+	public:
+		using value_type = void;
+		using error_type = E;
+
+		constexpr expected() noexcept = default;
+
+		template<typename G>
+		constexpr expected(const unexpected<G>& error) :
+			mError(error.error())
+		{
+		}
+
+		//
+		// Operators
+		//
+		constexpr explicit operator bool() const noexcept
+		{
+			return has_value();
+		}
+
+		//
+		// Public methods
+		//
+		[[nodiscard]] constexpr bool has_value() const noexcept
+		{
+			return !mError.has_value();
+		}
+
+		[[nodiscard]] constexpr const E& error() const& noexcept
+		{
+			assert(!has_value());
+			return *mError;
+		}
+
+		//
+		// Members
+		//
+	private:
+		std::optional<E> mError;
+	};
+}
+#endif // __cpp_lib_expected
@@ -0,0 +1,127 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\git.cpp
+ *
+ * Function definitions used to query local git repository
+ *
+*/
+
+#include "pch.hpp"
+#include "git.hpp"
+#include "StringCast.hpp"
+#include "error.hpp"
+#include "ErrorCode.hpp"
+using namespace wsl;
+namespace fs = std::filesystem;
+
+
+/**
+ * @brief			Remove trailing line breaks from git output
+ * @param output	String which to trim
+*/
+static void TrimLineBreaks(std::string& output)
+{
+	while (!output.empty() && ((output.back() == '\n') || (output.back() == '\r')))
+		output.pop_back();
+}
+
+/**
+ * @brief			Append NUL separated list of paths to files vector
+ * @param root		Top level directory of repository to which paths are relative
+ * @param list		Output of git command run with -z switch
+ * @param filter	Globs which select files, matched against paths relative to root
+ * @param files		Vector which receives full paths to files
+*/
+static void AppendPaths(const fs::path& root, const std::string& list, const FileFilter& filter, std::vector<fs::path>& files)
+{
+	std::size_t begin = 0;
+
+	for (std::size_t end = list.find('\0'); end != std::string::npos; end = list.find('\0', begin))
+	{
+		// git outputs paths as UTF-8 relative to top level directory
+		const fs::path file_path = (root / StringCast(list.substr(begin, end - begin))).lexically_normal();
+		begin = end + 1;
+
+		// Deleted files are already filtered out by git but file could be removed meanwhile
+		if (MatchFile(root, file_path, filter) && fs::is_regular_file(file_path))
+			files.push_back(file_path);
+	}
+}
+
+bool RunGit(const std::string& arguments, std::string& output)
+{
+	output.clear();
+	const std::string command = "git " + arguments;
+
+	_set_errno(0);
+	// MSDN: Returns a stream associated with one end of the created pipe.
+	// If an error occurs, NULL is returned
+	FILE* pipe = _popen(command.c_str(), "rb");
+
+	if (pipe == nullptr)
+	{
+		ShowCrtError(Exception(ErrorCode::FunctionFailed, "Failed to run " + command), ERROR_INFO);
+		return false;
+	}
+
+	std::array<char, 4096> buffer{ };
+	std::size_t bytes_read = 0;
+
+	while ((bytes_read = fread(buffer.data(), sizeof(char), buffer.size(), pipe)) > 0)
+		output.append(buffer.data(), bytes_read);
+
+	// MSDN: Returns the exit status of the terminating command processor, or -1 if an error occurs
+	const int status = _pclose(pipe);
+
+	if (status != 0)
+	{
+		ShowError(ErrorCode::FunctionFailed, "Command '" + command + "' failed with exit status " + std::to_string(status));
+		return false;
+	}
+
+	return true;
+}
+
+bool GetChangedFiles(const std::string& ref, const FileFilter& filter, std::vector<fs::path>& files)
+{
+	// Ref is passed trough command processor
+	if (ref.find_first_of("\"&|<>^%") != std::string::npos)
+	{
+		ShowError(ErrorCode::InvalidOptionArgument, "Git ref '" + ref + "' contains invalid characters");
+		return false;
+	}
+
+	std::string toplevel;
+	if (!RunGit("rev-parse --show-toplevel", toplevel))
+		return false;
+
+	std::string merge_base;
+	if (!RunGit("merge-base \"" + ref + "\" HEAD", merge_base))
+		return false;
+
+	TrimLineBreaks(toplevel);
+	TrimLineBreaks(merge_base);
+
+	// Compares merge base against working tree which includes both staged and unstaged changes,
+	// -z outputs unquoted paths separated by NUL and --diff-filter=d excludes deleted files
+	std::string changed;
+	if (!RunGit("diff --name-only -z --diff-filter=d " + merge_base, changed))
+		return false;
+
+	// ":/" pathspec makes sure entire repository is listed regardless of working directory
+	std::string untracked;
+	if (!RunGit("ls-files --others --exclude-standard --full-name -z :/", untracked))
+		return false;
+
+	const fs::path root = StringCast(toplevel);
+	AppendPaths(root, changed, filter, files);
+	AppendPaths(root, untracked, filter, files);
+
+	return true;
+}
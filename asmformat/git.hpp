@@ -0,0 +1,40 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\git.hpp
+ *
+ * Function declarations used to query local git repository
+ *
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+#include <filesystem>
+#include "Filter.hpp"
+
+
+/**
+ * @brief				Run git with the specified arguments and capture it's standard output
+ * @param arguments		Command line arguments passed to git
+ * @param output		Receives standard output of git
+ * @return				true if git exited with status 0
+*/
+[[nodiscard]] bool RunGit(const std::string& arguments, std::string& output);
+
+/**
+ * Get files which changed since merge base of the specified ref and HEAD.
+ * Both committed, staged and unstaged changes as well as untracked files are included,
+ * deleted files and files which FindFiles wouldn't select in top level directory of repository are omitted.
+ *
+ * @param ref			Git ref (branch, tag or commit) against which merge base is computed
+ * @param filter		Globs which select files, .asmformatignore files of repository are applied as well
+ * @param files			Vector to which full paths of changed files are appended
+ * @return				true if git was successfully queried
+*/
+[[nodiscard]] bool GetChangedFiles(const std::string& ref, const FileFilter& filter, std::vector<std::filesystem::path>& files);
@@ -22,8 +22,18 @@
 
 #include "pch.hpp"
 #include "console.hpp"
-#include "FormatFile.hpp"
-#include "SourceFile.hpp"
+#include "Formatter.hpp"
+#include "git.hpp"
+#include "watch.hpp"
+#include "Report.hpp"
+#include "Shard.hpp"
+#include "Filter.hpp"
+#include "Includes.hpp"
+#include "Server.hpp"
+#include "Kernels.hpp"
+#include "Trace.hpp"
+#include "Probes.hpp"
+#include "Logger.hpp"
 #include "error.hpp"
 #include "ErrorCode.hpp"
 #include "StringCast.hpp"
@@ -31,9 +41,6 @@ using namespace wsl;
 namespace fs = std::filesystem;
 
 
-// Code page originally used by the console
-std::pair<UINT, UINT> default_CP;
-
 // https://learn.microsoft.com/en-us/cpp/c-runtime-library/parameter-validation
 // The parameters all have the value NULL in release build
 extern "C" void RunTimeLibraryError(
@@ -63,41 +70,314 @@ extern "C" void RunTimeLibraryError(
 	std::exit(ExitCode(ErrorCode::RunTimeLibraryError));
 }
 
+/**
+ * @brief Kind of command line argument which specifies files to format
+*/
+enum class InputKind
+{
+	File,			// File name or path without option
+	Path,			// --path option
+	Directory,		// --directory option
+	ChangedSince	// --changed-since option
+};
+
+/**
+ * @brief Command line parsed in a single pass, no file system or git access is done while parsing
+*/
+struct CommandLine
+{
+	bool version = false;
+	bool help = false;
+	bool nologo = false;
+	bool quiet = false;
+	bool verbose = false;
+	bool batch = false;
+	bool recurse = false;
+	// Align inline comments of all files to the same column
+	bool global_align = false;
+	// Format files included by files to format
+	bool follow_includes = false;
+	// Print statistics once all files are formatted
+	bool stats = false;
+	// Serve clients which forward formatting instead of formatting files
+	bool server = false;
+	// Instruction set of kernels if --kernels was specified
+	std::optional<Isa> kernels;
+	FormatOptions options;
+	// Files, directories and git refs in the order in which they were specified
+	std::vector<std::pair<InputKind, std::string>> inputs;
+	// Directory to watch for changes if --watch was specified
+	std::string watch_directory;
+	// JSON report file if --report was specified
+	fs::path report_file;
+	// Chrome trace event file if --trace was specified
+	fs::path trace_file;
+	// Shard of files to format if --shard was specified
+	Shard shard;
+	// Globs which select files found by --directory
+	std::vector<std::string> include;
+	std::vector<std::string> exclude;
+	// The first error encountered, it's shown once parsing is done
+	ErrorCode error = ErrorCode::Success;
+	std::string error_message;
+};
+
+/**
+ * @brief			Parse command line arguments, parsing continues after an error so that options such as --help are known
+ * @param argc		Count of arguments including program name
+ * @param argv		Arguments
+ * @param command	Receives parsed command line and the first error if any
+*/
+static void ParseCommandLine(int argc, char* argv[], CommandLine& command)
+{
+	const auto fail = [&command](ErrorCode error, const std::string& message)
+	{
+		if (command.error == ErrorCode::Success)
+		{
+			command.error = error;
+			command.error_message = message;
+		}
+	};
+
+	// Options which take one argument
+	constexpr std::array<std::string_view, 13> arg_options{
+		"--encoding", "--tabwidth", "--linebreaks", "--directory", "--changed-since", "--path", "--watch", "--report", "--trace", "--shard",
+		"--include", "--exclude", "--kernels"
+	};
+
+	FormatOptions& options = command.options;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string_view param = argv[i];
+
+		if (!param.starts_with("--"))
+		{
+			command.inputs.emplace_back(InputKind::File, param);
+			continue;
+		}
+
+		// Options which take no argument
+		if (param == "--version")
+			command.version = true;
+		else if (param == "--help")
+			command.help = true;
+		else if (param == "--nologo")
+			command.nologo = true;
+		else if (param == "--quiet")
+			command.quiet = true;
+		else if (param == "--verbose")
+			command.verbose = true;
+		else if (param == "--batch")
+			command.batch = true;
+		else if (param == "--recurse")
+			command.recurse = true;
+		else if (param == "--follow-includes")
+			command.follow_includes = true;
+		else if (param == "--stats")
+			command.stats = true;
+		else if (param == "--server")
+			command.server = true;
+		else if (param == "--spaces")
+			options.spaces = true;
+		else if (param == "--compact")
+			options.compact = true;
+		else if (param == "--normalize")
+			options.normalize = true;
+		else if (param == "--global-align")
+			command.global_align = true;
+		else if (param == "--verify")
+			options.verify = true;
+		else if (param == "--noverify")
+			options.verify = false;
+		else if (std::find(arg_options.begin(), arg_options.end(), param) == arg_options.end())
+			fail(ErrorCode::UnknownOption, "option '" + std::string(param) + "' was not recognized");
+		else
+		{
+			std::string arg{ };
+
+			// Make sure we aren't at the end of argv
+			if ((i + 1) != argc)
+				arg = argv[++i];
+
+			if (arg.empty())
+			{
+				// Will happen when a valid option is at the end without an argument
+				fail(ErrorCode::InvalidOptionArgument, std::string(param) + " option requires one argument");
+				continue;
+			}
+			// Make sure argument doesn't use option syntax
+			else if (arg.starts_with("--"))
+			{
+				fail(ErrorCode::InvalidOptionArgument, "An argument was expected for " + std::string(param) + " option but '" + arg + "' was encountered");
+				continue;
+			}
+
+			if (param == "--encoding")
+			{
+				if (arg == "utf8")
+				{
+					options.encoding = Encoding::UTF8;
+				}
+				else if (arg == "utf16le")
+				{
+					options.encoding = Encoding::UTF16LE;
+				}
+				else if (arg != "ansi")
+				{
+					fail(ErrorCode::InvalidOptionArgument, "The specified encoding '" + arg + "' was not recognized");
+				}
+				// This is needed if --encoding was specified more than once
+				else options.encoding = Encoding::ANSI;
+			}
+			else if (param == "--tabwidth")
+			{
+				const int width = std::stoi(arg);
+
+				if (width < 1)
+					fail(ErrorCode::InvalidOptionArgument, "Tab width must be a number grater than zero");
+				else options.tab_width = static_cast<std::size_t>(width);
+			}
+			else if (param == "--linebreaks")
+			{
+				if (arg == "crlf")
+				{
+					options.line_break = LineBreak::CRLF;
+				}
+				else if (arg == "lf")
+				{
+					options.line_break = LineBreak::LF;
+				}
+				else if (arg == "cr")
+				{
+					options.line_break = LineBreak::CR;
+				}
+				else
+				{
+					fail(ErrorCode::InvalidOptionArgument, "The specified linebreak '" + arg + "' was not recognized");
+				}
+			}
+			else if (param == "--directory")
+			{
+				command.inputs.emplace_back(InputKind::Directory, arg);
+			}
+			else if (param == "--changed-since")
+			{
+				command.inputs.emplace_back(InputKind::ChangedSince, arg);
+			}
+			else if (param == "--path")
+			{
+				command.inputs.emplace_back(InputKind::Path, arg);
+			}
+			else if (param == "--watch")
+			{
+				command.watch_directory = arg;
+			}
+			else if (param == "--report")
+			{
+				command.report_file = arg;
+			}
+			else if (param == "--trace")
+			{
+				command.trace_file = arg;
+			}
+			else if (param == "--include")
+			{
+				command.include.push_back(arg);
+			}
+			else if (param == "--exclude")
+			{
+				command.exclude.push_back(arg);
+			}
+			else if (param == "--shard")
+			{
+				if (!ParseShard(arg, command.shard))
+					fail(ErrorCode::InvalidOptionArgument, "The specified shard '" + arg + "' must be I/N where I is in range from 1 to N");
+			}
+			else if (param == "--kernels")
+			{
+				Isa isa = Isa::Scalar;
+
+				if (StringToIsa(arg, isa))
+					command.kernels = isa;
+				else fail(ErrorCode::InvalidOptionArgument, "The specified kernels '" + arg + "' must be scalar, sse2, avx2 or avx512");
+			}
+		}
+	}
+}
+
+/**
+ * @brief Print statistics of the run requested by --stats option
+*/
+static void PrintStats()
+{
+	const Isa isa = GetKernels().isa;
+	std::cout << "kernels: " << IsaToString(isa);
+
+	if (isa != GetSupportedIsa())
+		std::cout << " (selected by --kernels, supported: " << IsaToString(GetSupportedIsa()) << ")";
+
+	std::cout << std::endl;
+
+	// Whole file buffers copied while handing them over between load, format and write
+	const CopyTotals copies = GetCopyTotals();
+	std::cout << "bytes copied: " << copies.bytes_copied << " in " << copies.files << " files";
+
+	if (copies.files != 0)
+		std::cout << " (" << copies.bytes_copied / copies.files << " per file)";
+
+	std::cout << std::endl;
+}
+
 int main(int argc, char* argv[]) try
 {
 	#ifdef _DEBUG
 	_set_invalid_parameter_handler(RunTimeLibraryError);
 	#endif
 
-	if (!RegisterConsoleHandler())
-	{
-		return ExitCode(ErrorCode::FunctionFailed);
-	}
+	// Probes are disabled until a tracing session enables the provider
+	RegisterProbes();
 
-	default_CP = GetConsoleCodePage();
-	fs::path executable_path = argv[0];
-	const std::string executable_name = executable_path.stem().string();
-	std::vector<std::string> all_params(argv + 1, argv + argc);
+	// Records are written on every return from main, including the ones which don't format any file
+	const LogSession log_session;
+
+	// Console code page and console handler are initialized on first use, see DefaultConsoleCodePage
+	CommandLine command;
+	ParseCommandLine(argc, argv, command);
+	FormatOptions& options = command.options;
 
 	constexpr const char* version = "0.5.0";
 
 	// Show program version if --version was specified
-	if (std::find(all_params.begin(), all_params.end(), "--version") != all_params.end())
+	if (command.version)
 	{
 		std::cout << "asmformat version " << version;
 		return 0;
 	}
 
-	const bool nologo = std::find(all_params.begin(), all_params.end(), "--nologo") != all_params.end();
-	constexpr const char* syntax = " [-path] file1.asm [dir\\file2.asm ...] [--directory DIR] [--recurse] [--encoding ansi|utf8|utf16le] [--tabwidth N] [--spaces] [--linebreaks crlf|lf] [--compact] [--version] [--nologo] [--help]";
+	fs::path executable_path = argv[0];
+	const std::string executable_name = executable_path.stem().string();
+	constexpr const char* syntax = " [-path] file1.asm [dir\\file2.asm ...] [--directory DIR] [--recurse] [--include GLOB ...] [--exclude GLOB ...] [--follow-includes] [--changed-since REF] [--watch DIR] [--report FILE] [--trace FILE] [--shard I/N] [--encoding ansi|utf8|utf16le] [--tabwidth N] [--spaces] [--linebreaks crlf|lf|cr] [--compact] [--normalize] [--global-align] [--verify|--noverify] [--kernels scalar|sse2|avx2|avx512] [--stats] [--server] [--quiet|--verbose] [--batch] [--version] [--nologo] [--help]";
 
-	if (!nologo)
+	// Prompting for user response isn't possible if input is redirected, ex. CI runs
+	if (command.batch || (GetFileType(GetStdHandle(STD_INPUT_HANDLE)) != FILE_TYPE_CHAR))
+	{
+		SetErrorPolicy(ErrorPolicy::Batch);
+	}
+
+	if (command.quiet)
+		SetVerbosity(Verbosity::Quiet);
+	else if (command.verbose)
+		SetVerbosity(Verbosity::Verbose);
+
+	// With --nologo nothing is written through iostream unless there is an error
+	if (!command.nologo)
 	{
 		std::cout << std::endl << "ASM Formatter " << version << " https://github.com/metablaster/ASM-Formatter" << std::endl;
-		std::cout << "Copyright (C) 2023 metablaster (zebal@protonmail.ch)" << std::endl;
+		std::cout << "Copyright (C) 2023 metablaster (zebal@protonmail.ch)" << std::endl << std::endl;
 	}
 
-	if (argc < (nologo ? 3 : 2))
+	if (argc < (command.nologo ? 3 : 2))
 	{
 		std::cerr << std::endl << "Usage: " << std::endl << std::endl;
 		std::cerr << executable_name << syntax << std::endl;
@@ -105,7 +385,7 @@ int main(int argc, char* argv[]) try
 	}
 
 	// Show help if --help was specified
-	if (std::find(all_params.begin(), all_params.end(), "--help") != all_params.end())
+	if (command.help)
 	{
 		std::cout << std::endl << "Syntax:" << std::endl;
 		std::cout << std::endl << executable_name << syntax << std::endl << std::endl;
@@ -113,11 +393,29 @@ int main(int argc, char* argv[]) try
 		std::cout << " --path\t\tExplicitly specify path to file" << std::endl;
 		std::cout << " --directory\tSpecify directory which to search for *.asm files to format" << std::endl;
 		std::cout << " --recurse\tRecurse into directory specified by --directory" << std::endl;
+		std::cout << " --include\tFormat files found by --directory which match GLOB (default: *.asm)" << std::endl;
+		std::cout << " --exclude\tSkip files and directories found by --directory which match GLOB" << std::endl;
+		std::cout << " --follow-includes\tFormat files included by INCLUDE directive of files to format" << std::endl;
+		std::cout << " --changed-since\tFormat files changed in git repository since merge base of REF and HEAD" << std::endl;
+		std::cout << " --watch\tWatch directory and format *.asm and *.inc files as soon as they are saved" << std::endl;
+		std::cout << " --report\tWrite JSON report about each formatted file and totals of the run to FILE" << std::endl;
+		std::cout << " --trace\tWrite trace events of each thread to FILE in Chrome trace event format" << std::endl;
+		std::cout << " --shard\tFormat only shard I of N shards of specified files, shards are balanced by file size" << std::endl;
 		std::cout << " --encoding\tSpecifies the default encoding used to read and write files (default: ansi)" << std::endl;
 		std::cout << " --tabwidth\tSpecifies tab width used in source files (default: 4)" << std::endl;
 		std::cout << " --spaces\tUse spaces instead of tabs (by default tabs are used)" << std::endl;
 		std::cout << " --linebreaks\tPerform line breaks conversion (by default line breaks are preserved)" << std::endl;
 		std::cout << " --compact\tReplaces all surplus blank lines with single blank line" << std::endl;
+		std::cout << " --normalize\tReplace whitespace between code tokens with tabs or spaces, depending on --spaces option" << std::endl;
+		std::cout << " --global-align\tAlign inline comments of all files to the same column" << std::endl;
+		std::cout << " --verify\tVerify that only whitespace was changed before writing a file (default)" << std::endl;
+		std::cout << " --noverify\tDon't verify formatted files" << std::endl;
+		std::cout << " --kernels\tUse kernels of specified instruction set instead of the newest one supported by processor" << std::endl;
+		std::cout << " --stats\tPrint statistics of the run once all files are formatted" << std::endl;
+		std::cout << " --server\tKeep running and format files forwarded by clients trough named pipe" << std::endl;
+		std::cout << " --quiet\tDon't print options used and files being formatted, errors are still shown" << std::endl;
+		std::cout << " --verbose\tPrint additional details about each file being formatted" << std::endl;
+		std::cout << " --batch\tDon't ask how to deal with errors, report them per file once all files are formatted" << std::endl;
 		std::cout << " --version\tShows program version" << std::endl;
 		std::cout << " --nologo\tSuppresses the display of the program banner, version and Copyright when the " << executable_name << " starts up" << std::endl;
 		std::cout << " --help\t\tDisplays this help" << std::endl;
@@ -130,9 +428,39 @@ int main(int argc, char* argv[]) try
 		std::cout << "also working directory of asmformat is searched." << std::endl;
 		std::cout << "Otherwise if you specify full path to file name without --path the behavior is same." << std::endl << std::endl;
 
+		std::cout << "--include and --exclude options may be specified multiple times, globs use .gitignore syntax and are case insensitive." << std::endl;
+		std::cout << "--directory also skips files and directories listed in " << StringCast(std::wstring(IGNORE_FILE_NAME)) << " file of any searched directory." << std::endl;
+		std::cout << "Excluded and ignored directories are not searched, files specified by other options are not filtered." << std::endl << std::endl;
+
+		std::cout << "Each file is formatted once even if it's specified by several options or found trough overlapping directories." << std::endl;
+		std::cout << "--follow-includes option adds files named by INCLUDE directives, included files are followed as well." << std::endl;
+		std::cout << "INCLUDE is resolved relative to directory of the file which contains it and then to current working directory," << std::endl;
+		std::cout << "directories of INCLUDE environment variable are not searched so that SDK headers are not formatted." << std::endl << std::endl;
+
+		std::cout << "--changed-since option asks git in current working directory for files changed since merge base of REF and HEAD," << std::endl;
+		std::cout << "which includes committed, staged, unstaged and untracked files, deleted files are skipped." << std::endl;
+		std::cout << "Changed files are selected by --include, --exclude and .asmformatignore same as by --directory." << std::endl;
+		std::cout << "If no such files were changed there is nothing to format which is not an error." << std::endl << std::endl;
+
+		std::cout << "--watch option keeps " << executable_name << " running and formats *.asm and *.inc files in DIR whenever they change," << std::endl;
+		std::cout << "subdirectories are watched as well if --recurse is specified, use CTRL + C to stop watching." << std::endl;
+		std::cout << "--include, --exclude and ignore files select watched files, *.inc files are then watched only if included." << std::endl;
+		std::cout << "File which fails to format is reported and watching continues." << std::endl << std::endl;
+
+		std::cout << "--report option records path, BOM, encoding, size, line count, status and time spent in each phase for every file," << std::endl;
+		std::cout << "followed by totals and throughput of the run. In watch mode only files formatted before watching starts are reported." << std::endl << std::endl;
+
+		std::cout << "--trace option records time spans of loading, decoding, both formatting passes, encoding and writing of every file," << std::endl;
+		std::cout << "FILE can be opened with chrome://tracing or https://ui.perfetto.dev, watch mode is not traced." << std::endl << std::endl;
+
+		std::cout << "--shard option splits files between N runs, ex. CI runners, each run formats the files of shard I." << std::endl;
+		std::cout << "Runs which are given same files compute same shards, files are assigned largest first to the shard with the least bytes." << std::endl;
+		std::cout << "Shard is recorded in report, watch mode is not sharded." << std::endl << std::endl;
+
 		std::cout << "--encoding option is ignored if file encoding is auto detected, in which case a message is printed" << std::endl;
 		std::cout << "telling that the option was ignored in favor of actual file encoding." << std::endl << std::endl;
 
+		std::cout << "--linebreaks option converts LF, CRLF and CR line breaks alike, thus files with mixed line breaks are normalized." << std::endl;
 		std::cout << "--linebreaks option doesn't have any effect on UTF-16 encoded files, UTF-16 files are always formatted with CRLF." << std::endl;
 		std::cout << "By default line breaks are preserved if not specified." << std::endl << std::endl;
 
@@ -144,200 +472,141 @@ int main(int argc, char* argv[]) try
 		std::cout << "whether you'll use that option or not depends on whether your sources are formatted with spaces or tabs?" << std::endl;
 		std::cout << "The default tab width, if not specified is 4." << std::endl;
 		std::cout << "Note that tab width option also affects spaces, that is, how many spaces are used for tab in existing sources?" << std::endl << std::endl;;
+		std::cout << "--normalize option converts whitespace between mnemonic, operands and other code tokens to tabs or spaces" << std::endl;
+		std::cout << "which occupy the same columns, text in quotes is not modified." << std::endl;
+		std::cout << "Inline comments are aligned according to displayed width of code, that is, tabs in code are expanded to tab stops." << std::endl << std::endl;
+
+		std::cout << "--global-align option aligns inline comments according to the widest code of all specified files rather than of each file." << std::endl;
+		std::cout << "All files are read concurrently up front and kept in memory until formatted, concurrently in batch mode, files are not read twice." << std::endl;
+		std::cout << "In watch mode files which change are aligned to the column computed up front unless their code is wider." << std::endl << std::endl;
+
+		std::cout << "--verify option compares each file before and after formatting with whitespace between code tokens ignored," << std::endl;
+		std::cout << "quoted literals and comment text must be unchanged except for whitespace which surrounds the comment." << std::endl;
+		std::cout << "If anything other than whitespace or line breaks was changed an error is shown and the file is not written." << std::endl;
+		std::cout << "Verification is enabled by default, --noverify disables it." << std::endl << std::endl;
+
+		std::cout << "Line breaks, whitespace and ASCII text are processed by kernels vectorized with SSE2, AVX2 or AVX-512," << std::endl;
+		std::cout << "the newest instruction set supported by processor is used. --kernels option selects older instruction set for benchmarking," << std::endl;
+		std::cout << "instruction set not supported by processor is an error. --stats option prints instruction set of kernels in use" << std::endl;
+		std::cout << "and bytes of file buffers copied, ANSI file is copied once and UTF-8 file is not copied only converted." << std::endl << std::endl;
+
+		std::cout << "--server option keeps " << executable_name << " running with one thread per processor which format files on behalf of clients," << std::endl;
+		std::cout << "pipe name is taken from ASMFORMAT_SERVER environment variable, or asmformat if not set, use CTRL + C to stop the server." << std::endl;
+		std::cout << "If ASMFORMAT_SERVER is set " << executable_name << " is a client which sends paths, options and working directory to the server" << std::endl;
+		std::cout << "and shows errors which server returns, if no server is running files are formatted in process." << std::endl;
+		std::cout << "--report, --trace, --watch, --stats and --kernels options are always run in process." << std::endl << std::endl;
+
+		std::cout << "--batch option is implied if standard input is redirected, in batch mode formatting continues with the next file" << std::endl;
+		std::cout << "on error and exit code is that of the worst error encountered." << std::endl << std::endl;
 
 		std::cout << "If you specify same option more than once, ex by mistake, the last one is used." << std::endl;
 		std::cout << "--path and --directory options if specified multiple times and all will be processed." << std::endl;
 		return 0;
 	}
 
-	// Default values
-	bool spaces = false;
-	// TODO: There could multiple verbosities of compact
-	// ex. lvl 2, removing all blanks completely prior to formatting
-	bool compact = false;
-	std::size_t tabwidth = 4;
-	Encoding default_encoding = Encoding::ANSI;
-	LineBreak linebreaks = LineBreak::Preserve;
-
-	std::vector<fs::path> files;
-	std::cout << std::endl;
-
-	for (int i = 1; i < argc; ++i)
+	if (command.error != ErrorCode::Success)
 	{
-		std::string param = argv[i];
+		ShowError(command.error, command.error_message);
+		return ExitCode(command.error);
+	}
 
-		if (param.starts_with("--"))
-		{
-			if (param == "--nologo")
-			{
-				continue;
-			}
-			else if (param == "--spaces")
-			{
-				spaces = true;
-				std::cout << "using --spaces option" << std::endl;
-				continue;
-			}
-			else if (param == "--compact")
-			{
-				compact = true;
-				std::cout << "using --compact option" << std::endl;
-				continue;
-			}
-			else if (param == "--recurse")
-			{
-				continue;
-			}
+	if (options.spaces)
+		Log() << "using --spaces option";
 
-			std::string arg{ };
+	if (options.compact)
+		Log() << "using --compact option";
 
-			// Make sure we aren't at the end of argv
-			if ((i + 1) != argc)
-				arg = argv[++i];
+	if (options.normalize)
+		Log() << "using --normalize option";
 
-			// Make sure argument doesn't use option syntax
-			const bool noarg = arg.starts_with("--");
+	if (command.global_align)
+		Log() << "using --global-align option";
 
-			if (param == "--encoding")
-			{
-				if (arg.empty())
-					goto endofcommand;
+	if (!options.verify)
+		Log() << "using --noverify option";
 
-				if (noarg)
-					goto noargerror;
+	if (command.kernels && !SelectKernels(*command.kernels))
+	{
+		ShowError(ErrorCode::UnsuportedOperation, std::string("Processor doesn't support ") + IsaToString(*command.kernels) + " kernels, the newest supported are " + IsaToString(GetSupportedIsa()));
+		return ExitCode(ErrorCode::UnsuportedOperation);
+	}
 
-				if (arg == "utf8")
-				{
-					default_encoding = Encoding::UTF8;
-				}
-				else if (arg == "utf16le")
-				{
-					default_encoding = Encoding::UTF16LE;
-				}
-				else if (arg != "ansi")
-				{
-					ShowError(ErrorCode::InvalidOptionArgument, "The specified encoding '" + arg + "' was not recognized");
-					return ExitCode(ErrorCode::InvalidOptionArgument);
-				}
-				// This is needed if --encoding was specified more than once
-				else default_encoding = Encoding::ANSI;
-			}
-			else if (param == "--tabwidth")
-			{
-				if (arg.empty())
-					goto endofcommand;
+	Log(Verbosity::Verbose) << "using " << IsaToString(GetKernels().isa) << " kernels";
 
-				if (noarg)
-					goto noargerror;
+	if (options.line_break != LineBreak::Preserve)
+		Log() << "forcing " << (options.line_break == LineBreak::CRLF ? "crlf" : options.line_break == LineBreak::LF ? "lf" : "cr") << " line breaks";
 
-				const std::size_t width = static_cast<std::size_t>(std::stoi(arg));
+	// Options of clients are sent with each request, server doesn't forward to another server
+	if (command.server)
+	{
+		const ErrorCode status = RunServer(GetServerPipe(L"asmformat"));
 
-				if (width < 1)
-				{
-					ShowError(ErrorCode::InvalidOptionArgument, "Tab width must be a number grater than zero");
-					return ExitCode(ErrorCode::InvalidOptionArgument);
-				}
+		RestoreConsoleCodePage();
+		return ExitCode(status);
+	}
 
-				tabwidth = width;
-			}
-			else if (param == "--linebreaks")
-			{
-				if (arg.empty())
-					goto endofcommand;
+	std::vector<fs::path> files;
+	// Set if --changed-since was specified in which case no files to format is not an error
+	bool changed_since = false;
+	// Directory to watch for changes if --watch was specified
+	fs::path watch_directory;
 
-				if (noarg)
-					goto noargerror;
+	// Globs are compiled once for all directories, command line is in ANSI code page while globs match UTF-8 names
+	FileFilter filter;
 
-				if (arg == "crlf")
-				{
-					linebreaks = LineBreak::CRLF;
-				}
-				else if (arg == "lf")
-				{
-					linebreaks = LineBreak::LF;
-				}
-				else if (arg == "cr")
-				{
-					ShowError(ErrorCode::NotImplemented, "CR linebreak is not implemented");
-					return ExitCode(ErrorCode::NotImplemented);
-				}
-				else
-				{
-					ShowError(ErrorCode::InvalidOptionArgument, "The specified linebreak '" + arg + "' was not recognized");
-					return ExitCode(ErrorCode::InvalidOptionArgument);
-				}
+	for (const std::string& glob : command.include)
+		filter.include.emplace_back(StringCast(StringCast(glob, CP_ACP)));
 
-				std::cout << "forcing " << arg << " line breaks" << std::endl;
-			}
-			else if (param == "--directory")
-			{
-				if (arg.empty())
-					goto endofcommand;
+	for (const std::string& glob : command.exclude)
+		filter.exclude.emplace_back(StringCast(StringCast(glob, CP_ACP)));
 
-				if (noarg)
-					goto noargerror;
+	if (filter.include.empty())
+		filter.include.emplace_back("*.asm");
 
-				if (fs::is_directory(arg))
-				{
-					if (std::find(all_params.begin(), all_params.end(), "--recurse") != all_params.end())
-						for (const auto& dir_entry : fs::recursive_directory_iterator(arg))
-						{
-							if (dir_entry.path().extension() == ".asm")
-								files.push_back(dir_entry.path());
-						}
-					else for (const auto& dir_entry : fs::directory_iterator(arg))
-						if (dir_entry.path().extension() == ".asm")
-							files.push_back(dir_entry.path());
-
-					if (files.empty())
-						ShowError(Exception(ErrorCode::BadResult, "Directory " + arg + " contains no *.asm files"), ERROR_INFO, MB_ICONINFORMATION);
-				}
-				else
-				{
-					ShowError(Exception(ErrorCode::InvalidCommand, param + " is not a directory and was ignored"), ERROR_INFO, MB_ICONINFORMATION);
-				}
-			}
-			else if (param == "--path")
+	for (const auto& [kind, arg] : command.inputs)
+	{
+		switch (kind)
+		{
+		case InputKind::Directory:
+			if (fs::is_directory(arg))
 			{
-				if (arg.empty())
-					goto endofcommand;
-
-				if (noarg)
-					goto noargerror;
-
-				if (fs::exists(arg))
-				{
-					files.push_back(arg);
-				}
-				else
-				{
-					ShowError(ErrorCode::InvalidCommand, "File '" + arg + "' was not found");
-					return ExitCode(ErrorCode::InvalidCommand);
-				}
+				if (FindFiles(arg, command.recurse, filter, files) == 0)
+					ShowError(Exception(ErrorCode::BadResult, "Directory " + arg + " contains no files to format"), ERROR_INFO, MB_ICONINFORMATION);
 			}
 			else
 			{
-				ShowError(ErrorCode::UnknownOption, "option '" + param + "' was not recognized");
-				return ExitCode(ErrorCode::UnknownOption);
+				ShowError(Exception(ErrorCode::InvalidCommand, arg + " is not a directory and was ignored"), ERROR_INFO, MB_ICONINFORMATION);
 			}
+			break;
+		case InputKind::ChangedSince:
+		{
+			const std::size_t count = files.size();
+			changed_since = true;
 
-			continue;
-
-		endofcommand:
-			// Will happen when a valid option is at the end without an argument
-			ShowError(ErrorCode::InvalidOptionArgument, param + " option requires one argument");
-			return ExitCode(ErrorCode::InvalidOptionArgument);
+			if (!GetChangedFiles(arg, filter, files))
+				return ExitCode(ErrorCode::FunctionFailed);
 
-		noargerror:
-			ShowError(ErrorCode::InvalidOptionArgument, "An argument was expected for " + param + " option but '" + arg + "' was encountered");
-			return ExitCode(ErrorCode::InvalidOptionArgument);
+			Log() << files.size() - count << " files to format changed since " << arg;
+			break;
 		}
-		else
+		case InputKind::Path:
+			if (fs::exists(arg))
+			{
+				files.push_back(arg);
+			}
+			else
+			{
+				ShowError(ErrorCode::InvalidCommand, "File '" + arg + "' was not found");
+				return ExitCode(ErrorCode::InvalidCommand);
+			}
+			break;
+		case InputKind::File:
+		default:
 		{
-			fs::path file_path = param;
+			fs::path file_path = arg;
 			if (fs::is_directory(file_path))
 			{
-				ShowError(Exception(ErrorCode::InvalidCommand, param + " is directory and was ignored"), ERROR_INFO, MB_ICONINFORMATION);
+				ShowError(Exception(ErrorCode::InvalidCommand, arg + " is directory and was ignored"), ERROR_INFO, MB_ICONINFORMATION);
 				continue;
 			}
 			else if (fs::exists(file_path))
@@ -359,133 +628,197 @@ int main(int argc, char* argv[]) try
 					return ExitCode(ErrorCode::InvalidCommand);
 				}
 			}
+			break;
+		}
 		}
 	}
 
-	if (files.empty())
+	if (!command.watch_directory.empty())
+	{
+		if (!fs::is_directory(command.watch_directory))
+		{
+			ShowError(ErrorCode::InvalidCommand, "Directory '" + command.watch_directory + "' was not found");
+			return ExitCode(ErrorCode::InvalidCommand);
+		}
+
+		watch_directory = fs::absolute(command.watch_directory);
+	}
+
+	// Same file may be specified by several options or found trough overlapping directories
+	if (const std::size_t count = RemoveDuplicateFiles(files); count != 0)
+		Log() << count << " duplicate files were removed";
+
+	if (command.follow_includes)
+		Log() << FollowIncludes(files, options.encoding) << " included files were added";
+
+	if (command.shard.count != 0)
+	{
+		const std::size_t count = files.size();
+		const std::uintmax_t bytes = SelectShard(command.shard, files);
+
+		Log() << "shard " << ShardToString(command.shard) << " has " << files.size() << " of " << count << " files, " << bytes << " bytes";
+	}
+
+	// In watch mode there may be nothing to format up front, only files which are going to change
+	if (files.empty() && changed_since && watch_directory.empty())
+	{
+		Log() << "No changed files to format";
+		return 0;
+	}
+	// Shards are balanced by size, with fewer files than shards some shards are empty
+	else if (files.empty() && (command.shard.count != 0) && watch_directory.empty())
+	{
+		Log() << "No files to format in shard " << ShardToString(command.shard);
+		return 0;
+	}
+	else if (files.empty() && watch_directory.empty())
 	{
 		ShowError(Exception(ErrorCode::InvalidCommand, "No files were specified to format"), ERROR_INFO, MB_ICONINFORMATION);
 		return ExitCode(ErrorCode::InvalidCommand);
 	}
 
-	std::cout << "using tab width of " << tabwidth << std::endl;
-	std::cout << "using "<< EncodingToString(default_encoding) << " encoding" << std::endl;
+	Log() << "using tab width of " << options.tab_width;
+	Log() << "using " << EncodingToString(options.encoding) << " encoding";
 
-	Encoding encoding = default_encoding;
-	std::vector<unsigned char> bom_bytes;
+	// Options which collect per process data or keep running are not forwarded to server
+	const std::wstring server_pipe = GetServerPipe();
 
-	for (const auto& file_path : files)
+	if (!server_pipe.empty() && command.report_file.empty() && command.trace_file.empty() && watch_directory.empty() && !command.stats && !command.kernels)
 	{
-		const BOM bom = GetBOM(file_path, bom_bytes);
-		const Encoding file_encoding = BomToEncoding(bom);
+		std::vector<ServerResult> results;
 
-		switch (file_encoding)
+		if (FormatOnServer(server_pipe, files, options, command.global_align, results))
 		{
-		case Encoding::UTF8:
-		case Encoding::UTF16LE:
-			if (encoding != file_encoding)
+			Log(Verbosity::Verbose) << "files were formatted by server " << StringCast(server_pipe);
+
+			for (std::size_t index = 0; index < files.size(); ++index)
 			{
-				encoding = file_encoding;
-				std::cout << EncodingToString(default_encoding) + " encoding option was ignored for file " + file_path.filename().string() + ", file is encoded as " + BomToString(bom) << std::endl;
-			}
-			break;
-		case Encoding::Unsupported:
-			goto invalid_encoding;
-		case Encoding::Unknown:
-			// TODO: Function to detect encoding based on file contents
-			// BOM not found in file, use default or user specified encoding
-			break;
-		case Encoding::ANSI:
-			// No such thing as "ANSI BOM"
-			assert(false);
-			break;
-		default:
-			// Use default or user specified encoding
-			break;
-		}
+				const ServerResult& result = results.at(index);
 
-		std::cout << "Formatting file " << file_path.filename() << std::endl;
+				if (result.code == ErrorCode::Success)
+					continue;
 
-		switch (encoding)
-		{
-		case Encoding::UTF8:
-		{
-			const bool has_bom = bom == BOM::utf8;
-			// Either user specified or no BOM
-			assert(has_bom || (bom == BOM::none));
+				const ErrorContext context(files.at(index).string());
+
+				// Message was formatted by server as if the file was formatted in process
+				if (result.message.empty())
+					ShowError(result.code, "Failed to format file " + files.at(index).string());
+				else ShowErrorMessage(result.code, result.message);
+
+				// Server stopped formatting on this file as well
+				if ((result.code == ErrorCode::FunctionFailed) && (GetErrorPolicy() != ErrorPolicy::Batch))
+				{
+					RestoreConsoleCodePage();
+					return ExitCode(ErrorCode::FunctionFailed);
+				}
+			}
 
-			if (!SetConsoleCodePage(default_CP.first, CP_UTF8))
+			if (!RestoreConsoleCodePage())
 				return ExitCode(ErrorCode::FunctionFailed);
 
-			std::string filebytes = LoadFileBytes(file_path);
-			std::wstringstream filedata(StringCast(filebytes));
+			return ReportErrors();
+		}
 
-			FormatFileW(filedata, tabwidth, spaces, compact, linebreaks);
+		Log(Verbosity::Verbose) << "format server " << StringCast(server_pipe) << " is not running, formatting in process";
+	}
 
-			if (has_bom)
-				WriteFileBytes(file_path, bom_bytes, false);
+	if (!command.report_file.empty() && !OpenReport(command.report_file, command.shard.count == 0 ? "" : ShardToString(command.shard)))
+		return ExitCode(ErrorCode::FunctionFailed);
 
-			filebytes = StringCast(filedata.str());
-			WriteFileBytes(file_path, filebytes, has_bom);
-			break;
-		}
-		case Encoding::UTF16LE:
-		{
-			// If there is no BOM don't assume
-			assert(bom == BOM::utf16le);
+	if (!command.trace_file.empty() && !StartTrace(command.trace_file))
+	{
+		CloseReport();
+		return ExitCode(ErrorCode::FunctionFailed);
+	}
 
-			if (!SetConsoleCodePage(default_CP.first, default_CP.second))
-				return ExitCode(ErrorCode::FunctionFailed);
+	const bool batch = GetErrorPolicy() == ErrorPolicy::Batch;
 
-			std::wstringstream filedata(LoadFile<std::wstring>(file_path, encoding));
-			FormatFileW(filedata, tabwidth, spaces, compact, linebreaks);
+	// Contents of files loaded by the pre-pass, each is released once the file is formatted
+	std::vector<std::optional<std::string>> contents;
 
-			#if TRUE
-			// TODO: Converts from LF to CRLF
-			WriteFile(file_path, filedata.str(), encoding);
-			#else
-			// TODO: Not working
-			if (bom == BOM::utf16le)
-				WriteFileBytes(file_path, bom_bytes, false);
+	if (command.global_align)
+	{
+		options.code_width = GetGlobalCodeWidth(files, options, contents);
+		Log() << "aligning inline comments to code width of " << options.code_width;
 
-			std::string converted = StringCast(filedata.str());
-			WriteFileBytes(file_path, converted, bom == BOM::utf16le);
-			#endif
-			break;
-		}
-		case Encoding::ANSI:
-		case Encoding::Unknown:
+		// Files are formatted from contents loaded by the pre-pass, concurrently in batch mode
+		if (FormatSourceFiles(files, options, contents) == ErrorCode::FunctionFailed)
 		{
-			assert(bom == BOM::none);
+			StopTrace();
+			CloseReport();
+			return ExitCode(ErrorCode::FunctionFailed);
+		}
+	}
 
-			if (!SetConsoleCodePage(default_CP.first, default_CP.second))
-				return ExitCode(ErrorCode::FunctionFailed);
+	for (std::size_t index = 0; (index < files.size()) && !command.global_align; ++index)
+	{
+		const fs::path& file_path = files.at(index);
 
-			std::stringstream filedata(LoadFileBytes(file_path.string()));
+		// In batch mode one bad file must not stop formatting of remaining files
+		try
+		{
+			if ((FormatSourceFile(file_path, options, contents.empty() ? std::nullopt : std::move(contents.at(index))) == ErrorCode::FunctionFailed) && !batch)
+			{
+				StopTrace();
+				CloseReport();
+				return ExitCode(ErrorCode::FunctionFailed);
+			}
+		}
+		catch (Exception& custom)
+		{
+			if (!batch)
+				throw;
 
-			FormatFileA(filedata, tabwidth, spaces, compact, linebreaks);
-			WriteFileBytes(file_path, filedata.str(), false);
-			break;
+			const ErrorContext context(file_path.string());
+			ShowError(custom, ERROR_INFO);
 		}
-		case Encoding::Unsupported:
-		default:
-			goto invalid_encoding;
+		catch (const std::exception& ex)
+		{
+			if (!batch)
+				throw;
+
+			const ErrorContext context(file_path.string());
+			ShowError(ex, ERROR_INFO);
 		}
+	}
+
+	// Report and trace are complete once all specified files are formatted
+	StopTrace();
+	CloseReport();
+
+	if (command.stats)
+		PrintStats();
+
+	if (!watch_directory.empty())
+	{
+		// Errors of files formatted up front are shown before watching starts
+		const int initial = ReportErrors();
+
+		// Include files are edited as often as sources, unless globs say otherwise
+		FileFilter watch_filter = filter;
+		if (command.include.empty())
+			watch_filter.include.emplace_back("*.inc");
+
+		const ErrorCode status = WatchDirectory(watch_directory, command.recurse, watch_filter, options);
+
+		RestoreConsoleCodePage();
+
+		// Errors recorded in batch mode since the last batch of changes was reported
+		const int reported = ReportErrors();
 
-		encoding = default_encoding;
-		continue;
+		if (status != ErrorCode::Success)
+			return ExitCode(status);
 
-	invalid_encoding:
-		ShowError(ErrorCode::UnsuportedOperation, EncodingToString(encoding) + " was specified but file " + file_path.filename().string() + " is encoded as " + BomToString(bom));
-		encoding = default_encoding;
+		return (reported != 0) ? reported : initial;
 	}
 
-	if (!SetConsoleCodePage(default_CP.first, default_CP.second))
+	if (!RestoreConsoleCodePage())
 	{
 		return ExitCode(ErrorCode::FunctionFailed);
 	}
 
-	return 0;
+	// Errors recorded in batch mode, if any
+	return ReportErrors();
 }
 // Those exit codes won't be returned if the user chooses to exit or if there is an exception in ShowError
 catch (Exception& custom)
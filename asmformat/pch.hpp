@@ -26,6 +26,11 @@
 #include <Windows.h>
 #include <comdef.h>		// _com_error (error.cpp)
 #include <strsafe.h>	// StringCbCopyA (error.cpp)
+#include <Psapi.h>		// GetProcessMemoryInfo (Process.cpp)
+#include <winmeta.h>	// WINEVENT_OPCODE_START (Probes.hpp)
+#include <TraceLoggingProvider.h>	// TraceLoggingWrite (Probes.hpp)
+#include <evntrace.h>	// StartTraceW (Counters.cpp)
+#include <evntcons.h>	// EVENT_RECORD (Counters.cpp)
 
 // C++ Standard Header Files
 #include <iostream>
@@ -49,6 +54,25 @@
 #include <cstring>		// std::strrchr (ErrorMacros.hpp)
 #include <algorithm>	// std::find, std::min (main.cpp, SourceFile.hpp)
 #include <clocale>		// std::setlocale (StringCast.cpp)
+#include <set>			// std::set (watch.cpp)
+#include <unordered_map>	// std::unordered_map (watch.cpp)
+#include <thread>		// std::thread (Logger.cpp)
+#include <mutex>		// std::mutex (Logger.cpp)
+#include <condition_variable>	// std::condition_variable (Logger.cpp)
+#include <deque>		// std::deque (Logger.cpp)
+#include <atomic>		// std::atomic (Logger.cpp)
+#include <cstdio>		// std::fwrite (Logger.cpp)
+#include <chrono>		// std::chrono::steady_clock (Report.hpp)
+#include <iomanip>		// std::setprecision (Report.cpp)
+#include <functional>	// std::function (ThreadPool.hpp)
+#include <span>			// std::span (libasmformat.cpp)
+#include <cstdlib>		// std::malloc (libasmformat.cpp)
+#include <string_view>	// std::string_view (Verify.hpp)
+#include <numeric>		// std::accumulate (Statistics.cpp)
+#include <fstream>		// std::ifstream (Startup.cpp)
+#include <charconv>		// std::from_chars (Shard.cpp)
+#include <optional>		// std::optional (Formatter.hpp)
+#include <random>		// std::mt19937 (Scaling.cpp)
 
 // C Standard header files
 #include <stdio.h>		// fopen_s (SourceFile.cpp)
@@ -89,4 +89,43 @@ namespace wsl
 
 		source.swap(new_string);
     }
+
+	std::string JsonEscape(const std::string& value)
+	{
+		std::string result;
+		result.reserve(value.size());
+
+		for (const char ch : value)
+		{
+			switch (ch)
+			{
+			case '"':
+				result += "\\\"";
+				break;
+			case '\\':
+				result += "\\\\";
+				break;
+			case '\n':
+				result += "\\n";
+				break;
+			case '\r':
+				result += "\\r";
+				break;
+			case '\t':
+				result += "\\t";
+				break;
+			default:
+				if (static_cast<unsigned char>(ch) < 0x20)
+				{
+					std::array<char, 7> escaped{ };
+					std::snprintf(escaped.data(), escaped.size(), "\\u%04x", static_cast<unsigned>(ch));
+					result += escaped.data();
+				}
+				else result += ch;
+				break;
+			}
+		}
+
+		return result;
+	}
 }
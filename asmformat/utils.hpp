@@ -127,4 +127,11 @@ namespace wsl
 	 * @param to		Replacement
 	*/
 	void ReplaceAll(std::wstring& source, const std::wstring& from, const std::wstring& to);
+
+	/**
+	 * @brief			Escape string for use as JSON string value
+	 * @param value		UTF-8 string which to escape
+	 * @return			Escaped string without quotes
+	*/
+	[[nodiscard]] std::string JsonEscape(const std::string& value);
 }
@@ -0,0 +1,335 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\watch.cpp
+ *
+ * Function definitions used to watch directory for changes to source files
+ *
+*/
+
+#include "pch.hpp"
+#include "watch.hpp"
+#include "SourceFile.hpp"
+#include "Filter.hpp"
+#include "Logger.hpp"
+#include "error.hpp"
+using namespace wsl;
+namespace fs = std::filesystem;
+
+
+/**
+ * @brief			Compute hash of file contents
+ * @param filepath	File which to hash
+ * @return			Hash of file bytes
+*/
+static std::size_t GetFileHash(const fs::path& filepath)
+{
+	// File which can't be read hashes as empty, formatting it reports the error
+	return std::hash<std::string>{ }(LoadFileBytes(filepath).value_or(std::string()));
+}
+
+/**
+ * @brief Directory opened for change notifications, owns the buffer into which notifications are read.
+ * Pending read is cancelled and completed before the buffer is released, system would otherwise write to it
+*/
+class DirectoryReader
+{
+	//
+	// Constructors
+	//
+public:
+	/**
+	 * @brief				Take ownership of handles
+	 * @param hDirectory	Directory opened with FILE_FLAG_OVERLAPPED
+	 * @param hEvent		Manual reset event signaled when notifications are available
+	*/
+	DirectoryReader(HANDLE hDirectory, HANDLE hEvent) noexcept :
+		mDirectory(hDirectory),
+		mEvent(hEvent)
+	{
+		mOverlapped.hEvent = hEvent;
+	}
+
+	~DirectoryReader()
+	{
+		if (mPending)
+		{
+			DWORD bytes_returned = 0;
+			// Read is complete once result is retrieved, whether it was canceled or completed meanwhile
+			CancelIoEx(mDirectory, &mOverlapped);
+			GetOverlappedResult(mDirectory, &mOverlapped, &bytes_returned, TRUE);
+		}
+
+		CloseHandle(mEvent);
+		CloseHandle(mDirectory);
+	}
+
+	DirectoryReader(const DirectoryReader&) = delete;
+	DirectoryReader(DirectoryReader&&) = delete;
+
+	//
+	// Operators
+	//
+public:
+	DirectoryReader& operator=(const DirectoryReader&) = delete;
+	DirectoryReader& operator=(DirectoryReader&&) = delete;
+
+	//
+	// Public methods
+	//
+public:
+	/**
+	 * @brief			Start reading change notifications, event is signaled once they're available
+	 * @param recurse	Watch subdirectories as well?
+	 * @return			true if read was started
+	*/
+	[[nodiscard]] bool Read(bool recurse) noexcept
+	{
+		mPending = ReadDirectoryChangesW(mDirectory, mBuffer.data(), static_cast<DWORD>(mBuffer.size()), recurse ? TRUE : FALSE,
+			FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE, nullptr, &mOverlapped, nullptr) != FALSE;
+
+		return mPending;
+	}
+
+	/**
+	 * @brief					Complete read once event is signaled
+	 * @param bytes_returned	Receives size of notifications in buffer, 0 if notifications overflowed the buffer
+	 * @return					true if read succeeded
+	*/
+	[[nodiscard]] bool Complete(DWORD& bytes_returned) noexcept
+	{
+		mPending = false;
+		ResetEvent(mEvent);
+
+		return GetOverlappedResult(mDirectory, &mOverlapped, &bytes_returned, FALSE) != FALSE;
+	}
+
+	/** Wait for event to be signaled */
+	[[nodiscard]] DWORD Wait(DWORD milliseconds) const noexcept
+	{
+		return WaitForSingleObject(mEvent, milliseconds);
+	}
+
+	/** Change notifications read by last completed read */
+	[[nodiscard]] const BYTE* Data() const noexcept
+	{
+		return mBuffer.data();
+	}
+
+	//
+	// Members
+	//
+private:
+	HANDLE mDirectory;
+	HANDLE mEvent;
+	OVERLAPPED mOverlapped{ };
+	// Is read in progress
+	bool mPending = false;
+	// MSDN: A pointer to the DWORD-aligned formatted buffer in which the read results are to be returned
+	alignas(DWORD) std::array<BYTE, 64 * 1024> mBuffer{ };
+};
+
+/**
+ * @brief				Parse change notifications and collect source files which need formatting
+ * @param directory		Watched directory to which notified file names are relative
+ * @param filter		Filter which selects watched files
+ * @param buffer		Buffer filled by ReadDirectoryChangesW
+ * @param pending		Set which receives files to format
+*/
+static void CollectChanges(const fs::path& directory, const FileFilter& filter, const BYTE* buffer, std::set<fs::path>& pending)
+{
+	for (;;)
+	{
+		SUPPRESS(26490)	// Don't use reinterpret_cast
+		const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(buffer);
+
+		switch (info->Action)
+		{
+		case FILE_ACTION_ADDED:
+		case FILE_ACTION_MODIFIED:
+		case FILE_ACTION_RENAMED_NEW_NAME:
+		{
+			// MSDN: The file name is in the Unicode character format and is not null-terminated
+			const fs::path file_path = directory / std::wstring(info->FileName, info->FileNameLength / sizeof(WCHAR));
+
+			if (IsWatchedFile(directory, file_path, filter))
+				pending.insert(file_path);
+			break;
+		}
+		case FILE_ACTION_REMOVED:
+		case FILE_ACTION_RENAMED_OLD_NAME:
+		default:
+			break;
+		}
+
+		// MSDN: The number of bytes that must be skipped to get to the next record.
+		// A value of zero indicates that this is the last record
+		if (info->NextEntryOffset == 0)
+			break;
+
+		buffer += info->NextEntryOffset;
+	}
+}
+
+/**
+ * @brief				Collect all watched files in directory, used when change notifications were lost
+ * @param directory		Watched directory
+ * @param recurse		Collect files in subdirectories as well?
+ * @param filter		Filter which selects watched files
+ * @param pending		Set which receives files to format
+*/
+static void RescanDirectory(const fs::path& directory, bool recurse, const FileFilter& filter, std::set<fs::path>& pending)
+{
+	// Files which are already formatted are left as is by formatter
+	std::vector<fs::path> files;
+	FindFiles(directory, recurse, filter, files);
+	pending.insert(files.begin(), files.end());
+}
+
+/**
+ * @brief				Format changed file, failure is reported and doesn't stop watching
+ * @param file_path		File which to format
+ * @param options		Formatting options
+ * @return				true if file was formatted
+*/
+static bool FormatChangedFile(const fs::path& file_path, const FormatOptions& options)
+{
+	try
+	{
+		return FormatSourceFile(file_path, options) == ErrorCode::Success;
+	}
+	catch (Exception& custom)
+	{
+		const ErrorContext context(file_path.string());
+		ShowError(custom, ERROR_INFO);
+	}
+	catch (const std::exception& ex)
+	{
+		const ErrorContext context(file_path.string());
+		ShowError(ex, ERROR_INFO);
+	}
+
+	return false;
+}
+
+bool IsWatchedFile(const fs::path& directory, const fs::path& file, const FileFilter& filter)
+{
+	return MatchFile(directory, file, filter);
+}
+
+ErrorCode WatchDirectory(const fs::path& directory, bool recurse, const FileFilter& filter, const FormatOptions& options)
+{
+	HANDLE hDirectory = CreateFileW(
+		directory.c_str(),
+		// Required to use ReadDirectoryChangesW
+		FILE_LIST_DIRECTORY,
+		// Editors must be able to save, rename and delete files in watched directory
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		// Default security
+		nullptr,
+		// Opens a file or device, only if it exists
+		OPEN_EXISTING,
+		// Backup semantics is needed to obtain directory handle and overlapped to be able to wait with timeout
+		FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+		// No attributes template
+		nullptr);
+
+	if (hDirectory == INVALID_HANDLE_VALUE)
+	{
+		ShowError(ERROR_INFO_HR, ("Failed to open directory " + directory.string()).c_str());
+		return ErrorCode::FunctionFailed;
+	}
+
+	// Manual reset event signaled when change notifications are available
+	HANDLE hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+	if (hEvent == nullptr)
+	{
+		ShowError(ERROR_INFO_HR, "Failed to create watch event");
+		CloseHandle(hDirectory);
+		return ErrorCode::FunctionFailed;
+	}
+
+	DirectoryReader reader(hDirectory, hEvent);
+
+	// Files changed since last formatting, formatted once notifications settle
+	std::set<fs::path> pending;
+	// Hash of file contents as last written by formatter, used to ignore our own writes
+	std::unordered_map<std::wstring, std::size_t> written;
+
+	Log() << "watching " << directory.string() << (recurse ? " and subdirectories" : "") << " for changes, press CTRL + C to stop";
+	LogFlush();
+
+	for (bool issue_read = true;;)
+	{
+		if (issue_read)
+		{
+			issue_read = false;
+
+			if (!reader.Read(recurse))
+			{
+				ShowError(ERROR_INFO_HR, ("Failed to watch directory " + directory.string()).c_str());
+				return ErrorCode::FunctionFailed;
+			}
+		}
+
+		// Wait indefinitely unless there are files waiting for the burst of notifications to settle
+		const DWORD wait = reader.Wait(pending.empty() ? INFINITE : WATCH_DEBOUNCE_MS);
+
+		if (wait == WAIT_OBJECT_0)
+		{
+			DWORD bytes_returned = 0;
+
+			if (!reader.Complete(bytes_returned))
+			{
+				ShowError(ERROR_INFO_HR, ("Failed to read changes in directory " + directory.string()).c_str());
+				return ErrorCode::FunctionFailed;
+			}
+
+			// Zero bytes means notifications overflowed the buffer, changed files are unknown
+			if (bytes_returned != 0)
+			{
+				CollectChanges(directory, filter, reader.Data(), pending);
+			}
+			else
+			{
+				Log() << "changes in " << directory.string() << " were lost, formatting all watched files";
+				RescanDirectory(directory, recurse, filter, pending);
+			}
+
+			issue_read = true;
+		}
+		else if (wait == WAIT_TIMEOUT)
+		{
+			for (const fs::path& file_path : pending)
+			{
+				if (!fs::is_regular_file(file_path))
+					continue;
+
+				// Skip notifications caused by formatter writing back the file
+				const auto last_write = written.find(file_path.wstring());
+				if ((last_write != written.end()) && (last_write->second == GetFileHash(file_path)))
+					continue;
+
+				// File which failed to format is formatted again on next change
+				if (FormatChangedFile(file_path, options))
+					written[file_path.wstring()] = GetFileHash(file_path);
+			}
+
+			pending.clear();
+			// Formatting is interactive, show results and errors recorded in batch mode right away
+			LogFlush();
+			static_cast<void>(ReportErrors());
+		}
+		else
+		{
+			ShowError(ERROR_INFO_HR, "Failed to wait for directory changes");
+			return ErrorCode::FunctionFailed;
+		}
+	}
+}
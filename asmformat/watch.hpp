@@ -0,0 +1,50 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file asmformat\watch.hpp
+ *
+ * Function declarations used to watch directory for changes to source files
+ *
+*/
+
+#pragma once
+#include <filesystem>
+#include "Formatter.hpp"
+#include "Filter.hpp"
+#include "ErrorCode.hpp"
+
+
+/**
+ * Time in milliseconds to wait for the burst of change notifications to settle
+ * before files are formatted, editors often write a file several times per save
+*/
+constexpr unsigned long WATCH_DEBOUNCE_MS = 200;
+
+/**
+ * @brief				Check if file is a source file which is formatted in watch mode
+ * @param directory		Watched directory
+ * @param file			File path to check, in watched directory or its subdirectories
+ * @param filter		Include and exclude globs, ignore files in directory are applied as well
+ * @return				true if file is selected by filter
+*/
+[[nodiscard]] bool IsWatchedFile(const std::filesystem::path& directory, const std::filesystem::path& file, const FileFilter& filter);
+
+/**
+ * Watch directory for changes to files selected by filter and format them as soon as they're saved.
+ * Files written back by the formatter are recognized by hash of the output and don't retrigger formatting.
+ * File which fails to format is reported and watching continues, errors recorded in batch mode
+ * are reported after each batch of changes is formatted.
+ * The function returns only on failure to watch, use CTRL + C to stop watching.
+ *
+ * @param directory		Directory which to watch
+ * @param recurse		Watch subdirectories as well?
+ * @param filter		Filter which selects watched files
+ * @param options		Formatting options
+ * @return				Error code which caused watching to stop
+*/
+[[nodiscard]] wsl::ErrorCode WatchDirectory(const std::filesystem::path& directory, bool recurse, const FileFilter& filter, const FormatOptions& options);
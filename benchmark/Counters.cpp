@@ -0,0 +1,458 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file benchmark\Counters.cpp
+ *
+ * Hardware performance counter function definitions
+ *
+*/
+
+#include "pch.hpp"
+#include "Counters.hpp"
+
+
+namespace
+{
+	/**
+	 * @brief Properties of kernel ETW session followed by session name, as required by StartTraceW
+	*/
+	struct SessionProperties
+	{
+		EVENT_TRACE_PROPERTIES properties;
+		wchar_t name[std::size(KERNEL_LOGGER_NAMEW)];
+	};
+
+	/**
+	 * @brief Profile source which is counted as one of HardwareCounters members
+	*/
+	struct ProfileSource
+	{
+		// Name of profile source as reported by TraceQueryInformation
+		std::wstring_view name;
+		// Index of HardwareCounters member
+		std::size_t counter;
+	};
+
+	/**
+	 * @brief Counters of a watched process
+	*/
+	struct WatchedProcess
+	{
+		HardwareCounters counters;
+		// Set once process end event was delivered
+		bool ended = false;
+	};
+
+	// Count of HardwareCounters members
+	constexpr std::size_t counter_count = 4;
+
+	/**
+	 * @brief State of kernel ETW session shared with thread which consumes events
+	*/
+	struct CounterSession
+	{
+		TRACEHANDLE session = 0;
+		TRACEHANDLE consumer = INVALID_PROCESSTRACE_HANDLE;
+		std::thread thread;
+		// Index of each HardwareCounters member in PMC data of an event, counter_count if not counted
+		std::array<std::size_t, counter_count> slots{ };
+		std::mutex mutex;
+		std::condition_variable ended;
+		std::unordered_map<DWORD, WatchedProcess> processes;
+		// Threads of watched processes and process to which they belong
+		std::unordered_map<DWORD, DWORD> threads;
+		// Counter values of previous context switch of each processor
+		std::vector<std::optional<std::array<ULONG64, counter_count>>> previous;
+	};
+}
+
+// Classic kernel event GUIDs, evntrace.h defines them only if INITGUID is defined
+static constexpr GUID system_trace_guid = { 0x9e814aad, 0x3204, 0x11d2, { 0x9a, 0x82, 0x00, 0x60, 0x08, 0xa8, 0x69, 0x39 } };
+static constexpr GUID thread_guid = { 0x3d6fa8d1, 0xfe05, 0x11d0, { 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } };
+static constexpr GUID process_guid = { 0x3d6fa8d0, 0xfe05, 0x11d0, { 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } };
+
+// Event types of classic kernel events
+static constexpr UCHAR thread_start = 1;
+static constexpr UCHAR process_end = 2;
+static constexpr UCHAR context_switch = 36;
+
+// Profile sources in order of preference, names differ between Intel and AMD processors
+static constexpr ProfileSource profile_sources[] = {
+	{ L"InstructionRetired", 0 },
+	{ L"TotalCycles", 1 },
+	{ L"UnhaltedCoreCycles", 1 },
+	{ L"LLCMisses", 2 },
+	{ L"CacheMisses", 2 },
+	{ L"DcacheMisses", 2 },
+	{ L"BranchMispredictsRetired", 3 },
+	{ L"BranchMispredictions", 3 }
+};
+
+// Time to wait for exit of a process to be delivered, session flushes buffers at least every second
+static constexpr std::chrono::seconds delivery_timeout(5);
+
+static CounterSession counter_session;
+
+/**
+ * @brief	Get properties of kernel ETW session
+ * @return	Properties with size and name offset set, as required to start, flush and stop session
+*/
+[[nodiscard]] static SessionProperties GetSessionProperties() noexcept
+{
+	SessionProperties properties{ };
+	properties.properties.Wnode.BufferSize = sizeof(SessionProperties);
+	properties.properties.Wnode.Guid = system_trace_guid;
+	properties.properties.Wnode.Flags = WNODE_FLAG_TRACED_GUID;
+	// Query performance counter timestamps
+	properties.properties.Wnode.ClientContext = 1;
+	properties.properties.LogFileMode = EVENT_TRACE_REAL_TIME_MODE;
+	properties.properties.FlushTimer = 1;
+	properties.properties.EnableFlags = EVENT_TRACE_FLAG_PROCESS | EVENT_TRACE_FLAG_THREAD | EVENT_TRACE_FLAG_CSWITCH;
+	properties.properties.LoggerNameOffset = offsetof(SessionProperties, name);
+	return properties;
+}
+
+/**
+ * @brief			Read integer from event payload
+ * @param record	Event record
+ * @param offset	Offset of integer in payload
+ * @return			Integer, 0 if payload is too short
+*/
+[[nodiscard]] static DWORD ReadPayload(const EVENT_RECORD& record, std::size_t offset) noexcept
+{
+	DWORD value = 0;
+
+	if (offset + sizeof(DWORD) <= record.UserDataLength)
+		std::memcpy(&value, static_cast<const BYTE*>(record.UserData) + offset, sizeof(DWORD));
+
+	return value;
+}
+
+/**
+ * @brief			Add counters since previous context switch on the same processor to process of switched out thread
+ * @param record	Context switch event
+*/
+static void OnContextSwitch(const EVENT_RECORD& record)
+{
+	std::array<ULONG64, counter_count> values{ };
+	bool sampled = false;
+
+	for (USHORT index = 0; index < record.ExtendedDataCount; ++index)
+	{
+		const EVENT_HEADER_EXTENDED_DATA_ITEM& item = record.ExtendedData[index];
+
+		if (item.ExtType == EVENT_HEADER_EXT_TYPE_PMC_COUNTERS)
+		{
+			const std::size_t count = std::min<std::size_t>(item.DataSize / sizeof(ULONG64), counter_count);
+			std::memcpy(values.data(), reinterpret_cast<const void*>(item.DataPtr), count * sizeof(ULONG64));
+			sampled = true;
+		}
+	}
+
+	if (!sampled)
+		return;
+
+	// Payload of context switch event starts with NewThreadId followed by OldThreadId
+	const DWORD old_thread = ReadPayload(record, sizeof(DWORD));
+	const std::size_t processor = record.BufferContext.ProcessorIndex;
+
+	const std::lock_guard lock(counter_session.mutex);
+
+	if (processor >= counter_session.previous.size())
+		counter_session.previous.resize(processor + 1);
+
+	std::optional<std::array<ULONG64, counter_count>>& previous = counter_session.previous.at(processor);
+	const auto thread = counter_session.threads.find(old_thread);
+
+	if (previous && (thread != counter_session.threads.end()))
+	{
+		const auto process = counter_session.processes.find(thread->second);
+
+		if (process != counter_session.processes.end())
+		{
+			std::array<ULONG64*, counter_count> counters = {
+				&process->second.counters.instructions,
+				&process->second.counters.cycles,
+				&process->second.counters.cache_misses,
+				&process->second.counters.branch_misses
+			};
+
+			for (std::size_t counter = 0; counter < counter_count; ++counter)
+			{
+				const std::size_t slot = counter_session.slots.at(counter);
+
+				if (slot < counter_count)
+					*counters.at(counter) += values.at(slot) - previous->at(slot);
+			}
+		}
+	}
+
+	previous = values;
+}
+
+/**
+ * @brief			Consume event of kernel ETW session
+ * @param record	Event record
+*/
+static void WINAPI OnEvent(PEVENT_RECORD record)
+{
+	const EVENT_HEADER& header = record->EventHeader;
+	const UCHAR type = header.EventDescriptor.Opcode;
+
+	if (IsEqualGUID(header.ProviderId, thread_guid))
+	{
+		if (type == context_switch)
+		{
+			OnContextSwitch(*record);
+		}
+		else if (type == thread_start)
+		{
+			// Payload of thread event starts with ProcessId followed by TThreadId
+			const DWORD process = ReadPayload(*record, 0);
+			const std::lock_guard lock(counter_session.mutex);
+
+			if (counter_session.processes.contains(process))
+				counter_session.threads[ReadPayload(*record, sizeof(DWORD))] = process;
+		}
+	}
+	else if (IsEqualGUID(header.ProviderId, process_guid) && (type == process_end))
+	{
+		// Payload of process event starts with UniqueProcessKey pointer followed by ProcessId
+		const std::size_t pointer = (header.Flags & EVENT_HEADER_FLAG_64_BIT_HEADER) != 0 ? 8 : 4;
+		const DWORD process = ReadPayload(*record, pointer);
+
+		{
+			const std::lock_guard lock(counter_session.mutex);
+			const auto watched = counter_session.processes.find(process);
+
+			if (watched == counter_session.processes.end())
+				return;
+
+			watched->second.ended = true;
+		}
+
+		counter_session.ended.notify_all();
+	}
+}
+
+/**
+ * @brief			Stop session if benchmark is interrupted, a kernel session is not stopped when its process exits
+ * @param signal	Console control signal
+ * @return			FALSE to run default handler which exits process
+*/
+static BOOL WINAPI OnConsoleControl(DWORD signal) noexcept
+{
+	static_cast<void>(signal);
+
+	SessionProperties properties = GetSessionProperties();
+	ControlTraceW(0, KERNEL_LOGGER_NAMEW, &properties.properties, EVENT_TRACE_CONTROL_STOP);
+	return FALSE;
+}
+
+/**
+ * @brief			Select profile sources which are counted
+ * @param sources	Receives profile sources in order of PMC data of an event
+ * @param reason	Receives reason if no profile source is supported
+ * @return			true if at least one profile source is supported
+*/
+[[nodiscard]] static bool SelectProfileSources(std::vector<ULONG>& sources, std::string& reason)
+{
+	// ULONG64 elements align PROFILE_SOURCE_INFO entries
+	std::vector<ULONG64> buffer(8192);
+	ULONG length = 0;
+
+	const ULONG status = TraceQueryInformation(0, TraceProfileSourceListInfo, buffer.data(),
+		static_cast<ULONG>(buffer.size() * sizeof(ULONG64)), &length);
+
+	if (status != ERROR_SUCCESS)
+	{
+		reason = "failed to query profile sources, error " + std::to_string(status);
+		return false;
+	}
+
+	counter_session.slots.fill(counter_count);
+	const BYTE* entries = reinterpret_cast<const BYTE*>(buffer.data());
+
+	for (const ProfileSource& source : profile_sources)
+	{
+		if (counter_session.slots.at(source.counter) != counter_count)
+			continue;
+
+		for (ULONG offset = 0; offset < length; )
+		{
+			const PROFILE_SOURCE_INFO* info = reinterpret_cast<const PROFILE_SOURCE_INFO*>(entries + offset);
+
+			if (std::wstring_view(info->Description) == source.name)
+			{
+				counter_session.slots.at(source.counter) = sources.size();
+				sources.push_back(info->Source);
+				break;
+			}
+
+			if (info->NextEntryOffset == 0)
+				break;
+
+			offset += info->NextEntryOffset;
+		}
+	}
+
+	if (sources.empty())
+	{
+		reason = "processor exposes no supported profile source";
+		return false;
+	}
+
+	return true;
+}
+
+bool StartCounters(std::string& reason)
+{
+	HANDLE token = nullptr;
+	TOKEN_ELEVATION elevation{ };
+	DWORD size = 0;
+
+	if (OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token) != FALSE)
+	{
+		if (GetTokenInformation(token, TokenElevation, &elevation, sizeof(TOKEN_ELEVATION), &size) == FALSE)
+			elevation.TokenIsElevated = 0;
+
+		CloseHandle(token);
+	}
+
+	if (elevation.TokenIsElevated == 0)
+	{
+		reason = "kernel ETW session requires administrator";
+		return false;
+	}
+
+	std::vector<ULONG> sources;
+
+	if (!SelectProfileSources(sources, reason))
+		return false;
+
+	SessionProperties properties = GetSessionProperties();
+	ULONG status = StartTraceW(&counter_session.session, KERNEL_LOGGER_NAMEW, &properties.properties);
+
+	if (status != ERROR_SUCCESS)
+	{
+		counter_session.session = 0;
+
+		if (status == ERROR_ALREADY_EXISTS)
+			reason = "NT Kernel Logger session is used by another program";
+		else
+			reason = "failed to start kernel ETW session, error " + std::to_string(status);
+
+		return false;
+	}
+
+	SetConsoleCtrlHandler(OnConsoleControl, TRUE);
+
+	// Counters are sampled on context switch events only
+	CLASSIC_EVENT_ID event{ };
+	event.EventGuid = thread_guid;
+	event.Type = context_switch;
+
+	status = TraceSetInformation(counter_session.session, TracePmcCounterListInfo, sources.data(),
+		static_cast<ULONG>(sources.size() * sizeof(ULONG)));
+
+	if (status == ERROR_SUCCESS)
+		status = TraceSetInformation(counter_session.session, TracePmcEventListInfo, &event, sizeof(CLASSIC_EVENT_ID));
+
+	if (status != ERROR_SUCCESS)
+	{
+		reason = "failed to enable performance counters, error " + std::to_string(status);
+		StopCounters();
+		return false;
+	}
+
+	EVENT_TRACE_LOGFILEW logfile{ };
+	logfile.LoggerName = properties.name;
+	logfile.ProcessTraceMode = PROCESS_TRACE_MODE_REAL_TIME | PROCESS_TRACE_MODE_EVENT_RECORD;
+	logfile.EventRecordCallback = OnEvent;
+
+	counter_session.consumer = OpenTraceW(&logfile);
+
+	if (counter_session.consumer == INVALID_PROCESSTRACE_HANDLE)
+	{
+		reason = "failed to open kernel ETW session, error " + std::to_string(GetLastError());
+		StopCounters();
+		return false;
+	}
+
+	counter_session.thread = std::thread([]
+	{
+		ProcessTrace(&counter_session.consumer, 1, nullptr, nullptr);
+	});
+
+	return true;
+}
+
+void StopCounters() noexcept
+{
+	if (counter_session.session == 0)
+		return;
+
+	// Stopping session makes ProcessTrace return once remaining events are delivered
+	SessionProperties properties = GetSessionProperties();
+	ControlTraceW(counter_session.session, nullptr, &properties.properties, EVENT_TRACE_CONTROL_STOP);
+	counter_session.session = 0;
+
+	if (counter_session.thread.joinable())
+		counter_session.thread.join();
+
+	if (counter_session.consumer != INVALID_PROCESSTRACE_HANDLE)
+	{
+		CloseTrace(counter_session.consumer);
+		counter_session.consumer = INVALID_PROCESSTRACE_HANDLE;
+	}
+
+	SetConsoleCtrlHandler(OnConsoleControl, FALSE);
+}
+
+bool CountersStarted() noexcept
+{
+	return counter_session.consumer != INVALID_PROCESSTRACE_HANDLE;
+}
+
+void WatchProcess(DWORD process_id, DWORD thread_id)
+{
+	const std::lock_guard lock(counter_session.mutex);
+
+	counter_session.processes[process_id] = WatchedProcess{ };
+	counter_session.threads[thread_id] = process_id;
+}
+
+bool CollectCounters(DWORD process_id, HardwareCounters& counters)
+{
+	// Events are delivered once buffers are flushed
+	SessionProperties properties = GetSessionProperties();
+	ControlTraceW(counter_session.session, nullptr, &properties.properties, EVENT_TRACE_CONTROL_FLUSH);
+
+	std::unique_lock lock(counter_session.mutex);
+
+	const bool ended = counter_session.ended.wait_for(lock, delivery_timeout, [process_id]
+	{
+		const auto process = counter_session.processes.find(process_id);
+		return (process == counter_session.processes.end()) || process->second.ended;
+	});
+
+	const auto process = counter_session.processes.find(process_id);
+
+	if (process != counter_session.processes.end())
+	{
+		counters = process->second.counters;
+		counter_session.processes.erase(process);
+	}
+
+	std::erase_if(counter_session.threads, [process_id](const auto& thread)
+	{
+		return thread.second == process_id;
+	});
+
+	return ended;
+}
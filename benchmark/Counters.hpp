@@ -0,0 +1,69 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file benchmark\Counters.hpp
+ *
+ * Hardware performance counter function declarations
+ *
+ * Windows exposes hardware performance counters (PMC) only to kernel ETW sessions, which require administrator.
+ * Counters are sampled on every context switch and the difference since previous switch on the same processor
+ * is added to the process whose thread was switched out, thus counters of a process are counted only while
+ * its threads run. If the session can't be started counters are not available and remain 0.
+ *
+*/
+
+#pragma once
+#include <string>
+#include <Windows.h>
+
+
+/**
+ * @brief Hardware performance counters of a process, 0 if counter is not available
+*/
+struct HardwareCounters
+{
+	// Instructions retired
+	ULONG64 instructions = 0;
+	// Unhalted core cycles, unlike process cycle time these scale with clock frequency
+	ULONG64 cycles = 0;
+	// Last level cache misses
+	ULONG64 cache_misses = 0;
+	// Mispredicted branches
+	ULONG64 branch_misses = 0;
+};
+
+/**
+ * @brief			Start kernel ETW session which samples hardware performance counters
+ * @param reason	Receives reason why counters are not available if session was not started
+ * @return			true if session was started
+*/
+[[nodiscard]] bool StartCounters(std::string& reason);
+
+/** Stop kernel ETW session, does nothing if session isn't started */
+void StopCounters() noexcept;
+
+/**
+ * @brief	Check if hardware performance counters are sampled
+ * @return	true if session is started
+*/
+[[nodiscard]] bool CountersStarted() noexcept;
+
+/**
+ * @brief				Start counting process, must be called before the process runs, ex. while it's suspended
+ * @param process_id	Process which to count
+ * @param thread_id		Initial thread of the process, threads it creates are counted as well
+*/
+void WatchProcess(DWORD process_id, DWORD thread_id);
+
+/**
+ * @brief				Wait for exit of watched process to be delivered by session and stop counting it
+ * @param process_id	Process which was passed to WatchProcess
+ * @param counters		Receives counters of the process
+ * @return				true if exit of the process was delivered in time and counters are complete
+*/
+[[nodiscard]] bool CollectCounters(DWORD process_id, HardwareCounters& counters);
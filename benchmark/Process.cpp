@@ -0,0 +1,159 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file benchmark\Process.cpp
+ *
+ * Function definitions to run and time processes
+ *
+*/
+
+#include "pch.hpp"
+#include "Process.hpp"
+
+
+/**
+ * @brief			Convert FILETIME interval in 100 ns units to duration
+ * @param time		FILETIME to convert
+ * @return			Duration
+*/
+[[nodiscard]] static std::chrono::nanoseconds FileTimeToDuration(const FILETIME& time) noexcept
+{
+	const ULONGLONG ticks = (static_cast<ULONGLONG>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+	return std::chrono::nanoseconds(ticks * 100);
+}
+
+/**
+ * @brief			Get counters of exited process
+ * @param process	Handle of exited process
+ * @param result	Receives exit code and counters, wall time is not set
+*/
+static void QueryProcessResult(HANDLE process, ProcessResult& result)
+{
+	if (GetExitCodeProcess(process, &result.exit_code) == FALSE)
+		result.exit_code = static_cast<DWORD>(-1);
+
+	// Counters of exited process remain available until its handle is closed, failure is not an error
+	if (QueryProcessCycleTime(process, &result.cycles) == FALSE)
+		result.cycles = 0;
+
+	PROCESS_MEMORY_COUNTERS memory{ };
+
+	if (GetProcessMemoryInfo(process, &memory, sizeof(PROCESS_MEMORY_COUNTERS)) != FALSE)
+	{
+		result.page_faults = memory.PageFaultCount;
+		result.peak_working_set = memory.PeakWorkingSetSize;
+	}
+
+	FILETIME creation{ };
+	FILETIME exit{ };
+	FILETIME kernel{ };
+	FILETIME user{ };
+
+	if (GetProcessTimes(process, &creation, &exit, &kernel, &user) != FALSE)
+	{
+		result.cpu_time = FileTimeToDuration(kernel) + FileTimeToDuration(user);
+		result.elapsed = FileTimeToDuration(exit) - FileTimeToDuration(creation);
+	}
+}
+
+bool RunProcesses(const std::vector<std::wstring>& commands, std::vector<ProcessResult>& results, std::chrono::steady_clock::duration& elapsed)
+{
+	assert(commands.size() <= MAXIMUM_WAIT_OBJECTS);
+
+	// Handle must be inheritable to be passed to child process
+	SECURITY_ATTRIBUTES security{ };
+	security.nLength = sizeof(SECURITY_ATTRIBUTES);
+	security.bInheritHandle = TRUE;
+
+	// Output is discarded, console output is not what is measured
+	HANDLE null = CreateFileW(L"NUL", GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &security, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (null == INVALID_HANDLE_VALUE)
+	{
+		std::cerr << "Failed to open NUL device, error " << GetLastError() << std::endl;
+		return false;
+	}
+
+	STARTUPINFOW startup{ };
+	startup.cb = sizeof(STARTUPINFOW);
+	startup.dwFlags = STARTF_USESTDHANDLES;
+	startup.hStdInput = null;
+	startup.hStdOutput = null;
+	startup.hStdError = null;
+
+	std::vector<HANDLE> processes;
+	std::vector<HANDLE> threads;
+	processes.reserve(commands.size());
+	threads.reserve(commands.size());
+	bool started = true;
+
+	const auto start = std::chrono::steady_clock::now();
+
+	for (const std::wstring& command : commands)
+	{
+		PROCESS_INFORMATION process{ };
+		// MSDN: The Unicode version of this function, CreateProcessW, can modify the contents of command line
+		std::wstring command_line = command;
+
+		// Processes are created suspended so that their counters are watched before they run
+		if (CreateProcessW(nullptr, command_line.data(), nullptr, nullptr, TRUE, CREATE_SUSPENDED, nullptr, nullptr, &startup, &process) == FALSE)
+		{
+			std::cerr << "Failed to start process, error " << GetLastError() << std::endl;
+			started = false;
+			break;
+		}
+
+		if (CountersStarted())
+			WatchProcess(process.dwProcessId, process.dwThreadId);
+
+		processes.push_back(process.hProcess);
+		threads.push_back(process.hThread);
+	}
+
+	for (HANDLE thread : threads)
+	{
+		ResumeThread(thread);
+		CloseHandle(thread);
+	}
+
+	// Processes which were started are waited for so that they don't outlive the run
+	if (!processes.empty())
+		WaitForMultipleObjects(static_cast<DWORD>(processes.size()), processes.data(), TRUE, INFINITE);
+
+	elapsed = std::chrono::steady_clock::now() - start;
+
+	results.assign(processes.size(), ProcessResult{ });
+
+	for (std::size_t index = 0; index < processes.size(); ++index)
+	{
+		QueryProcessResult(processes.at(index), results.at(index));
+
+		// Counters which were not delivered in time are not reported rather than reported incomplete
+		if (CountersStarted() && !CollectCounters(GetProcessId(processes.at(index)), results.at(index).counters))
+			results.at(index).counters = HardwareCounters{ };
+
+		CloseHandle(processes.at(index));
+	}
+
+	CloseHandle(null);
+	return started;
+}
+
+bool RunProcess(const std::wstring& command, ProcessResult& result)
+{
+	std::vector<ProcessResult> results;
+	std::chrono::steady_clock::duration elapsed{ };
+
+	if (!RunProcesses({ command }, results, elapsed))
+		return false;
+
+	result = results.front();
+	// Process times have coarse resolution, wall time measured by caller is precise
+	result.elapsed = elapsed;
+	return true;
+}
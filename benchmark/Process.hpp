@@ -0,0 +1,62 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file benchmark\Process.hpp
+ *
+ * Function declarations to run and time processes
+ *
+ * Cycles and page faults of a process are always measured, hardware performance counters
+ * such as instructions retired, cache misses and branch misses are measured if counters were started.
+ *
+*/
+
+#pragma once
+#include <chrono>
+#include <string>
+#include <vector>
+#include <Windows.h>
+#include "Counters.hpp"
+
+
+/**
+ * @brief Outcome of running a process
+*/
+struct ProcessResult
+{
+	// Exit code of the process
+	DWORD exit_code = 0;
+	// Wall time from process creation until the process exited
+	std::chrono::steady_clock::duration elapsed{ };
+	// CPU cycles consumed by all threads of the process, 0 if not available
+	ULONG64 cycles = 0;
+	// Count of page faults of the process, 0 if not available
+	DWORD page_faults = 0;
+	// Time spent by all threads of the process in user and kernel mode, 0 if not available
+	std::chrono::nanoseconds cpu_time{ };
+	// Peak working set of the process in bytes, 0 if not available
+	SIZE_T peak_working_set = 0;
+	// Hardware performance counters of the process, 0 if counters were not started
+	HardwareCounters counters;
+};
+
+/**
+ * @brief			Run process with standard handles redirected to NUL and wait for it to exit
+ * @param command	Command line, the first token is path to executable
+ * @param result	Receives exit code, wall time and counters
+ * @return			true if process was started
+*/
+[[nodiscard]] bool RunProcess(const std::wstring& command, ProcessResult& result);
+
+/**
+ * @brief			Run processes concurrently with standard handles redirected to NUL and wait for all of them to exit
+ * @param commands	Command lines, at most MAXIMUM_WAIT_OBJECTS
+ * @param results	Receives exit code, wall time and counters of each process
+ * @param elapsed	Receives wall time from creation of the first process until the last process exited
+ * @return			true if all processes were started, processes which were started are waited for regardless
+*/
+[[nodiscard]] bool RunProcesses(const std::vector<std::wstring>& commands, std::vector<ProcessResult>& results, std::chrono::steady_clock::duration& elapsed);
@@ -0,0 +1,433 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file benchmark\Scaling.cpp
+ *
+ * Multi-file scaling benchmark definition
+ *
+*/
+
+#include "pch.hpp"
+#include "Scaling.hpp"
+#include "Process.hpp"
+#include "Statistics.hpp"
+#include "utils.hpp"
+namespace fs = std::filesystem;
+
+
+namespace
+{
+	/**
+	 * @brief Generated files of which corpus consists
+	*/
+	struct Corpus
+	{
+		// Name used by --corpus option and in results
+		std::string name;
+		// Size of each file in bytes, files are generated with sizes rounded up to whole lines
+		std::vector<std::size_t> sizes;
+	};
+
+	/**
+	 * @brief Result of formatting corpus by a count of workers, median of timed runs
+	*/
+	struct Point
+	{
+		std::size_t workers = 0;
+		double wall_ms = 0.0;
+		double files_per_second = 0.0;
+		double mb_per_second = 0.0;
+		// Total CPU time divided by wall time of all workers
+		double cpu_utilization = 0.0;
+		// Largest peak working set of a single worker
+		double peak_rss_mb = 0.0;
+		// Sum of peak working sets of all workers
+		double total_rss_mb = 0.0;
+		double speedup = 0.0;
+		double efficiency = 0.0;
+		// Counters of all workers divided by corpus size, 0 if not available
+		double cycles_per_byte = 0.0;
+		double page_faults_per_kb = 0.0;
+		double instructions_per_byte = 0.0;
+		double cache_misses_per_kb = 0.0;
+		double branch_misses_per_kb = 0.0;
+		// Instructions per core cycle of all workers, 0 if not available
+		double ipc = 0.0;
+	};
+}
+
+// Unformatted lines of which generated procedures consist
+static constexpr std::string_view lines[] = {
+	"mov rax,  rcx",
+	"   add rax, rdx      ; sum of arguments",
+	"  sub    rsp, 28h",
+	"\tlea rcx, [rsp+20h] ;address of local",
+	"call  ExternalProc",
+	"xor eax,eax",
+	"        test rax, rax",
+	"  jz   @F",
+	"@@:   inc rcx",
+	"; comment line without space",
+	"    ;   indented comment line",
+	"mov qword ptr [rsp+8], rbx   ; save nonvolatile",
+	"",
+	"",
+	"  ret"
+};
+
+/**
+ * @brief			Generate unformatted source file
+ * @param engine	Random engine, generated file depends only on its state
+ * @param size		Approximate size of file in bytes
+ * @param id		Unique number used in procedure names
+ * @return			File contents with CRLF line breaks
+*/
+[[nodiscard]] static std::string GenerateFile(std::mt19937& engine, std::size_t size, std::size_t id)
+{
+	std::string contents = "\r\n  .code\r\n";
+	contents.reserve(size + 256);
+
+	for (std::size_t proc = 0; contents.size() < size; ++proc)
+	{
+		const std::string name = "Proc" + std::to_string(id) + "_" + std::to_string(proc);
+		contents += name + "   PROC\r\n";
+
+		// Procedures of 10 to 50 lines
+		const std::size_t count = 10 + engine() % 41;
+
+		for (std::size_t line = 0; line < count; ++line)
+		{
+			contents += lines[engine() % std::size(lines)];
+			contents += "\r\n";
+		}
+
+		contents += name + " ENDP\r\n\r\n";
+	}
+
+	contents += "END\r\n";
+	return contents;
+}
+
+/**
+ * @brief	Get corpora which are benchmarked
+ * @return	Corpora, file sizes are the same on every run of benchmark
+*/
+[[nodiscard]] static std::vector<Corpus> GetCorpora()
+{
+	std::vector<Corpus> corpora;
+
+	// Many small files, process startup and per file overhead dominates
+	corpora.push_back({ "small", std::vector<std::size_t>(1000, 2 * 1024) });
+
+	// Few huge files, workers beyond count of files have nothing to do
+	corpora.push_back({ "huge", std::vector<std::size_t>(4, 2 * 1024 * 1024) });
+
+	// Sizes from 1 KiB to 256 KiB in powers of two, shards are balanced by size
+	std::mt19937 engine(2023);
+	Corpus mixed{ "mixed", { } };
+
+	for (std::size_t file = 0; file < 150; ++file)
+		mixed.sizes.push_back(std::size_t{ 1024 } << (engine() % 9));
+
+	corpora.push_back(std::move(mixed));
+	return corpora;
+}
+
+/**
+ * @brief			Overwrite file with bytes
+ * @param filepath	File which to write
+ * @param contents	Bytes to write
+ * @return			true if file was written
+*/
+[[nodiscard]] static bool WriteBytes(const fs::path& filepath, std::string_view contents)
+{
+	std::ofstream file(filepath, std::ios::binary | std::ios::trunc);
+	file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+	return file.good();
+}
+
+/**
+ * @brief			Write unformatted files of corpus to directory
+ * @param directory	Directory which receives files
+ * @param files		Contents of files
+ * @return			true if all files were written
+*/
+[[nodiscard]] static bool WriteCorpus(const fs::path& directory, const std::vector<std::string>& files)
+{
+	for (std::size_t index = 0; index < files.size(); ++index)
+	{
+		const fs::path filepath = directory / ("file" + std::to_string(index) + ".asm");
+
+		if (!WriteBytes(filepath, files.at(index)))
+		{
+			std::cerr << "Failed to write file " << filepath.string() << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief			Get worker counts which are benchmarked
+ * @param workers	Maximum count of workers
+ * @return			Powers of two up to maximum and maximum itself
+*/
+[[nodiscard]] static std::vector<std::size_t> GetWorkerCounts(std::size_t workers)
+{
+	std::vector<std::size_t> counts;
+
+	for (std::size_t count = 1; count < workers; count *= 2)
+		counts.push_back(count);
+
+	counts.push_back(workers);
+	return counts;
+}
+
+/**
+ * @brief			Format corpus by count of workers
+ * @param options	Benchmark options
+ * @param directory	Directory with corpus files
+ * @param files		Contents of corpus files, they are restored before each run
+ * @param workers	Count of workers
+ * @param point		Receives medians of timed runs, speedup and efficiency are not set
+ * @return			true if all runs succeeded
+*/
+[[nodiscard]] static bool RunWorkers(const ScalingOptions& options, const fs::path& directory,
+	const std::vector<std::string>& files, std::size_t workers, Point& point)
+{
+	std::wstring command = L"\"" + options.asmformat.wstring() + L"\" --nologo --batch --quiet";
+
+	for (const std::wstring& option : options.options)
+		command += L" " + option;
+
+	// Each worker formats one shard, shards are balanced by file size
+	std::vector<std::wstring> commands;
+
+	for (std::size_t shard = 1; shard <= workers; ++shard)
+	{
+		commands.push_back(command + L" --shard " + std::to_wstring(shard) + L"/" + std::to_wstring(workers) +
+			L" --directory \"" + directory.wstring() + L"\"");
+	}
+
+	std::vector<double> wall;
+	std::vector<double> cpu;
+	std::vector<double> peak_rss;
+	std::vector<double> total_rss;
+	std::vector<double> cycles;
+	std::vector<double> page_faults;
+	std::vector<double> instructions;
+	std::vector<double> core_cycles;
+	std::vector<double> cache_misses;
+	std::vector<double> branch_misses;
+
+	for (std::size_t run = 0; run < options.runs; ++run)
+	{
+		// Restoring files is not timed
+		if (!WriteCorpus(directory, files))
+			return false;
+
+		std::vector<ProcessResult> results;
+		std::chrono::steady_clock::duration elapsed{ };
+
+		if (!RunProcesses(commands, results, elapsed))
+			return false;
+
+		std::chrono::nanoseconds cpu_time{ };
+		SIZE_T peak = 0;
+		SIZE_T total = 0;
+		ULONG64 cycle_count = 0;
+		ULONG64 fault_count = 0;
+		HardwareCounters counters;
+
+		for (const ProcessResult& result : results)
+		{
+			if (result.exit_code != 0)
+			{
+				std::cerr << "asmformat failed with exit code " << result.exit_code << std::endl;
+				return false;
+			}
+
+			cpu_time += result.cpu_time;
+			peak = std::max(peak, result.peak_working_set);
+			total += result.peak_working_set;
+			cycle_count += result.cycles;
+			fault_count += result.page_faults;
+			counters.instructions += result.counters.instructions;
+			counters.cycles += result.counters.cycles;
+			counters.cache_misses += result.counters.cache_misses;
+			counters.branch_misses += result.counters.branch_misses;
+		}
+
+		const double seconds = std::chrono::duration<double>(elapsed).count();
+
+		wall.push_back(seconds * 1000.0);
+		cpu.push_back(std::chrono::duration<double>(cpu_time).count() / (seconds * static_cast<double>(workers)));
+		peak_rss.push_back(static_cast<double>(peak) / 1e6);
+		total_rss.push_back(static_cast<double>(total) / 1e6);
+		cycles.push_back(static_cast<double>(cycle_count));
+		page_faults.push_back(static_cast<double>(fault_count));
+		instructions.push_back(static_cast<double>(counters.instructions));
+		core_cycles.push_back(static_cast<double>(counters.cycles));
+		cache_misses.push_back(static_cast<double>(counters.cache_misses));
+		branch_misses.push_back(static_cast<double>(counters.branch_misses));
+	}
+
+	std::size_t bytes = 0;
+
+	for (const std::string& file : files)
+		bytes += file.size();
+
+	const double size = static_cast<double>(std::max<std::size_t>(1, bytes));
+	const double instruction_count = Summarize(std::move(instructions)).median;
+	const double core_cycle_count = Summarize(std::move(core_cycles)).median;
+
+	point.workers = workers;
+	point.wall_ms = Summarize(std::move(wall)).median;
+	point.files_per_second = static_cast<double>(files.size()) / (point.wall_ms / 1000.0);
+	point.mb_per_second = static_cast<double>(bytes) / 1e6 / (point.wall_ms / 1000.0);
+	point.cpu_utilization = Summarize(std::move(cpu)).median;
+	point.peak_rss_mb = Summarize(std::move(peak_rss)).median;
+	point.total_rss_mb = Summarize(std::move(total_rss)).median;
+	point.cycles_per_byte = Summarize(std::move(cycles)).median / size;
+	point.page_faults_per_kb = Summarize(std::move(page_faults)).median / size * 1000.0;
+	point.instructions_per_byte = instruction_count / size;
+	point.cache_misses_per_kb = Summarize(std::move(cache_misses)).median / size * 1000.0;
+	point.branch_misses_per_kb = Summarize(std::move(branch_misses)).median / size * 1000.0;
+	point.ipc = core_cycle_count != 0.0 ? instruction_count / core_cycle_count : 0.0;
+	return true;
+}
+
+int ScalingBenchmark(const ScalingOptions& options)
+{
+	// WaitForMultipleObjects waits for at most MAXIMUM_WAIT_OBJECTS processes
+	const std::size_t max_workers = std::min<std::size_t>(MAXIMUM_WAIT_OBJECTS,
+		options.workers != 0 ? options.workers : std::max(1u, std::thread::hardware_concurrency()));
+
+	std::vector<Corpus> corpora = GetCorpora();
+
+	if (!options.corpora.empty())
+	{
+		std::erase_if(corpora, [&options](const Corpus& corpus)
+		{
+			return std::find(options.corpora.begin(), options.corpora.end(), corpus.name) == options.corpora.end();
+		});
+
+		if (corpora.empty())
+		{
+			std::cerr << "No corpus matches --corpus option, corpora are small, huge and mixed" << std::endl;
+			return 1;
+		}
+	}
+
+	const fs::path root = fs::temp_directory_path() / L"asmformat-scaling";
+	std::ostringstream json;
+
+	json << std::fixed << std::setprecision(3);
+	json << "{" << std::endl;
+	json << "  \"asmformat\": \"" << wsl::JsonEscape(options.asmformat.string()) << "\"," << std::endl;
+	json << "  \"logical_processors\": " << std::thread::hardware_concurrency() << "," << std::endl;
+	json << "  \"runs\": " << options.runs << "," << std::endl;
+	json << "  \"corpora\": [" << std::endl;
+
+	std::cout << std::fixed << std::setprecision(2);
+
+	for (std::size_t index = 0; index < corpora.size(); ++index)
+	{
+		const Corpus& corpus = corpora.at(index);
+		const fs::path directory = root / corpus.name;
+
+		std::error_code error;
+		fs::remove_all(directory, error);
+
+		if (!fs::create_directories(directory, error))
+		{
+			std::cerr << "Failed to create directory " << directory.string() << std::endl;
+			return 1;
+		}
+
+		// Files are generated once, the same engine seed gives the same corpus on every run of benchmark
+		std::mt19937 engine(static_cast<std::mt19937::result_type>(index));
+		std::vector<std::string> files;
+		std::size_t bytes = 0;
+
+		for (std::size_t file = 0; file < corpus.sizes.size(); ++file)
+		{
+			files.push_back(GenerateFile(engine, corpus.sizes.at(file), file));
+			bytes += files.back().size();
+		}
+
+		std::cout << std::endl << "scaling: " << corpus.name << ", " << files.size() << " files, "
+			<< static_cast<double>(bytes) / 1e6 << " MB, " << options.runs << " runs" << std::endl;
+		std::cout << "workers\twall ms\t\tfiles/s\t\tMB/s\tCPU %\tpeak RSS MB\tspeedup\tefficiency\tcycles/B\tIPC" << std::endl;
+
+		// Untimed run loads executable and its DLLs into file cache
+		Point point;
+		ScalingOptions warmup = options;
+		warmup.runs = 1;
+
+		if (!RunWorkers(warmup, directory, files, 1, point))
+			return 1;
+
+		std::vector<Point> points;
+
+		for (const std::size_t workers : GetWorkerCounts(max_workers))
+		{
+			if (!RunWorkers(options, directory, files, workers, point))
+				return 1;
+
+			point.speedup = points.empty() ? 1.0 : points.front().wall_ms / point.wall_ms;
+			point.efficiency = point.speedup / static_cast<double>(workers);
+			points.push_back(point);
+
+			std::cout << point.workers << "\t" << point.wall_ms << "\t\t" << point.files_per_second << "\t\t"
+				<< point.mb_per_second << "\t" << point.cpu_utilization * 100.0 << "\t" << point.peak_rss_mb << "\t\t"
+				<< point.speedup << "\t" << point.efficiency << "\t\t" << point.cycles_per_byte << "\t\t" << point.ipc << std::endl;
+		}
+
+		fs::remove_all(directory, error);
+
+		json << "    {" << std::endl;
+		json << "      \"name\": \"" << wsl::JsonEscape(corpus.name) << "\"," << std::endl;
+		json << "      \"files\": " << files.size() << "," << std::endl;
+		json << "      \"bytes\": " << bytes << "," << std::endl;
+		json << "      \"points\": [" << std::endl;
+
+		for (std::size_t count = 0; count < points.size(); ++count)
+		{
+			const Point& result = points.at(count);
+
+			json << "        { \"workers\": " << result.workers << ", \"wall_ms\": " << result.wall_ms
+				<< ", \"files_per_second\": " << result.files_per_second << ", \"mb_per_second\": " << result.mb_per_second
+				<< ", \"cpu_utilization\": " << result.cpu_utilization << ", \"peak_rss_mb\": " << result.peak_rss_mb
+				<< ", \"total_rss_mb\": " << result.total_rss_mb << ", \"speedup\": " << result.speedup
+				<< ", \"efficiency\": " << result.efficiency << ", \"cycles_per_byte\": " << result.cycles_per_byte
+				<< ", \"page_faults_per_kb\": " << result.page_faults_per_kb << ", \"instructions_per_byte\": " << result.instructions_per_byte
+				<< ", \"ipc\": " << result.ipc << ", \"cache_misses_per_kb\": " << result.cache_misses_per_kb
+				<< ", \"branch_misses_per_kb\": " << result.branch_misses_per_kb << " }" << (count + 1 < points.size() ? "," : "") << std::endl;
+		}
+
+		json << "      ]" << std::endl;
+		json << "    }" << (index + 1 < corpora.size() ? "," : "") << std::endl;
+	}
+
+	json << "  ]" << std::endl;
+	json << "}" << std::endl;
+
+	std::error_code error;
+	fs::remove(root, error);
+
+	if (!WriteBytes(options.output, json.str()))
+	{
+		std::cerr << "Failed to write file " << options.output.string() << std::endl;
+		return 1;
+	}
+
+	std::cout << std::endl << "results written to " << options.output.string() << std::endl;
+	return 0;
+}
@@ -0,0 +1,49 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file benchmark\Scaling.hpp
+ *
+ * Multi-file scaling benchmark declaration
+ *
+ * Measures throughput of formatting generated corpora by 1 up to N workers, where each worker is asmformat
+ * process formatting one shard of corpus specified with --shard, same as CI runners would split the work.
+ * Corpora are many small files, few huge files and a mix of sizes, the last two show limits of sharding.
+ *
+*/
+
+#pragma once
+#include <filesystem>
+#include <string>
+#include <vector>
+
+
+/**
+ * @brief Options of scaling benchmark
+*/
+struct ScalingOptions
+{
+	// asmformat executable which to run
+	std::filesystem::path asmformat;
+	// Names of corpora which to run, all corpora if empty
+	std::vector<std::string> corpora;
+	// Maximum count of workers, 0 for count of logical processors
+	std::size_t workers = 0;
+	// Count of timed runs per count of workers
+	std::size_t runs = 3;
+	// JSON file which receives results
+	std::filesystem::path output = "scaling.json";
+	// Additional options passed to asmformat
+	std::vector<std::wstring> options;
+};
+
+/**
+ * @brief			Run scaling benchmark, print results and write them to JSON file
+ * @param options	Benchmark options
+ * @return			0 if benchmark succeeded
+*/
+[[nodiscard]] int ScalingBenchmark(const ScalingOptions& options);
@@ -0,0 +1,194 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file benchmark\Startup.cpp
+ *
+ * Startup latency benchmark definition
+ *
+*/
+
+#include "pch.hpp"
+#include "Startup.hpp"
+#include "Process.hpp"
+#include "Statistics.hpp"
+namespace fs = std::filesystem;
+
+
+// Small unformatted file used if no file was specified
+static constexpr std::string_view sample =
+	"\r\n"
+	"  .code\r\n"
+	"Startup   PROC\r\n"
+	"mov rax,  rcx      ; first argument\r\n"
+	"     add rax, rdx ; second argument\r\n"
+	"\r\n"
+	"\r\n"
+	"  ret\r\n"
+	"Startup ENDP\r\n"
+	"END\r\n";
+
+/**
+ * @brief			Load whole file as bytes
+ * @param filepath	File which to load
+ * @param contents	Receives file contents
+ * @return			true if file was loaded
+*/
+[[nodiscard]] static bool LoadBytes(const fs::path& filepath, std::string& contents)
+{
+	std::ifstream file(filepath, std::ios::binary);
+
+	if (!file)
+		return false;
+
+	contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return !file.bad();
+}
+
+/**
+ * @brief			Overwrite file with bytes
+ * @param filepath	File which to write
+ * @param contents	Bytes to write
+ * @return			true if file was written
+*/
+[[nodiscard]] static bool WriteBytes(const fs::path& filepath, std::string_view contents)
+{
+	std::ofstream file(filepath, std::ios::binary | std::ios::trunc);
+	file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+	return file.good();
+}
+
+/**
+ * @brief			Print median of a counter per run, per line and per byte
+ * @param name		Name of counter
+ * @param samples	Counter value of each run, all zeros if counter is not available
+ * @param lines		Count of lines in formatted file
+ * @param bytes		Count of bytes in formatted file
+*/
+static void PrintCounter(std::string_view name, std::vector<double> samples, std::size_t lines, std::size_t bytes)
+{
+	const Summary summary = Summarize(std::move(samples));
+
+	if (summary.max == 0.0)
+	{
+		std::cout << name << ": not available" << std::endl;
+		return;
+	}
+
+	std::cout << name << ": " << summary.median << " per run, " << summary.median / static_cast<double>(lines) << " per line, "
+		<< summary.median / static_cast<double>(bytes) << " per byte" << std::endl;
+}
+
+int StartupBenchmark(const StartupOptions& options)
+{
+	std::string contents(sample);
+
+	if (!options.file.empty() && !LoadBytes(options.file, contents))
+	{
+		std::cerr << "Failed to read file " << options.file.string() << std::endl;
+		return 1;
+	}
+
+	// The copy is restored before each run, each run formats unformatted file same as editor on save
+	const fs::path target = fs::temp_directory_path() / L"asmformat-startup.asm";
+
+	std::wstring command = L"\"" + options.asmformat.wstring() + L"\" --nologo --batch";
+
+	for (const std::wstring& option : options.options)
+		command += L" " + option;
+
+	command += L" \"" + target.wstring() + L"\"";
+
+	std::vector<double> samples;
+	std::vector<double> cycles;
+	std::vector<double> page_faults;
+	std::vector<double> instructions;
+	std::vector<double> core_cycles;
+	std::vector<double> ipc;
+	std::vector<double> cache_misses;
+	std::vector<double> branch_misses;
+	samples.reserve(options.runs);
+	cycles.reserve(options.runs);
+	page_faults.reserve(options.runs);
+
+	// The first run is not timed, it loads executable and its DLLs into file cache
+	for (std::size_t run = 0; run <= options.runs; ++run)
+	{
+		if (!WriteBytes(target, contents))
+		{
+			std::cerr << "Failed to write file " << target.string() << std::endl;
+			return 1;
+		}
+
+		ProcessResult result;
+
+		if (!RunProcess(command, result))
+			return 1;
+
+		if (result.exit_code != 0)
+		{
+			std::cerr << "asmformat failed with exit code " << result.exit_code << std::endl;
+			return 1;
+		}
+
+		if (run != 0)
+		{
+			samples.push_back(std::chrono::duration<double, std::milli>(result.elapsed).count());
+			cycles.push_back(static_cast<double>(result.cycles));
+			page_faults.push_back(static_cast<double>(result.page_faults));
+
+			const HardwareCounters& counters = result.counters;
+			instructions.push_back(static_cast<double>(counters.instructions));
+			core_cycles.push_back(static_cast<double>(counters.cycles));
+			cache_misses.push_back(static_cast<double>(counters.cache_misses));
+			branch_misses.push_back(static_cast<double>(counters.branch_misses));
+
+			if ((counters.instructions != 0) && (counters.cycles != 0))
+				ipc.push_back(static_cast<double>(counters.instructions) / static_cast<double>(counters.cycles));
+		}
+	}
+
+	std::error_code error;
+	fs::remove(target, error);
+
+	const Summary summary = Summarize(std::move(samples));
+
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << "startup: " << options.runs << " runs formatting " << contents.size() << " bytes" << std::endl;
+	std::cout << "min " << summary.min << " ms, median " << summary.median << " ms, p95 " << summary.p95
+		<< " ms, max " << summary.max << " ms" << std::endl;
+
+	// Last line without line break is counted too, counters are divided by at least 1
+	std::size_t lines = static_cast<std::size_t>(std::count(contents.begin(), contents.end(), '\n'));
+
+	if (contents.empty() || !contents.ends_with('\n'))
+		++lines;
+
+	const std::size_t bytes = std::max<std::size_t>(1, contents.size());
+
+	std::cout << std::endl << "median counters of " << lines << " lines:" << std::endl;
+	PrintCounter("cycles", std::move(cycles), lines, bytes);
+	PrintCounter("page faults", std::move(page_faults), lines, bytes);
+	PrintCounter("instructions", std::move(instructions), lines, bytes);
+	PrintCounter("core cycles", std::move(core_cycles), lines, bytes);
+	PrintCounter("cache misses", std::move(cache_misses), lines, bytes);
+	PrintCounter("branch misses", std::move(branch_misses), lines, bytes);
+
+	// IPC is a ratio, it's the same per run, per line and per byte
+	if (ipc.empty())
+		std::cout << "IPC: not available" << std::endl;
+	else
+		std::cout << "IPC: " << Summarize(std::move(ipc)).median << std::endl;
+
+	if ((options.budget > 0.0) && (summary.median > options.budget))
+	{
+		std::cerr << "median " << summary.median << " ms exceeds budget of " << options.budget << " ms" << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file benchmark\Startup.hpp
+ *
+ * Startup latency benchmark declaration
+ *
+ * Measures wall time of asmformat process formatting a single small file, which is what an editor
+ * pays on every save, that is process creation, initialization, argument parsing, formatting and exit.
+ *
+*/
+
+#pragma once
+#include <filesystem>
+#include <string>
+#include <vector>
+
+
+/**
+ * @brief Options of startup benchmark
+*/
+struct StartupOptions
+{
+	// asmformat executable which to run
+	std::filesystem::path asmformat;
+	// File which to format, a copy of it is formatted, built in sample is used if empty
+	std::filesystem::path file;
+	// Count of timed runs
+	std::size_t runs = 50;
+	// Median run time in milliseconds which must not be exceeded, 0 for no limit
+	double budget = 0.0;
+	// Additional options passed to asmformat
+	std::vector<std::wstring> options;
+};
+
+/**
+ * @brief			Run startup benchmark and print summary
+ * @param options	Benchmark options
+ * @return			0 if benchmark succeeded and median is within budget
+*/
+[[nodiscard]] int StartupBenchmark(const StartupOptions& options);
@@ -0,0 +1,42 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file benchmark\Statistics.cpp
+ *
+ * Summary statistics of benchmark samples
+ *
+*/
+
+#include "pch.hpp"
+#include "Statistics.hpp"
+
+
+Summary Summarize(std::vector<double> samples)
+{
+	Summary summary;
+
+	if (samples.empty())
+		return summary;
+
+	std::sort(samples.begin(), samples.end());
+
+	// Nearest rank, index of percentile is rounded up
+	const auto percentile = [&samples](std::size_t percent)
+	{
+		const std::size_t rank = (samples.size() * percent + 99) / 100;
+		return samples.at(std::max<std::size_t>(rank, 1) - 1);
+	};
+
+	summary.min = samples.front();
+	summary.max = samples.back();
+	summary.median = percentile(50);
+	summary.p95 = percentile(95);
+	summary.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / static_cast<double>(samples.size());
+
+	return summary;
+}
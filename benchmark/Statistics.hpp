@@ -0,0 +1,36 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file benchmark\Statistics.hpp
+ *
+ * Summary statistics of benchmark samples
+ *
+*/
+
+#pragma once
+#include <vector>
+
+
+/**
+ * @brief Summary of samples, all values are in unit of samples
+*/
+struct Summary
+{
+	double min = 0.0;
+	double median = 0.0;
+	double p95 = 0.0;
+	double max = 0.0;
+	double mean = 0.0;
+};
+
+/**
+ * @brief			Summarize samples
+ * @param samples	Samples to summarize, order doesn't matter
+ * @return			Summary which is all zeros if there are no samples
+*/
+[[nodiscard]] Summary Summarize(std::vector<double> samples);
@@ -0,0 +1,145 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file benchmark\main.cpp
+ *
+ * Defines the entry point for benchmark application
+ *
+ * Debug command arguments: startup --runs 20
+ * Debug command arguments: scaling --corpus small --workers 4
+ * Debug working directory: $(SolutionDir)Build\$(Platform)\$(Configuration)
+ *
+*/
+
+#include "pch.hpp"
+#include "Startup.hpp"
+#include "Scaling.hpp"
+#include "Counters.hpp"
+namespace fs = std::filesystem;
+
+
+/**
+ * @brief	Get path to asmformat executable which is built next to benchmark executable
+ * @return	Full path to asmformat.exe
+*/
+static fs::path DefaultExecutable()
+{
+	std::wstring path(MAX_PATH, L'\0');
+	const DWORD length = GetModuleFileNameW(nullptr, path.data(), static_cast<DWORD>(path.size()));
+	path.resize(length);
+
+	return fs::path(path).parent_path() / L"asmformat.exe";
+}
+
+/**
+ * @brief			Print usage
+ * @param program	Name of benchmark executable
+*/
+static void PrintUsage(const std::string& program)
+{
+	std::cerr << std::endl << "Usage: " << std::endl << std::endl;
+	std::cerr << program << " startup [--asmformat FILE] [--file FILE] [--runs N] [--budget MS] [-- asmformat options]" << std::endl;
+	std::cerr << program << " scaling [--asmformat FILE] [--corpus small|huge|mixed ...] [--workers N] [--runs N] [--output FILE] [-- asmformat options]" << std::endl << std::endl;
+
+	std::cerr << " startup\tTime asmformat formatting a single small file, as done by an editor on save" << std::endl;
+	std::cerr << " scaling\tTime 1 to N concurrent asmformat workers formatting shards of generated corpora" << std::endl;
+	std::cerr << " --asmformat\tasmformat executable to benchmark (default: asmformat.exe next to benchmark)" << std::endl;
+	std::cerr << " --file\t\tFile to format, a copy is formatted (default: built in sample)" << std::endl;
+	std::cerr << " --runs\t\tCount of timed runs (default: 50, scaling: 3 per count of workers)" << std::endl;
+	std::cerr << " --budget\tFail if median run time in milliseconds exceeds MS" << std::endl;
+	std::cerr << " --corpus\tCorpus to run, can be specified multiple times (default: all)" << std::endl;
+	std::cerr << " --workers\tMaximum count of workers, at most 64 (default: count of logical processors)" << std::endl;
+	std::cerr << " --output\tJSON file which receives scaling results (default: scaling.json)" << std::endl;
+	std::cerr << " --\t\tPass remaining arguments to asmformat" << std::endl;
+}
+
+int main(int argc, char* argv[]) try
+{
+	const std::string program = fs::path(argv[0]).stem().string();
+
+	const std::string_view benchmark = argc < 2 ? "" : argv[1];
+	const bool startup = benchmark == "startup";
+
+	if (!startup && (benchmark != "scaling"))
+	{
+		PrintUsage(program);
+		return 1;
+	}
+
+	StartupOptions options;
+	ScalingOptions scaling;
+	options.asmformat = DefaultExecutable();
+
+	for (int i = 2; i < argc; ++i)
+	{
+		const std::string_view param = argv[i];
+
+		if (param == "--")
+		{
+			for (++i; i < argc; ++i)
+				options.options.push_back(fs::path(argv[i]).wstring());
+
+			break;
+		}
+
+		if (i + 1 == argc)
+		{
+			std::cerr << param << " option requires one argument" << std::endl;
+			return 1;
+		}
+
+		const std::string arg = argv[++i];
+
+		if (param == "--asmformat")
+			options.asmformat = arg;
+		else if (param == "--runs")
+			options.runs = scaling.runs = static_cast<std::size_t>(std::max(1, std::stoi(arg)));
+		else if (startup && (param == "--file"))
+			options.file = arg;
+		else if (startup && (param == "--budget"))
+			options.budget = std::stod(arg);
+		else if (!startup && (param == "--corpus"))
+			scaling.corpora.push_back(arg);
+		else if (!startup && (param == "--workers"))
+			scaling.workers = static_cast<std::size_t>(std::max(1, std::stoi(arg)));
+		else if (!startup && (param == "--output"))
+			scaling.output = arg;
+		else
+		{
+			std::cerr << "option '" << param << "' was not recognized" << std::endl;
+			PrintUsage(program);
+			return 1;
+		}
+	}
+
+	if (!fs::exists(options.asmformat))
+	{
+		std::cerr << "asmformat executable " << options.asmformat.string() << " was not found" << std::endl;
+		return 1;
+	}
+
+	std::string reason;
+
+	// Counters are optional, cycles and page faults are measured regardless
+	if (!StartCounters(reason))
+		std::cout << "hardware performance counters are not available, " << reason << std::endl << std::endl;
+
+	scaling.asmformat = options.asmformat;
+	scaling.options = options.options;
+
+	const int result = startup ? StartupBenchmark(options) : ScalingBenchmark(scaling);
+	StopCounters();
+	return result;
+}
+catch (const std::exception& ex)
+{
+	// Kernel session would keep running after benchmark exits
+	StopCounters();
+	std::cerr << ex.what() << std::endl;
+	return 1;
+}
@@ -0,0 +1,98 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file libasmformat\ThreadPool.cpp
+ *
+ * Fixed size thread pool definition
+ *
+*/
+
+#include "pch.hpp"
+#include "ThreadPool.hpp"
+
+
+ThreadPool::ThreadPool(std::size_t threads)
+{
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+
+	try
+	{
+		mThreads.reserve(threads);
+
+		for (std::size_t i = 0; i < threads; ++i)
+			mThreads.emplace_back(&ThreadPool::Worker, this);
+	}
+	catch (...)
+	{
+		// Destructor isn't called, joinable threads would terminate the process
+		Stop();
+		throw;
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	Stop();
+}
+
+void ThreadPool::Stop() noexcept
+{
+	{
+		std::lock_guard lock(mMutex);
+		mStop = true;
+	}
+
+	mQueued.notify_all();
+
+	for (std::thread& thread : mThreads)
+		thread.join();
+}
+
+void ThreadPool::Submit(std::function<void()> task)
+{
+	{
+		std::lock_guard lock(mMutex);
+		mTasks.push_back(std::move(task));
+	}
+
+	mQueued.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+	std::unique_lock lock(mMutex);
+	mIdle.wait(lock, [this] { return mTasks.empty() && (mRunning == 0); });
+}
+
+void ThreadPool::Worker()
+{
+	std::unique_lock lock(mMutex);
+
+	for (;;)
+	{
+		mQueued.wait(lock, [this] { return mStop || !mTasks.empty(); });
+
+		// Queued tasks are finished before stopping
+		if (mTasks.empty())
+			break;
+
+		std::function<void()> task = std::move(mTasks.front());
+		mTasks.pop_front();
+		++mRunning;
+		lock.unlock();
+
+		task();
+
+		lock.lock();
+		--mRunning;
+
+		if (mTasks.empty() && (mRunning == 0))
+			mIdle.notify_all();
+	}
+}
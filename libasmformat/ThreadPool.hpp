@@ -0,0 +1,96 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file libasmformat\ThreadPool.hpp
+ *
+ * Fixed size thread pool declaration
+ *
+*/
+
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+
+/**
+ * @brief Runs submitted tasks on a fixed count of worker threads.
+ * Workers are joined on destruction after all submitted tasks are done.
+*/
+class ThreadPool
+{
+	//
+	// Constructors
+	//
+public:
+	/**
+	 * @brief			Start worker threads, if a thread fails to start those already started are joined
+	 * @param threads	Count of worker threads, 0 to use one thread per processor
+	 * @throws			std::system_error if a thread could not be started
+	*/
+	explicit ThreadPool(std::size_t threads);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool(ThreadPool&&) = delete;
+
+	//
+	// Operators
+	//
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	ThreadPool& operator=(ThreadPool&&) = delete;
+
+	//
+	// Public methods
+	//
+	/**
+	 * @brief		Queue task to run on a worker thread, tasks must not throw
+	 * @param task	Task to run
+	*/
+	void Submit(std::function<void()> task);
+
+	/** Wait until all submitted tasks are done */
+	void Wait();
+
+	/** Get count of worker threads */
+	[[nodiscard]] inline std::size_t Size() const noexcept
+	{
+		return mThreads.size();
+	}
+
+	//
+	// Private methods
+	//
+private:
+	/** Worker thread procedure */
+	void Worker();
+
+	/** Stop workers once queued tasks are done and join them */
+	void Stop() noexcept;
+
+	//
+	// Members
+	//
+private:
+	// Protects all members below except mThreads
+	std::mutex mMutex;
+	// Signaled when task is queued or pool is stopping
+	std::condition_variable mQueued;
+	// Signaled when there are no queued or running tasks
+	std::condition_variable mIdle;
+	// Tasks waiting for a worker
+	std::deque<std::function<void()>> mTasks;
+	// Count of tasks currently running
+	std::size_t mRunning = 0;
+	// Set to stop workers
+	bool mStop = false;
+	std::vector<std::thread> mThreads;
+};
@@ -0,0 +1,400 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file libasmformat\libasmformat.cpp
+ *
+ * C API of the embeddable formatter library
+ *
+*/
+
+#include "pch.hpp"
+#include "libasmformat.h"
+#include "ThreadPool.hpp"
+#include "FormatFile.hpp"
+#include "SourceFile.hpp"
+#include "Kernels.hpp"
+#include "Probes.hpp"
+#include "error.hpp"
+using namespace wsl;
+
+// UTF-16LE input is formatted in place of wchar_t
+static_assert(sizeof(wchar_t) == 2, "wchar_t must be UTF-16 code unit");
+
+
+/**
+ * @brief				Map error code to status code
+ * @param error_code	Error code returned by formatter or passed to ShowError
+ * @return				Status code
+*/
+[[nodiscard]] static asmformat_status ErrorToStatus(ErrorCode error_code) noexcept
+{
+	switch (error_code)
+	{
+	case ErrorCode::ParseFailure:
+		return ASMFORMAT_PARSE_FAILURE;
+	case ErrorCode::ConversionFailed:
+		return ASMFORMAT_CONVERSION_FAILED;
+	case ErrorCode::NotImplemented:
+		return ASMFORMAT_NOT_IMPLEMENTED;
+	case ErrorCode::InvalidArgument:
+	// Input which is too large to be converted
+	case ErrorCode::OutOfRange:
+		return ASMFORMAT_INVALID_ARGUMENT;
+	case ErrorCode::AlocationFailed:
+		return ASMFORMAT_OUT_OF_MEMORY;
+	default:
+		// ex. Win32 error of MultiByteToWideChar
+		return ASMFORMAT_INTERNAL_ERROR;
+	}
+}
+
+/**
+ * @brief			Validate options and convert them to formatter arguments
+ * @param options	Options passed by caller, nullptr for defaults
+ * @param result	Receives validated options
+ * @return			true if options are valid
+*/
+[[nodiscard]] static bool GetOptions(const asmformat_options* options, asmformat_options& result) noexcept
+{
+	asmformat_default_options(&result);
+
+	if (options == nullptr)
+		return true;
+
+	if ((options->version != ASMFORMAT_API_VERSION) || (options->tab_width == 0))
+		return false;
+
+	switch (options->encoding)
+	{
+	case ASMFORMAT_ENCODING_ANSI:
+	case ASMFORMAT_ENCODING_UTF8:
+	case ASMFORMAT_ENCODING_UTF16LE:
+		break;
+	default:
+		return false;
+	}
+
+	switch (options->line_break)
+	{
+	case ASMFORMAT_LINEBREAK_PRESERVE:
+	case ASMFORMAT_LINEBREAK_LF:
+	case ASMFORMAT_LINEBREAK_CRLF:
+	case ASMFORMAT_LINEBREAK_CR:
+		break;
+	default:
+		return false;
+	}
+
+	result = *options;
+	return true;
+}
+
+/**
+ * Format input buffer into string.
+ * Errors reported by formatter are captured and converted to status code
+ *
+ * @param options		Validated options
+ * @param input			Input buffer
+ * @param input_size	Size of input in bytes
+ * @param output		Receives formatted output
+ * @return				Status code
+*/
+[[nodiscard]] static asmformat_status FormatBuffer(const asmformat_options& options, const void* input, std::size_t input_size, std::string& output) noexcept try
+{
+	ErrorCapture capture;
+	RegisterProbes();
+
+	const std::size_t tab_width = options.tab_width;
+	const bool spaces = options.spaces != 0;
+	const bool compact = options.compact != 0;
+	const bool normalize = options.normalize != 0;
+	const LineBreak line_break =
+		options.line_break == ASMFORMAT_LINEBREAK_LF ? LineBreak::LF :
+		options.line_break == ASMFORMAT_LINEBREAK_CRLF ? LineBreak::CRLF :
+		options.line_break == ASMFORMAT_LINEBREAK_CR ? LineBreak::CR : LineBreak::Preserve;
+
+	Encoding encoding =
+		options.encoding == ASMFORMAT_ENCODING_UTF8 ? Encoding::UTF8 :
+		options.encoding == ASMFORMAT_ENCODING_UTF16LE ? Encoding::UTF16LE : Encoding::ANSI;
+
+	// The only copy of input, ANSI input is handed over to formatter as is
+	std::string data(static_cast<const char*>(input), input_size);
+	std::vector<unsigned char> bom_bytes;
+
+	// GetBOM expects at least 2 bytes
+	const BOM bom = data.size() < 2 ? BOM::none : GetBOM(data, bom_bytes);
+
+	switch (BomToEncoding(bom))
+	{
+	case Encoding::UTF8:
+	case Encoding::UTF16LE:
+		encoding = BomToEncoding(bom);
+		break;
+	case Encoding::Unsupported:
+		return ASMFORMAT_UNSUPPORTED_ENCODING;
+	default:
+		break;
+	}
+
+	// BOM is not formatted, it's put back as is
+	const std::string_view body = std::string_view(data).substr(bom_bytes.size());
+	output.assign(bom_bytes.begin(), bom_bytes.end());
+
+	switch (encoding)
+	{
+	case Encoding::UTF8:
+	{
+		FormatResult<std::wstring> text = WidenUTF8(body);
+
+		if (!text)
+			return ErrorToStatus(text.error().code);
+
+		const FormatResult<std::wstring> result = FormatTextW(std::move(*text), tab_width, spaces, compact, line_break, normalize);
+
+		if (!result)
+			return ErrorToStatus(result.error().code);
+
+		// BOM assigned to output is encoded together with text
+		FormatResult<std::string> encoded = NarrowUTF8(*result, output);
+
+		if (!encoded)
+			return ErrorToStatus(encoded.error().code);
+
+		output = std::move(*encoded);
+		break;
+	}
+	case Encoding::UTF16LE:
+	{
+		if (body.size() % sizeof(wchar_t) != 0)
+			return ASMFORMAT_CONVERSION_FAILED;
+
+		std::wstring text(body.size() / sizeof(wchar_t), L'\0');
+		std::memcpy(text.data(), body.data(), body.size());
+
+		const FormatResult<std::wstring> result = FormatTextW(std::move(text), tab_width, spaces, compact, line_break, normalize);
+
+		if (!result)
+			return ErrorToStatus(result.error().code);
+
+		SUPPRESS(26490)	// Don't use reinterpret_cast
+		output.append(reinterpret_cast<const char*>(result->data()), result->size() * sizeof(wchar_t));
+		break;
+	}
+	case Encoding::ANSI:
+	default:
+	{
+		// There is no such thing as "ANSI BOM", body is the whole input
+		assert(bom_bytes.empty());
+		FormatResult<std::string> result = FormatTextA(std::move(data), tab_width, spaces, compact, line_break, normalize);
+
+		if (!result)
+			return ErrorToStatus(result.error().code);
+
+		output = std::move(*result);
+		break;
+	}
+	}
+
+	if (capture.Failed())
+		return ErrorToStatus(capture.Error());
+
+	return ASMFORMAT_OK;
+}
+catch (const std::bad_alloc&)
+{
+	return ASMFORMAT_OUT_OF_MEMORY;
+}
+catch (...)
+{
+	return ASMFORMAT_INTERNAL_ERROR;
+}
+
+/**
+ * @brief			Copy formatted output into memory allocated by library
+ * @param formatted	Formatted output
+ * @param output	Receives allocated output
+ * @return			Status code
+*/
+[[nodiscard]] static asmformat_status AllocateOutput(const std::string& formatted, void*& output) noexcept
+{
+	// malloc(0) may return nullptr which would look like a failure
+	output = std::malloc(std::max<std::size_t>(formatted.size(), 1));
+
+	if (output == nullptr)
+		return ASMFORMAT_OUT_OF_MEMORY;
+
+	std::memcpy(output, formatted.data(), formatted.size());
+	return ASMFORMAT_OK;
+}
+
+void asmformat_default_options(asmformat_options* options)
+{
+	if (options == nullptr)
+		return;
+
+	// Same as asmformat command line defaults
+	options->version = ASMFORMAT_API_VERSION;
+	options->tab_width = 4;
+	options->spaces = 0;
+	options->compact = 0;
+	options->encoding = ASMFORMAT_ENCODING_ANSI;
+	options->line_break = ASMFORMAT_LINEBREAK_PRESERVE;
+	options->normalize = 0;
+}
+
+asmformat_status asmformat_format(const asmformat_options* options, const void* input, size_t input_size, void* output, size_t* output_size)
+{
+	asmformat_options format_options;
+
+	if (((input == nullptr) && (input_size != 0)) || (output_size == nullptr) || !GetOptions(options, format_options))
+		return ASMFORMAT_INVALID_ARGUMENT;
+
+	std::string formatted;
+	const asmformat_status status = FormatBuffer(format_options, input, input_size, formatted);
+
+	if (status != ASMFORMAT_OK)
+		return status;
+
+	const std::size_t capacity = *output_size;
+	*output_size = formatted.size();
+
+	if ((output == nullptr) || (capacity < formatted.size()))
+		return ASMFORMAT_BUFFER_TOO_SMALL;
+
+	std::memcpy(output, formatted.data(), formatted.size());
+	return ASMFORMAT_OK;
+}
+
+asmformat_status asmformat_format_alloc(const asmformat_options* options, const void* input, size_t input_size, void** output, size_t* output_size)
+{
+	asmformat_options format_options;
+
+	if ((output == nullptr) || (output_size == nullptr))
+		return ASMFORMAT_INVALID_ARGUMENT;
+
+	*output = nullptr;
+	*output_size = 0;
+
+	if (((input == nullptr) && (input_size != 0)) || !GetOptions(options, format_options))
+		return ASMFORMAT_INVALID_ARGUMENT;
+
+	std::string formatted;
+	asmformat_status status = FormatBuffer(format_options, input, input_size, formatted);
+
+	if (status == ASMFORMAT_OK)
+	{
+		status = AllocateOutput(formatted, *output);
+
+		if (status == ASMFORMAT_OK)
+			*output_size = formatted.size();
+	}
+
+	return status;
+}
+
+asmformat_status asmformat_format_batch(const asmformat_options* options, asmformat_job* jobs, size_t count, unsigned int threads)
+{
+	asmformat_options format_options;
+
+	if (((jobs == nullptr) && (count != 0)) || !GetOptions(options, format_options))
+		return ASMFORMAT_INVALID_ARGUMENT;
+
+	if (count == 0)
+		return ASMFORMAT_OK;
+
+	const std::span<asmformat_job> batch(jobs, count);
+
+	for (asmformat_job& job : batch)
+	{
+		job.output = nullptr;
+		job.output_size = 0;
+		job.status = ((job.input == nullptr) && (job.input_size != 0)) ? ASMFORMAT_INVALID_ARGUMENT : ASMFORMAT_OK;
+	}
+
+	try
+	{
+		// Pool lives only for the duration of the call, this way no threads outlive the call
+		// and there is nothing to join when the library is unloaded
+		const std::size_t processors = std::max(1u, std::thread::hardware_concurrency());
+		ThreadPool pool(std::min<std::size_t>(count, threads == 0 ? processors : threads));
+
+		for (asmformat_job& job : batch)
+		{
+			if (job.status != ASMFORMAT_OK)
+				continue;
+
+			pool.Submit([&job, &format_options]
+			{
+				std::string formatted;
+				job.status = FormatBuffer(format_options, job.input, job.input_size, formatted);
+
+				if (job.status == ASMFORMAT_OK)
+					job.status = AllocateOutput(formatted, job.output);
+
+				if (job.status == ASMFORMAT_OK)
+					job.output_size = formatted.size();
+			});
+		}
+
+		pool.Wait();
+	}
+	catch (const std::bad_alloc&)
+	{
+		// Jobs which were not run keep ASMFORMAT_OK status with no output
+		return ASMFORMAT_OUT_OF_MEMORY;
+	}
+	catch (...)
+	{
+		// ex. std::system_error if thread can't be started
+		return ASMFORMAT_INTERNAL_ERROR;
+	}
+
+	for (const asmformat_job& job : batch)
+	{
+		if (job.status != ASMFORMAT_OK)
+			return job.status;
+	}
+
+	return ASMFORMAT_OK;
+}
+
+void asmformat_free(void* output)
+{
+	std::free(output);
+}
+
+const char* asmformat_status_string(asmformat_status status)
+{
+	switch (status)
+	{
+	case ASMFORMAT_OK:
+		return "Success";
+	case ASMFORMAT_INVALID_ARGUMENT:
+		return "Invalid argument";
+	case ASMFORMAT_BUFFER_TOO_SMALL:
+		return "Output buffer is too small";
+	case ASMFORMAT_UNSUPPORTED_ENCODING:
+		return "Input encoding is not supported";
+	case ASMFORMAT_CONVERSION_FAILED:
+		return "Input is not valid in its encoding";
+	case ASMFORMAT_PARSE_FAILURE:
+		return "Failed to process input";
+	case ASMFORMAT_NOT_IMPLEMENTED:
+		return "Option is not implemented";
+	case ASMFORMAT_OUT_OF_MEMORY:
+		return "Out of memory";
+	case ASMFORMAT_INTERNAL_ERROR:
+	default:
+		return "Internal error";
+	}
+}
+
+const char* asmformat_version(void)
+{
+	return "0.5.0";
+}
@@ -0,0 +1,179 @@
+/*
+ * Project: "ASM Formatter" https://github.com/metablaster/ASM-Formatter
+ * Copyright(C) 2023 metablaster (zebal@protonmail.ch)
+ * Licensed under the MIT license
+ *
+*/
+
+/**
+ * @file libasmformat\libasmformat.h
+ *
+ * C API of the embeddable formatter library
+ *
+ * The library formats source files held in memory, it doesn't access the file system, console,
+ * console code page or show message boxes, failures are reported with status codes.
+ * All functions are thread safe.
+ *
+ * Define ASMFORMAT_STATIC when linking to static library.
+ *
+*/
+
+#pragma once
+#include <stddef.h>
+
+#if defined ASMFORMAT_STATIC
+#define ASMFORMAT_API
+#elif defined ASMFORMAT_EXPORTS
+#define ASMFORMAT_API __declspec(dllexport)
+#else
+#define ASMFORMAT_API __declspec(dllimport)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Version of the API declared by this header, checked against options.version */
+#define ASMFORMAT_API_VERSION 1
+
+/**
+ * @brief Status codes returned by library functions
+*/
+typedef enum asmformat_status
+{
+	ASMFORMAT_OK = 0,					/* Success */
+	ASMFORMAT_INVALID_ARGUMENT,			/* Null pointer, invalid option or input too large to convert */
+	ASMFORMAT_BUFFER_TOO_SMALL,			/* Output buffer is too small, required size is returned */
+	ASMFORMAT_UNSUPPORTED_ENCODING,		/* Input has a BOM of unsupported encoding, ex. UTF-16BE */
+	ASMFORMAT_CONVERSION_FAILED,		/* Input is not valid in its encoding */
+	ASMFORMAT_PARSE_FAILURE,			/* Formatter failed to process input */
+	ASMFORMAT_NOT_IMPLEMENTED,			/* Requested option is not implemented */
+	ASMFORMAT_OUT_OF_MEMORY,			/* Memory allocation failed */
+	ASMFORMAT_INTERNAL_ERROR			/* Any other failure */
+} asmformat_status;
+
+/**
+ * @brief Encoding of input which has no BOM, input which has a BOM is always formatted in encoding of its BOM
+*/
+typedef enum asmformat_encoding
+{
+	ASMFORMAT_ENCODING_ANSI = 0,
+	ASMFORMAT_ENCODING_UTF8,
+	ASMFORMAT_ENCODING_UTF16LE
+} asmformat_encoding;
+
+/**
+ * @brief Line breaks conversion
+*/
+typedef enum asmformat_linebreak
+{
+	ASMFORMAT_LINEBREAK_PRESERVE = 0,
+	ASMFORMAT_LINEBREAK_LF,
+	ASMFORMAT_LINEBREAK_CRLF,
+	ASMFORMAT_LINEBREAK_CR
+} asmformat_linebreak;
+
+/**
+ * @brief Formatting options, initialize with asmformat_default_options
+*/
+typedef struct asmformat_options
+{
+	/* Must be ASMFORMAT_API_VERSION */
+	unsigned int version;
+	/* Count of spaces ocupying a tab character, must not be 0 */
+	unsigned int tab_width;
+	/* Use spaces instead of tabs? */
+	int spaces;
+	/* Replace all surplus blank lines with single blank line */
+	int compact;
+	/* Encoding of input which has no BOM */
+	asmformat_encoding encoding;
+	/* Line breaks conversion */
+	asmformat_linebreak line_break;
+	/* Replace whitespace between code tokens with tabs or spaces according to spaces member */
+	int normalize;
+} asmformat_options;
+
+/**
+ * @brief Single input of batch formatting
+*/
+typedef struct asmformat_job
+{
+	/* [in] Input buffer, including BOM if any */
+	const void* input;
+	/* [in] Size of input in bytes */
+	size_t input_size;
+	/* [out] Output allocated by library, release with asmformat_free, NULL on failure */
+	void* output;
+	/* [out] Size of output in bytes */
+	size_t output_size;
+	/* [out] Status of this job */
+	asmformat_status status;
+} asmformat_job;
+
+/**
+ * @brief			Fill options with defaults used by asmformat command line
+ * @param options	Options which to initialize
+*/
+ASMFORMAT_API void asmformat_default_options(asmformat_options* options);
+
+/**
+ * Format input into caller provided output buffer.
+ * Output is encoded same as input and keeps input BOM if any.
+ *
+ * @param options		Formatting options, NULL for defaults
+ * @param input			Input buffer
+ * @param input_size	Size of input in bytes
+ * @param output		Output buffer, may be NULL to query required size
+ * @param output_size	[in] Size of output buffer, [out] size of formatted output.
+ *						If output is too small ASMFORMAT_BUFFER_TOO_SMALL is returned together with required size,
+ *						note that in this case input is formatted again on next call.
+ * @return				Status code
+*/
+ASMFORMAT_API asmformat_status asmformat_format(const asmformat_options* options, const void* input, size_t input_size, void* output, size_t* output_size);
+
+/**
+ * @brief				Format input into output allocated by library
+ * @param options		Formatting options, NULL for defaults
+ * @param input			Input buffer
+ * @param input_size	Size of input in bytes
+ * @param output		Receives output which must be released with asmformat_free, NULL on failure
+ * @param output_size	Receives size of output in bytes
+ * @return				Status code
+*/
+ASMFORMAT_API asmformat_status asmformat_format_alloc(const asmformat_options* options, const void* input, size_t input_size, void** output, size_t* output_size);
+
+/**
+ * Format multiple inputs concurrently on an internal thread pool.
+ * Each job receives its own output and status, failure of one job doesn't affect other jobs.
+ *
+ * @param options		Formatting options used for all jobs, NULL for defaults
+ * @param jobs			Array of jobs
+ * @param count			Count of jobs in array
+ * @param threads		Maximum count of threads, 0 to use one thread per processor
+ * @return				ASMFORMAT_OK if all jobs succeeded, status of the first failed job otherwise
+*/
+ASMFORMAT_API asmformat_status asmformat_format_batch(const asmformat_options* options, asmformat_job* jobs, size_t count, unsigned int threads);
+
+/**
+ * @brief			Release output allocated by library
+ * @param output	Output to release, may be NULL
+*/
+ASMFORMAT_API void asmformat_free(void* output);
+
+/**
+ * @brief			Get description of a status code
+ * @param status	Status code
+ * @return			Static string which is never NULL
+*/
+ASMFORMAT_API const char* asmformat_status_string(asmformat_status status);
+
+/**
+ * @brief	Get library version string
+ * @return	Static string which is never NULL
+*/
+ASMFORMAT_API const char* asmformat_version(void);
+
+#ifdef __cplusplus
+}
+#endif